@@ -0,0 +1,102 @@
+#include "async_recognizer.h"
+
+static const int kDecodeChunkSamples = 1600; // 0.1 s at 16 kHz per AcceptWaveform on the worker
+
+AsyncRecognizer::AsyncRecognizer(Model *model, float buffer_seconds,
+                                 AsyncRecognizerCallback callback, void *user_data)
+        : recognizer_(model),
+          buffer_(static_cast<size_t>(16000 * (buffer_seconds > 0 ? buffer_seconds : 5.0f))),
+          callback_(callback),
+          user_data_(user_data),
+          input_finished_(false),
+          stop_(false),
+          dropped_samples_(0),
+          overrun_(false) {
+    worker_ = std::thread(&AsyncRecognizer::Run, this);
+}
+
+int AsyncRecognizer::AcceptWaveform(const short *sdata, int len) {
+    size_t n = buffer_.Push(sdata, len);
+    if (n < static_cast<size_t>(len)) {
+        dropped_samples_ += len - n;
+        // Warn once per overrun, not for every chunk the recorder hands us while it lasts
+        if (!overrun_) {
+            overrun_ = true;
+            KALDI_WARN << "Decoder is behind, dropping samples ("
+                       << dropped_samples_.load() << " dropped so far)";
+        }
+    } else {
+        overrun_ = false;
+    }
+    Notify();
+    return static_cast<int>(n);
+}
+
+void AsyncRecognizer::InputFinished() {
+    input_finished_ = true;
+    Notify();
+}
+
+void AsyncRecognizer::Notify() {
+    // The state change (push, flag) happens before this, outside the lock. Taking
+    // the lock once orders it against the worker's predicate check so the
+    // notification cannot fall between the check and the wait. The worker only
+    // holds the mutex around that check, never while decoding.
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    cond_.notify_one();
+}
+
+void AsyncRecognizer::Run() {
+    short chunk[kDecodeChunkSamples];
+    while (!stop_) {
+        size_t n = buffer_.Pop(chunk, kDecodeChunkSamples);
+        if (n == 0) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] {
+                    return stop_ || input_finished_ || buffer_.Size() > 0;
+                });
+            }
+            // The flag is read before the buffer size: samples pushed before
+            // InputFinished() are then always visible and decoded first.
+            if (input_finished_ && buffer_.Size() == 0) {
+                input_finished_ = false;
+                const char *res = "";
+                try {
+                    res = recognizer_.FinalResult();
+                } catch (...) {
+                    KALDI_WARN << "Final decoding failed on the async worker";
+                }
+                last_partial_.clear();
+                if (callback_) callback_(user_data_, ASYNC_EVENT_FINAL, res);
+            }
+            continue;
+        }
+
+        try {
+            if (recognizer_.AcceptWaveform(chunk, static_cast<int>(n))) {
+                const char *res = recognizer_.Result();
+                last_partial_.clear();
+                if (callback_) callback_(user_data_, ASYNC_EVENT_RESULT, res);
+            } else if (buffer_.Size() < kDecodeChunkSamples) {
+                // Only report partials once caught up, no point formatting them mid-backlog
+                const char *res = recognizer_.PartialResult();
+                if (last_partial_ != res) {
+                    last_partial_ = res;
+                    if (callback_) callback_(user_data_, ASYNC_EVENT_PARTIAL, res);
+                }
+            }
+        } catch (...) {
+            KALDI_WARN << "Decoding failed on the async worker, resetting recognizer";
+            recognizer_.Reset();
+        }
+    }
+}
+
+AsyncRecognizer::~AsyncRecognizer() {
+    stop_ = true;
+    Notify();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
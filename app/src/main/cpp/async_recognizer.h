@@ -0,0 +1,55 @@
+#ifndef KALDIANDROID_ASYNC_RECOGNIZER_H
+#define KALDIANDROID_ASYNC_RECOGNIZER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "audio_ring_buffer.h"
+#include "recognizer.h"
+
+enum AsyncRecognizerEvent {
+    ASYNC_EVENT_PARTIAL,   // partial result changed
+    ASYNC_EVENT_RESULT,    // endpoint detected, result of the finished utterance
+    ASYNC_EVENT_FINAL      // input finished, final result of the stream
+};
+
+// result is only valid for the duration of the callback
+typedef void (*AsyncRecognizerCallback)(void *user_data, int event, const char *result);
+
+// Runs a Recognizer on its own decode thread. The caller (normally the audio
+// recorder thread) only copies samples into a lock-free ring buffer, so a slow
+// nnet3 chunk or lattice operation never blocks the audio read.
+class AsyncRecognizer {
+public:
+    AsyncRecognizer(Model *model, float buffer_seconds,
+                    AsyncRecognizerCallback callback, void *user_data);
+    // Returns the number of samples queued, less than len if the decoder fell
+    // behind by more than the buffer size (the rest is dropped and counted).
+    int AcceptWaveform(const short *sdata, int len);
+    // Decode what is left in the buffer and deliver ASYNC_EVENT_FINAL
+    void InputFinished();
+    int64 DroppedSamples() const { return dropped_samples_.load(); }
+    ~AsyncRecognizer();
+private:
+    void Run();
+    void Notify();
+
+    Recognizer recognizer_;
+    AudioRingBuffer<short> buffer_;
+    AsyncRecognizerCallback callback_;
+    void *user_data_;
+
+    std::thread worker_;
+    std::mutex mutex_; // only guards sleeping/waking of the worker, not the audio path
+    std::condition_variable cond_;
+    std::atomic<bool> input_finished_;
+    std::atomic<bool> stop_;
+    std::atomic<int64> dropped_samples_;
+    bool overrun_; // producer side only: a drop was already reported for this overrun
+
+    string last_partial_;
+};
+
+#endif // KALDIANDROID_ASYNC_RECOGNIZER_H
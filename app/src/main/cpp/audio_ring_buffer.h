@@ -0,0 +1,81 @@
+#ifndef KALDIANDROID_AUDIO_RING_BUFFER_H
+#define KALDIANDROID_AUDIO_RING_BUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+// Single-producer single-consumer ring buffer of audio samples.
+// Push() must only be called from one thread (the recorder) and Pop() from one
+// other thread (the decode worker). Neither side ever blocks or takes a lock.
+template <typename T>
+class AudioRingBuffer {
+public:
+    // capacity is rounded up to a power of two so indices can be masked
+    explicit AudioRingBuffer(size_t capacity): head_(0), tail_(0) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        data_.resize(size);
+        mask_ = size - 1;
+    }
+
+    size_t Capacity() const { return data_.size(); }
+
+    size_t Size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // Returns the number of samples actually written, less than len when full
+    size_t Push(const T *samples, size_t len) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t n = std::min(len, data_.size() - (head - tail));
+        CopyIn(head, samples, n);
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Returns the number of samples actually read, 0 when empty
+    size_t Pop(T *samples, size_t len) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t n = std::min(len, head - tail);
+        CopyOut(tail, samples, n);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Pop() without the copy, from the consumer side
+    size_t Discard(size_t len) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t n = std::min(len, head - tail);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    void CopyIn(size_t pos, const T *src, size_t n) {
+        size_t start = pos & mask_;
+        size_t first = std::min(n, data_.size() - start);
+        memcpy(&data_[start], src, first * sizeof(T));
+        memcpy(&data_[0], src + first, (n - first) * sizeof(T));
+    }
+
+    void CopyOut(size_t pos, T *dst, size_t n) const {
+        size_t start = pos & mask_;
+        size_t first = std::min(n, data_.size() - start);
+        memcpy(dst, &data_[start], first * sizeof(T));
+        memcpy(dst + first, &data_[0], (n - first) * sizeof(T));
+    }
+
+    std::vector<T> data_;
+    size_t mask_;
+    // producer and consumer indices kept on separate cache lines to avoid false sharing
+    std::atomic<size_t> head_;
+    char pad_[64];
+    std::atomic<size_t> tail_;
+};
+
+#endif // KALDIANDROID_AUDIO_RING_BUFFER_H
@@ -0,0 +1,203 @@
+#include "batch_nnet_computer.h"
+
+#include <chrono>
+
+static nnet3::NnetBatchComputerOptions MakeComputerOptions(const BatchComputeOptions &opts,
+                                                           int32 frame_subsampling_factor,
+                                                           BaseFloat acoustic_scale) {
+    nnet3::NnetBatchComputerOptions computer_opts;
+    computer_opts.minibatch_size = opts.max_batch_size;
+    computer_opts.edge_minibatch_size = opts.max_batch_size; // chunks are padded, never edge-shaped
+    computer_opts.frame_subsampling_factor = frame_subsampling_factor;
+    // NnetBatchComputer scales its outputs, so DecodableAmNnetBatchOnline
+    // returns them as they are
+    computer_opts.acoustic_scale = acoustic_scale;
+    // round the chunk up so every chunk produces a whole number of output frames
+    computer_opts.frames_per_chunk = frame_subsampling_factor *
+            ((opts.frames_per_chunk + frame_subsampling_factor - 1) / frame_subsampling_factor);
+    return computer_opts;
+}
+
+BatchNnetComputer::BatchNnetComputer(const BatchComputeOptions &opts,
+                                     const nnet3::AmNnetSimple &am_nnet,
+                                     int32 frame_subsampling_factor,
+                                     BaseFloat acoustic_scale)
+        : opts_(opts),
+          computer_opts_(MakeComputerOptions(opts, frame_subsampling_factor, acoustic_scale)),
+          computer_(computer_opts_, am_nnet.GetNnet(), am_nnet.Priors()) {
+    KALDI_ASSERT(opts_.max_batch_size >= 2);
+    kaldi::nnet3::ComputeSimpleNnetContext(am_nnet.GetNnet(), &left_context_, &right_context_);
+    frames_per_chunk_ = computer_opts_.frames_per_chunk;
+    KALDI_LOG << "Batched nnet3 computation, max-batch-size=" << opts_.max_batch_size <<
+                 " frames-per-chunk=" << frames_per_chunk_ <<
+                 " left-context=" << left_context_ << " right-context=" << right_context_;
+    worker_ = std::thread(&BatchNnetComputer::Run, this);
+}
+
+void BatchNnetComputer::Compute(nnet3::NnetInferenceTask *task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // older chunks first, so no stream starves behind others
+        task->priority = -static_cast<double>(num_submitted_++);
+    }
+    computer_.AcceptTask(task);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+    }
+    cond_.notify_one();
+    task->semaphore.Wait();
+}
+
+void BatchNnetComputer::Run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || queued_ > 0; });
+            if (stop_ && queued_ == 0) {
+                break;
+            }
+            // give the other streams a moment to submit their chunks
+            cond_.wait_for(lock, std::chrono::microseconds(opts_.compute_interval),
+                           [this] { return stop_ || queued_ >= opts_.max_batch_size; });
+            // every task counted so far is already in computer_ and is computed below
+            queued_ = 0;
+        }
+        while (computer_.Compute(true)) { }
+    }
+}
+
+BatchNnetComputer::~BatchNnetComputer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+
+DecodableAmNnetBatchOnline::DecodableAmNnetBatchOnline(BatchNnetComputer *computer,
+                                                       const TransitionModel &trans_model,
+                                                       OnlineFeatureInterface *input_features,
+                                                       OnlineFeatureInterface *ivector_features)
+        : computer_(computer),
+          trans_model_(trans_model),
+          input_features_(input_features),
+          ivector_features_(ivector_features) {
+}
+
+int32 DecodableAmNnetBatchOnline::NumFramesReady() const {
+    int32 features_ready = input_features_->NumFramesReady();
+    if (features_ready == 0) {
+        return 0;
+    }
+    bool input_finished = input_features_->IsLastFrame(features_ready - 1);
+    int32 sf = computer_->FrameSubsamplingFactor();
+    if (input_finished) {
+        return (features_ready + sf - 1) / sf - frame_offset_;
+    }
+    // chunk k needs input frames up to (k + 1) * fpc - sf + right_context
+    int32 fpc = computer_->FramesPerChunk();
+    int32 num_chunks_ready = std::max<int32>(
+            0, features_ready - computer_->RightContext() + sf - 1) / fpc;
+    return num_chunks_ready * fpc / sf - frame_offset_;
+}
+
+bool DecodableAmNnetBatchOnline::IsLastFrame(int32 subsampled_frame) const {
+    int32 features_ready = input_features_->NumFramesReady();
+    if (features_ready == 0) {
+        return subsampled_frame == -1 && input_features_->IsLastFrame(-1);
+    }
+    if (!input_features_->IsLastFrame(features_ready - 1)) {
+        return false;
+    }
+    int32 sf = computer_->FrameSubsamplingFactor();
+    int32 num_subsampled_frames_ready = (features_ready + sf - 1) / sf;
+    return subsampled_frame + frame_offset_ == num_subsampled_frames_ready - 1;
+}
+
+void DecodableAmNnetBatchOnline::SetFrameOffset(int32 frame_offset) {
+    KALDI_ASSERT(0 <= frame_offset && frame_offset <= frame_offset_ + NumFramesReady());
+    frame_offset_ = frame_offset;
+}
+
+void DecodableAmNnetBatchOnline::Reset(OnlineFeatureInterface *input_features,
+                                       OnlineFeatureInterface *ivector_features) {
+    input_features_ = input_features;
+    ivector_features_ = ivector_features;
+    num_chunks_computed_ = 0;
+    current_log_post_subsampled_offset_ = 0;
+    frame_offset_ = 0;
+    current_log_post_.Resize(0, 0);
+}
+
+BaseFloat DecodableAmNnetBatchOnline::LogLikelihood(int32 subsampled_frame, int32 transition_id) {
+    int32 frame = subsampled_frame + frame_offset_;
+    EnsureFrameIsComputed(frame);
+    return current_log_post_(frame - current_log_post_subsampled_offset_,
+                             trans_model_.TransitionIdToPdfFast(transition_id));
+}
+
+void DecodableAmNnetBatchOnline::EnsureFrameIsComputed(int32 subsampled_frame) {
+    KALDI_ASSERT(subsampled_frame >= current_log_post_subsampled_offset_ &&
+                 "Frames must be accessed in order.");
+    while (subsampled_frame >= current_log_post_subsampled_offset_ + current_log_post_.NumRows()) {
+        AdvanceChunk();
+    }
+}
+
+void DecodableAmNnetBatchOnline::AdvanceChunk() {
+    int32 sf = computer_->FrameSubsamplingFactor();
+    int32 fpc = computer_->FramesPerChunk();
+    int32 num_outputs = fpc / sf;
+    int32 begin_output_t = num_chunks_computed_ * fpc;
+    int32 begin_input_t = begin_output_t - computer_->LeftContext();
+    int32 end_input_t = begin_output_t + (num_outputs - 1) * sf + computer_->RightContext() + 1;
+
+    int32 features_ready = input_features_->NumFramesReady();
+    bool input_finished = input_features_->IsLastFrame(features_ready - 1);
+    KALDI_ASSERT(features_ready > 0 && (input_finished || end_input_t <= features_ready));
+
+    // Pad with repeats of the first and last frames, as the looped decodable does
+    std::vector<int32> frames;
+    frames.reserve(end_input_t - begin_input_t);
+    for (int32 t = begin_input_t; t < end_input_t; t++) {
+        frames.push_back(std::min(std::max(t, 0), features_ready - 1));
+    }
+    Matrix<BaseFloat> feats(frames.size(), input_features_->Dim(), kUndefined);
+    input_features_->GetFrames(frames, &feats);
+
+    nnet3::NnetInferenceTask task;
+    task.input.Swap(&feats);
+    task.first_input_t = -computer_->LeftContext();
+    task.output_t_stride = sf;
+    task.num_output_frames = num_outputs;
+    task.num_initial_unused_output_frames = 0;
+    task.first_used_output_frame_index = num_chunks_computed_ * num_outputs;
+    task.num_used_output_frames = num_outputs;
+    if (input_finished) {
+        int32 total_outputs = (features_ready + sf - 1) / sf;
+        task.num_used_output_frames = std::min(num_outputs,
+                                               total_outputs - task.first_used_output_frame_index);
+    }
+    task.is_edge = false;
+    task.is_irregular = false;
+    task.output_to_cpu = true;
+    if (ivector_features_ != nullptr) {
+        // one i-vector per chunk, taken at the last input frame like the looped computation
+        int32 ivector_frame = std::min(end_input_t, ivector_features_->NumFramesReady()) - 1;
+        Vector<BaseFloat> ivector(ivector_features_->Dim());
+        ivector_features_->GetFrame(std::max(ivector_frame, 0), &ivector);
+        task.ivector.Resize(ivector.Dim(), kUndefined);
+        task.ivector.CopyFromVec(ivector);
+    }
+
+    computer_->Compute(&task);
+
+    current_log_post_.Swap(&task.output_cpu);
+    current_log_post_subsampled_offset_ = num_chunks_computed_ * num_outputs;
+    num_chunks_computed_++;
+}
@@ -0,0 +1,113 @@
+#ifndef KALDIANDROID_BATCH_NNET_COMPUTER_H
+#define KALDIANDROID_BATCH_NNET_COMPUTER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+// Options for batched acoustic scoring, read from model.conf together with the
+// decoding options. Batching is off unless --max-batch-size is at least 2.
+struct BatchComputeOptions {
+    int32 max_batch_size;
+    int32 frames_per_chunk;
+    int32 compute_interval;
+
+    BatchComputeOptions(): max_batch_size(0),
+                           frames_per_chunk(51),
+                           compute_interval(2000) { }
+
+    void Register(OptionsItf *opts) {
+        opts->Register("max-batch-size", &max_batch_size,
+                       "If >= 2, all recognizers of a model submit their nnet3 chunks "
+                       "to one shared computer, which evaluates up to this many chunks "
+                       "in a single computation.");
+        opts->Register("batch-frames-per-chunk", &frames_per_chunk,
+                       "Input frames per chunk in batched mode. Batched chunks are not "
+                       "looped, each one carries its own left/right context, so this "
+                       "should be well above the model context.");
+        opts->Register("batch-compute-interval", &compute_interval,
+                       "Microseconds to wait for more streams before computing a "
+                       "partial batch.");
+    }
+};
+
+// Shared by all recognizers of a Model. Decoding threads hand in one chunk each
+// and block; a single compute thread merges pending chunks of different streams
+// into one minibatch so the nnet runs a few large matrix products instead of
+// many small ones.
+class BatchNnetComputer {
+public:
+    BatchNnetComputer(const BatchComputeOptions &opts,
+                      const nnet3::AmNnetSimple &am_nnet,
+                      int32 frame_subsampling_factor,
+                      BaseFloat acoustic_scale);
+    // Queue the task and wait until its output is computed
+    void Compute(nnet3::NnetInferenceTask *task);
+
+    int32 LeftContext() const { return left_context_; }
+    int32 RightContext() const { return right_context_; }
+    int32 FramesPerChunk() const { return frames_per_chunk_; }
+    int32 FrameSubsamplingFactor() const { return computer_opts_.frame_subsampling_factor; }
+
+    ~BatchNnetComputer();
+private:
+    void Run();
+
+    BatchComputeOptions opts_;
+    nnet3::NnetBatchComputerOptions computer_opts_;
+    nnet3::NnetBatchComputer computer_;
+    int32 left_context_;
+    int32 right_context_;
+    int32 frames_per_chunk_;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int32 queued_ = 0; // tasks accepted since the worker last drained the computer
+    int64 num_submitted_ = 0;
+    bool stop_ = false;
+};
+
+// Online decodable that gets its log-likelihoods from a BatchNnetComputer.
+// Mirrors nnet3::DecodableAmNnetLoopedOnline (frame offset, frames ready, last
+// frame), but each chunk is computed with explicit context instead of the
+// looped state, which is what allows chunks of different streams to share a
+// computation.
+class DecodableAmNnetBatchOnline: public DecodableInterface {
+public:
+    DecodableAmNnetBatchOnline(BatchNnetComputer *computer,
+                               const TransitionModel &trans_model,
+                               OnlineFeatureInterface *input_features,
+                               OnlineFeatureInterface *ivector_features);
+
+    virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 transition_id);
+    virtual bool IsLastFrame(int32 subsampled_frame) const;
+    virtual int32 NumFramesReady() const;
+    virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+    int32 FrameSubsamplingFactor() const { return computer_->FrameSubsamplingFactor(); }
+    void SetFrameOffset(int32 frame_offset);
+    // Start over on the features of a new utterance
+    void Reset(OnlineFeatureInterface *input_features, OnlineFeatureInterface *ivector_features);
+private:
+    void EnsureFrameIsComputed(int32 subsampled_frame);
+    void AdvanceChunk();
+
+    BatchNnetComputer *computer_;
+    const TransitionModel &trans_model_;
+    OnlineFeatureInterface *input_features_;
+    OnlineFeatureInterface *ivector_features_;
+
+    Matrix<BaseFloat> current_log_post_;
+    int32 num_chunks_computed_ = 0;
+    int32 current_log_post_subsampled_offset_ = 0;
+    int32 frame_offset_ = 0;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetBatchOnline);
+};
+
+#endif // KALDIANDROID_BATCH_NNET_COMPUTER_H
@@ -0,0 +1,257 @@
+#include "batch_transcriber.h"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+BatchTranscriber::BatchTranscriber(Model *model, const BatchTranscriberOptions &opts)
+        : model_(model), opts_(opts) {
+    if (model_->HasGrammar()) {
+        KALDI_ERR << "Batch transcription does not support grammar graphs";
+    }
+    model_->Ref();
+
+    // Same search as the streaming recognizers, only without incremental determinization
+    const LatticeIncrementalDecoderConfig &config = model_->nnet3_decoding_config_;
+    decoder_config_.beam = config.beam;
+    decoder_config_.max_active = config.max_active;
+    decoder_config_.min_active = config.min_active;
+    decoder_config_.lattice_beam = config.lattice_beam;
+    decoder_config_.prune_interval = config.prune_interval;
+    decoder_config_.beam_delta = config.beam_delta;
+    decoder_config_.hash_ratio = config.hash_ratio;
+    decoder_config_.prune_scale = config.prune_scale;
+    decoder_config_.det_opts = config.det_opts;
+
+    // the model's acoustic scale is applied once, by the decodable in Transcribe()
+    opts_.compute_opts.acoustic_scale = 1.0;
+    opts_.compute_opts.frame_subsampling_factor = model_->decodable_opts_.frame_subsampling_factor;
+    opts_.num_threads = std::max(opts_.num_threads, 1);
+    opts_.read_ahead = std::max(opts_.read_ahead, 1);
+    computer_ = new nnet3::NnetBatchComputer(opts_.compute_opts, model_->nnet_->GetNnet(),
+                                             model_->nnet_->Priors());
+
+    if (opts_.rescore) {
+        rescore_ = model_->EnsureRescoring();
+    }
+}
+
+BatchTranscriber::~BatchTranscriber() {
+    delete computer_;
+    model_->Unref();
+}
+
+void BatchTranscriber::Run(const std::vector<std::pair<string, string> > &inputs,
+                           std::vector<BatchTranscriberResult> *results) {
+    results->clear();
+    results->resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        (*results)[i].key = inputs[i].first;
+    }
+    reading_done_ = false;
+
+    std::thread reader(&BatchTranscriber::ReadAudio, this, std::cref(inputs));
+    std::vector<std::thread> workers;
+    for (int32 i = 0; i < opts_.num_threads; i++) {
+        workers.push_back(std::thread(&BatchTranscriber::Work, this, results));
+    }
+    reader.join();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void BatchTranscriber::ReadAudio(const std::vector<std::pair<string, string> > &inputs) {
+    for (size_t i = 0; i < inputs.size(); i++) {
+        AudioItem *item = new AudioItem();
+        item->index = i;
+        item->ok = false;
+        try {
+            std::ifstream is(inputs[i].second.c_str(), std::ios::binary);
+            if (is) {
+                item->wave.Read(is);
+                item->ok = item->wave.Data().NumCols() > 0;
+            }
+        } catch (const std::exception &e) {
+            KALDI_WARN << "Failed to read " << inputs[i].second << ": " << e.what();
+        }
+        if (!item->ok) {
+            KALDI_WARN << "No audio in " << inputs[i].second;
+        }
+
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_not_full_.wait(lock, [this] {
+            return queue_.size() < static_cast<size_t>(opts_.read_ahead);
+        });
+        queue_.push_back(item);
+        queue_not_empty_.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    reading_done_ = true;
+    queue_not_empty_.notify_all();
+}
+
+void BatchTranscriber::Work(std::vector<BatchTranscriberResult> *results) {
+    // Per worker: the decoder keeps its token storage from file to file, a
+    // lookahead graph and the LM caches are not safe to share between threads.
+    // The CARPA state cache is started over for every file so it does not grow
+    // with the archive.
+    std::unique_ptr<fst::Fst<fst::StdArc> > decode_fst;
+    if (!model_->HCLG_fst_) {
+        decode_fst.reset(fst::LookaheadComposeFst(*model_->HCLr_fst_, *model_->Gr_fst_,
+                                                  model_->disambig_));
+    }
+    LatticeFasterDecoder decoder(model_->HCLG_fst_ ? *model_->HCLG_fst_ : *decode_fst,
+                                 decoder_config_);
+    std::unique_ptr<fst::BackoffDeterministicOnDemandFst<fst::StdArc> > lm_to_subtract_det_backoff;
+    std::unique_ptr<fst::ScaleDeterministicOnDemandFst> lm_to_subtract_det_scale;
+    std::unique_ptr<ConstArpaLmDeterministicFst> carpa_to_add;
+    if (rescore_) {
+        lm_to_subtract_det_backoff.reset(
+                new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(*model_->graph_lm_fst_));
+        lm_to_subtract_det_scale.reset(
+                new fst::ScaleDeterministicOnDemandFst(-1.0, lm_to_subtract_det_backoff.get()));
+    }
+
+    while (true) {
+        AudioItem *item;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_not_empty_.wait(lock, [this] { return !queue_.empty() || reading_done_; });
+            if (queue_.empty()) {
+                return;
+            }
+            item = queue_.front();
+            queue_.pop_front();
+            queue_not_full_.notify_one();
+        }
+
+        BatchTranscriberResult &result = (*results)[item->index];
+        if (item->ok) {
+            Timer timer;
+            result.audio_seconds = item->wave.Duration();
+            if (rescore_) {
+                carpa_to_add.reset(new ConstArpaLmDeterministicFst(model_->const_arpa_));
+            }
+            try {
+                result.ok = Transcribe(item->wave, &decoder, lm_to_subtract_det_scale.get(),
+                                       carpa_to_add.get(), &result.text);
+            } catch (const std::exception &e) {
+                KALDI_WARN << "Failed to transcribe " << result.key << ": " << e.what();
+            }
+            result.seconds = timer.Elapsed();
+            KALDI_VLOG(1) << result.key << ": " << result.audio_seconds << " s audio in "
+                          << result.seconds << " s";
+        }
+        delete item;
+    }
+}
+
+void BatchTranscriber::ComputeFeatures(const WaveData &wave, Matrix<BaseFloat> *features,
+                                       Matrix<BaseFloat> *ivectors) {
+    OnlineNnet2FeaturePipeline pipeline(model_->feature_info_);
+    SubVector<BaseFloat> samples(wave.Data(), 0); // first channel
+    pipeline.AcceptWaveform(wave.SampFreq(), samples);
+    pipeline.InputFinished();
+
+    int32 num_frames = pipeline.NumFramesReady();
+    OnlineFeatureInterface *input = pipeline.InputFeature();
+    features->Resize(num_frames, input->Dim(), kUndefined);
+    for (int32 t = 0; t < num_frames; t++) {
+        SubVector<BaseFloat> row(*features, t);
+        input->GetFrame(t, &row);
+    }
+
+    // the online iVectors the streaming decoder would have seen, one per period
+    OnlineFeatureInterface *ivector = pipeline.IvectorFeature();
+    if (ivector == nullptr) {
+        ivectors->Resize(0, 0);
+        return;
+    }
+    int32 period = model_->feature_info_.ivector_extractor_info.ivector_period;
+    int32 num_ivectors = (num_frames + period - 1) / period;
+    ivectors->Resize(num_ivectors, ivector->Dim(), kUndefined);
+    for (int32 i = 0; i < num_ivectors; i++) {
+        SubVector<BaseFloat> row(*ivectors, i);
+        ivector->GetFrame(i * period, &row);
+    }
+}
+
+void BatchTranscriber::ComputeLoglikes(const Matrix<BaseFloat> &features,
+                                       const Matrix<BaseFloat> &ivectors,
+                                       Matrix<BaseFloat> *loglikes) {
+    std::vector<nnet3::NnetInferenceTask> tasks;
+    int32 period = model_->feature_info_.ivector_extractor_info.ivector_period;
+    computer_->SplitUtteranceIntoTasks(true, features, nullptr,
+                                       ivectors.NumRows() > 0 ? &ivectors : nullptr, period, &tasks);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        computer_->AcceptTask(&tasks[i]);
+    }
+    // Help out instead of blocking: run a full minibatch if one is ready, else
+    // a partial one rather than leave the core idle
+    for (size_t i = 0; i < tasks.size(); i++) {
+        while (!tasks[i].semaphore.TryWait()) {
+            if (!computer_->Compute(false) && !computer_->Compute(true)) {
+                // nothing left in the queue, another worker is computing our chunk
+                tasks[i].semaphore.Wait();
+                break;
+            }
+        }
+    }
+    nnet3::MergeTaskOutput(tasks, loglikes);
+}
+
+bool BatchTranscriber::Transcribe(const WaveData &wave, LatticeFasterDecoder *decoder,
+                                  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                                  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add,
+                                  string *text) {
+    Matrix<BaseFloat> features, ivectors, loglikes;
+    ComputeFeatures(wave, &features, &ivectors);
+    if (features.NumRows() == 0) {
+        text->clear();
+        return true;
+    }
+    ComputeLoglikes(features, ivectors, &loglikes);
+
+    DecodableMatrixScaledMapped decodable(*model_->trans_model_, loglikes,
+                                          model_->decodable_opts_.acoustic_scale);
+    decoder->Decode(&decodable);
+    Lattice lat;
+    if (!decoder->GetRawLattice(&lat, decoder->ReachedFinal()) || lat.NumStates() == 0) {
+        KALDI_WARN << "Decoding failed";
+        return false;
+    }
+    CompactLattice clat;
+    DeterminizeLatticePhonePrunedWrapper(*model_->trans_model_, &lat, decoder_config_.lattice_beam,
+                                         &clat, decoder_config_.det_opts);
+
+    // Subtract G.fst and add CARPA, as Recognizer::GetResult()
+    if (lm_to_subtract && lm_to_add) {
+        fst::ComposeDeterministicOnDemandFst<fst::StdArc> lm_rescore(lm_to_subtract, lm_to_add);
+        CompactLattice rescored;
+        ComposeCompactLatticeDeterministic(clat, &lm_rescore, &rescored);
+        if (rescored.Start() != fst::kNoStateId) {
+            clat = rescored;
+        }
+    }
+    fst::ScaleLattice(fst::GraphLatticeScale(0.9), &clat);
+
+    CompactLattice aligned_lat;
+    if (model_->word_boundary_info_) {
+        WordAlignLattice(clat, *model_->trans_model_, *model_->word_boundary_info_, 0, &aligned_lat);
+    } else {
+        aligned_lat = clat;
+    }
+    MinimumBayesRisk mbr(aligned_lat);
+    const std::vector<int32> &words = mbr.GetOneBest();
+    std::ostringstream os;
+    for (size_t i = 0; i < words.size(); i++) {
+        if (i) {
+            os << " ";
+        }
+        os << model_->word_syms_->Find(words[i]);
+    }
+    *text = os.str();
+    return true;
+}
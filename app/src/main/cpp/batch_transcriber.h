@@ -0,0 +1,92 @@
+#ifndef KALDIANDROID_BATCH_TRANSCRIBER_H
+#define KALDIANDROID_BATCH_TRANSCRIBER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "kaldi.h"
+#include "model.h"
+
+using namespace kaldi;
+
+struct BatchTranscriberOptions {
+    int32 num_threads = 4;
+    int32 read_ahead = 8; // files read and queued before a worker takes them
+    bool rescore = true;  // rescore with rescore/ when the model has it, as Recognizer does
+    // Whole-file nnet3 evaluation in large chunks, batched across the files in flight.
+    // Acoustic scale and frame subsampling are always taken from the model,
+    // the scale is applied when decoding, not by the computer.
+    nnet3::NnetBatchComputerOptions compute_opts;
+
+    BatchTranscriberOptions() {
+        compute_opts.frames_per_chunk = 150;
+        compute_opts.minibatch_size = 8;
+        compute_opts.edge_minibatch_size = 4;
+    }
+
+    void Register(OptionsItf *po) {
+        po->Register("num-threads", &num_threads, "Worker threads, each decodes one file at a time");
+        po->Register("read-ahead", &read_ahead, "Files read in the background ahead of the workers");
+        po->Register("rescore", &rescore, "Rescore lattices with the model's rescoring LM if it has one");
+        compute_opts.Register(po);
+    }
+};
+
+struct BatchTranscriberResult {
+    string key;
+    string text;
+    bool ok = false;
+    double audio_seconds = 0;
+    double seconds = 0; // time a worker spent on the file
+};
+
+// Offline transcription of whole files. One reader thread loads audio in the
+// background, worker threads extract features, evaluate the acoustic model
+// through a NnetBatchComputer shared by all of them and decode with a
+// LatticeFasterDecoder each. Workers run whatever minibatch is ready while they
+// wait for their own chunks, so on CPU the nnet evaluation is spread over the
+// pool as well and chunks of different files share a matrix multiply.
+class BatchTranscriber {
+public:
+    BatchTranscriber(Model *model, const BatchTranscriberOptions &opts);
+    ~BatchTranscriber();
+
+    // inputs are (key, wav file) pairs, results come back in the same order
+    void Run(const std::vector<std::pair<string, string> > &inputs,
+             std::vector<BatchTranscriberResult> *results);
+
+private:
+    struct AudioItem {
+        size_t index;
+        WaveData wave;
+        bool ok;
+    };
+
+    void ReadAudio(const std::vector<std::pair<string, string> > &inputs);
+    void Work(std::vector<BatchTranscriberResult> *results);
+    bool Transcribe(const WaveData &wave, LatticeFasterDecoder *decoder,
+                    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add, string *text);
+    void ComputeFeatures(const WaveData &wave, Matrix<BaseFloat> *features,
+                         Matrix<BaseFloat> *ivectors);
+    void ComputeLoglikes(const Matrix<BaseFloat> &features, const Matrix<BaseFloat> &ivectors,
+                         Matrix<BaseFloat> *loglikes);
+
+    Model *model_;
+    BatchTranscriberOptions opts_;
+    LatticeFasterDecoderConfig decoder_config_;
+    nnet3::NnetBatchComputer *computer_ = nullptr;
+    bool rescore_ = false;
+
+    // reader -> workers
+    std::deque<AudioItem *> queue_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_not_empty_;
+    std::condition_variable queue_not_full_;
+    bool reading_done_ = false;
+};
+
+#endif // KALDIANDROID_BATCH_TRANSCRIBER_H
@@ -0,0 +1,132 @@
+#include "half_float.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+// Built without ISA flags, like int8_gemm.cpp: NEON on arm64 and scalar code
+// elsewhere. On x86_64 the F16C loops are in half_float_f16c.cpp, called
+// only once the CPU was checked for them.
+
+#if defined(__x86_64__)
+int32 FloatToFp16F16c(const float *in, int32 n, uint16 *out);
+int32 HalfToFloatF16c(const uint16 *in, int32 n, bool bf16, float *out);
+
+static bool HasF16c() {
+    unsigned int eax, ebx, ecx, edx;
+    return __builtin_cpu_supports("avx2") && __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+           (ecx & (1u << 29)) != 0; // F16C
+}
+
+static bool UseF16c() {
+    static const bool f16c = HasF16c();
+    return f16c;
+}
+#endif
+
+const char *HalfKernelName() {
+#if defined(__aarch64__)
+    return "neon";
+#elif defined(__x86_64__)
+    return UseF16c() ? "f16c" : "portable";
+#else
+    return "portable";
+#endif
+}
+
+static const float kFp16Max = 65504.0f;
+
+static inline uint16 FloatToFp16(float f) {
+    uint32 x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32 sign = (x >> 16) & 0x8000, abs = x & 0x7fffffff;
+    if (abs >= 0x477fe000) { // 65504 and up, and nan
+        return sign | 0x7bff;
+    }
+    if (abs < 0x38800000) { // fp16 subnormal, in units of 2^-24
+        float scaled = std::fabs(f) * 16777216.0f;
+        return sign | static_cast<uint16>(std::nearbyint(scaled));
+    }
+    // rebias the exponent from 127 to 15, round the 13 dropped bits to even
+    return sign | static_cast<uint16>((abs + 0x0fff + ((abs >> 13) & 1) - 0x38000000) >> 13);
+}
+
+static inline float Fp16ToFloat(uint16 h) {
+    uint32 sign = static_cast<uint32>(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+    uint32 x;
+    if (exp == 0) {
+        float f = mant * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    } else if (exp == 31) {
+        x = sign | 0x7f800000 | (mant << 13);
+    } else {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static inline uint16 FloatToBf16(float f) {
+    uint32 x;
+    std::memcpy(&x, &f, sizeof(x));
+    return static_cast<uint16>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+}
+
+static inline float Bf16ToFloat(uint16 h) {
+    uint32 x = static_cast<uint32>(h) << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void FloatToHalf(const float *in, int32 n, bool bf16, uint16 *out) {
+    int32 i = 0;
+    if (bf16) {
+        for (; i < n; i++) {
+            out[i] = FloatToBf16(in[i]);
+        }
+        return;
+    }
+#if defined(__aarch64__)
+    float32x4_t max = vdupq_n_f32(kFp16Max), min = vdupq_n_f32(-kFp16Max);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vminq_f32(vmaxq_f32(vld1q_f32(in + i), min), max);
+        vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(v)));
+    }
+#elif defined(__x86_64__)
+    if (UseF16c()) {
+        i = FloatToFp16F16c(in, n, out);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = FloatToFp16(in[i]);
+    }
+}
+
+void HalfToFloat(const uint16 *in, int32 n, bool bf16, float *out) {
+    int32 i = 0;
+#if defined(__aarch64__)
+    if (bf16) {
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(out + i, vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(in + i), 16)));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in + i))));
+        }
+    }
+#elif defined(__x86_64__)
+    if (UseF16c()) {
+        i = HalfToFloatF16c(in, n, bf16, out);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = bf16 ? Bf16ToFloat(in[i]) : Fp16ToFloat(in[i]);
+    }
+}
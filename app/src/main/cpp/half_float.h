@@ -0,0 +1,20 @@
+#ifndef KALDIANDROID_HALF_FLOAT_H
+#define KALDIANDROID_HALF_FLOAT_H
+
+// Only the int types, like int8_gemm.h: half_float_f16c.cpp is built with ISA flags
+#include "base/kaldi-types.h"
+
+using namespace kaldi;
+
+// 16 bit floats. fp16 is IEEE half, 10 mantissa bits and at most 65504. bf16
+// is the upper half of a float, 7 mantissa bits and the full float range.
+// Both round to nearest even, fp16 saturates instead of going to inf.
+void FloatToHalf(const float *in, int32 n, bool bf16, uint16 *out);
+void HalfToFloat(const uint16 *in, int32 n, bool bf16, float *out);
+
+// How fp16 is converted on this CPU, picked on first use: "neon" on arm64,
+// "f16c" on x86_64 with F16C and AVX2, "portable" scalar code otherwise. bf16
+// is a shift everywhere. Every CPU can run one of them.
+const char *HalfKernelName();
+
+#endif // KALDIANDROID_HALF_FLOAT_H
@@ -0,0 +1,32 @@
+// fp16 and bf16 conversion with F16C and AVX2, built with -mavx2 -mf16c
+// (CMakeLists.txt). Only half_float.cpp calls it, once the CPU has both. The
+// functions convert whole blocks of 8 and return how many values they did,
+// the rest is left to the scalar code.
+#include "half_float.h"
+
+#include <immintrin.h>
+
+int32 FloatToFp16F16c(const float *in, int32 n, uint16 *out) {
+    __m256 max = _mm256_set1_ps(65504.0f), min = _mm256_set1_ps(-65504.0f);
+    int32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), min), max);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+int32 HalfToFloatF16c(const uint16 *in, int32 n, bool bf16, float *out) {
+    int32 i = 0;
+    if (bf16) {
+        for (; i + 8 <= n; i += 8) {
+            __m256i h = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+            _mm256_storeu_ps(out + i, _mm256_castsi256_ps(_mm256_slli_epi32(h, 16)));
+        }
+    } else {
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+        }
+    }
+    return i;
+}
@@ -0,0 +1,97 @@
+#include "half_rnnlm.h"
+
+HalfRnnlmDeterministicFst::HalfRnnlmDeterministicFst(int32 max_ngram_order,
+                                                     const rnnlm::RnnlmComputeStateComputationOptions &opts,
+                                                     const nnet3::Nnet &rnnlm, const HalfMatrix &word_embedding)
+        : opts_(opts), rnnlm_(rnnlm), word_embedding_(word_embedding), max_ngram_order_(max_ngram_order) {
+    // as RnnlmComputeStateInfo
+    int32 left_context, right_context;
+    nnet3::ComputeSimpleNnetContext(rnnlm, &left_context, &right_context);
+    if (left_context != 0 || right_context != 0) {
+        KALDI_ERR << "RNNLM has left or right context, this is not supported";
+    }
+    if (word_embedding.cols != rnnlm.OutputDim("output")) {
+        KALDI_ERR << "RNNLM output dim " << rnnlm.OutputDim("output") << " does not match the word embedding dim " <<
+                     word_embedding.cols;
+    }
+    nnet3::ComputationRequest request1, request2, request3;
+    // one word per chunk, no context, one sequence
+    nnet3::CreateLoopedComputationRequest(rnnlm, 1, 1, 1, 0, 0, 1, &request1, &request2, &request3);
+    nnet3::CompileLooped(rnnlm, opts.optimize_config, request1, request2, request3, &computation_);
+    computation_.ComputeCudaIndexes();
+
+    std::vector<Label> bos(1, opts.bos_index);
+    State *start = new State(opts_, computation_, rnnlm_);
+    AddWord(start, opts.bos_index);
+    states_.push_back(start);
+    state_to_wseq_.push_back(bos);
+    wseq_to_state_[bos] = 0;
+}
+
+HalfRnnlmDeterministicFst::~HalfRnnlmDeterministicFst() {
+    for (size_t i = 0; i < states_.size(); i++) {
+        delete states_[i];
+    }
+}
+
+void HalfRnnlmDeterministicFst::Clear() {
+    for (size_t i = 1; i < states_.size(); i++) {
+        delete states_[i];
+    }
+    states_.resize(1);
+    state_to_wseq_.resize(1);
+    wseq_to_state_.clear();
+    wseq_to_state_[state_to_wseq_[0]] = 0;
+}
+
+void HalfRnnlmDeterministicFst::AddWord(State *state, int32 word) const {
+    KALDI_ASSERT(word > 0 && word < word_embedding_.rows);
+    CuMatrix<BaseFloat> input(1, word_embedding_.cols, kUndefined);
+    word_embedding_.Row(word, input.Data());
+    state->computer.AcceptInput("input", &input);
+    state->computer.Run();
+    // GetOutput(), not GetOutputDestructive(): the recurrence reads the output
+    state->predicted = &state->computer.GetOutput("output");
+    if (opts_.normalize_probs) {
+        CuMatrix<BaseFloat> scores(1, word_embedding_.rows);
+        word_embedding_.MultiplyAdd(*state->predicted, &scores);
+        scores.ApplyExp();
+        state->normalizer = Log(scores.Sum());
+    }
+}
+
+BaseFloat HalfRnnlmDeterministicFst::LogProb(const State &state, int32 word) const {
+    CuVector<BaseFloat> embedding(word_embedding_.cols, kUndefined);
+    word_embedding_.Row(word, embedding.Data());
+    BaseFloat log_prob = VecVec(state.predicted->Row(0), embedding);
+    return opts_.normalize_probs ? log_prob - state.normalizer : log_prob;
+}
+
+HalfRnnlmDeterministicFst::Weight HalfRnnlmDeterministicFst::Final(StateId s) {
+    return Weight(-LogProb(*states_[s], opts_.eos_index));
+}
+
+bool HalfRnnlmDeterministicFst::GetArc(StateId s, Label ilabel, fst::StdArc *oarc) {
+    std::vector<Label> wseq = state_to_wseq_[s];
+    BaseFloat log_prob = LogProb(*states_[s], ilabel);
+    wseq.push_back(ilabel);
+    if (max_ngram_order_ > 0) {
+        // the history keeps at most max_ngram_order - 1 words
+        while (wseq.size() >= static_cast<size_t>(max_ngram_order_)) {
+            wseq.erase(wseq.begin());
+        }
+    }
+    std::pair<std::unordered_map<std::vector<Label>, StateId, VectorHasher<Label> >::iterator, bool> result =
+            wseq_to_state_.insert(std::make_pair(wseq, static_cast<StateId>(state_to_wseq_.size())));
+    if (result.second) {
+        State *next = new State(*states_[s]);
+        AddWord(next, ilabel);
+        states_.push_back(next);
+        state_to_wseq_.push_back(wseq);
+    }
+    oarc->ilabel = ilabel;
+    oarc->olabel = ilabel;
+    oarc->nextstate = result.first->second;
+    oarc->weight = Weight(-log_prob);
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef KALDIANDROID_HALF_RNNLM_H
+#define KALDIANDROID_HALF_RNNLM_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "kaldi.h"
+#include "quantized_nnet.h"
+
+using namespace kaldi;
+
+// KaldiRnnlmDeterministicFst for word embeddings kept in fp16 or bf16, which
+// RnnlmComputeState cannot take. Same n-gram state merging and the same
+// scores up to the rounding of the embeddings: the row of a word is widened
+// when the word is fed to the nnet or scored, and all rows go through the
+// blocked product of HalfMatrix when --normalize-probs is set.
+class HalfRnnlmDeterministicFst : public fst::DeterministicOnDemandFst<fst::StdArc> {
+public:
+    typedef fst::StdArc::Weight Weight;
+    typedef fst::StdArc::StateId StateId;
+    typedef fst::StdArc::Label Label;
+
+    // Nothing is owned, all three must outlive the fst
+    HalfRnnlmDeterministicFst(int32 max_ngram_order, const rnnlm::RnnlmComputeStateComputationOptions &opts,
+                              const nnet3::Nnet &rnnlm, const HalfMatrix &word_embedding);
+    ~HalfRnnlmDeterministicFst() override;
+
+    // Drops all states but the start state, for the next utterance
+    void Clear();
+
+    StateId Start() override { return 0; }
+    Weight Final(StateId s) override;
+    bool GetArc(StateId s, Label ilabel, fst::StdArc *oarc) override;
+
+private:
+    struct State {
+        nnet3::NnetComputer computer;
+        const CuMatrixBase<BaseFloat> *predicted = nullptr; // output embedding, owned by computer
+        BaseFloat normalizer = 0; // log of the summed exp scores, with --normalize-probs
+
+        State(const rnnlm::RnnlmComputeStateComputationOptions &opts, const nnet3::NnetComputation &computation,
+              const nnet3::Nnet &rnnlm) : computer(opts.compute_config, computation, rnnlm, nullptr) {}
+        State(const State &other) : computer(other.computer), normalizer(other.normalizer) {}
+    };
+
+    void AddWord(State *state, int32 word) const;
+    BaseFloat LogProb(const State &state, int32 word) const;
+
+    const rnnlm::RnnlmComputeStateComputationOptions &opts_;
+    const nnet3::Nnet &rnnlm_;
+    const HalfMatrix &word_embedding_;
+    nnet3::NnetComputation computation_; // looped, one word per chunk
+    int32 max_ngram_order_;
+
+    std::unordered_map<std::vector<Label>, StateId, VectorHasher<Label> > wseq_to_state_;
+    std::vector<std::vector<Label> > state_to_wseq_;
+    std::vector<State *> states_;
+};
+
+#endif // KALDIANDROID_HALF_RNNLM_H
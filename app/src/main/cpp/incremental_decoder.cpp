@@ -0,0 +1,801 @@
+#include "incremental_decoder.h"
+
+// The search and the pruning follow decoder/lattice-incremental-decoder.cc,
+// only the allocation of tokens and links differs.
+
+// The decoding graph as the base of ConstFst and VectorFst, null for the
+// other graph types
+static inline const fst::Fst<fst::StdArc> *StdFst(const fst::Fst<fst::StdArc> &fst) {
+    return &fst;
+}
+
+template <typename Graph>
+static inline const fst::Fst<fst::StdArc> *StdFst(const Graph &) {
+    return nullptr;
+}
+
+template <typename FST, template <typename, typename> class Table>
+IncrementalDecoderTpl<FST, Table>::IncrementalDecoderTpl(const FST &fst, const TransitionModel &trans_model,
+                                                         const LatticeIncrementalDecoderConfig &config,
+                                                         TokenArena *arena)
+        : Base(fst, trans_model, config), arena_(arena) {
+    KALDI_ASSERT(arena_->tokens.NumLive() == 0 && arena_->links.NumLive() == 0);
+}
+
+template <typename FST, template <typename, typename> class Table>
+IncrementalDecoderTpl<FST, Table>::~IncrementalDecoderTpl() {
+    // leaves nothing for the destructor of the base to delete
+    ClearActiveTokens();
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::InitDecoding() {
+    table_.Clear(&prev_toks_);
+    this->cost_offsets_.clear();
+    ClearActiveTokens();
+    this->warned_ = false;
+    this->num_toks_ = 0;
+    this->decoding_finalized_ = false;
+    this->final_costs_.clear();
+    StateId start_state = this->fst_->Start();
+    KALDI_ASSERT(start_state != fst::kNoStateId);
+    this->active_toks_.resize(1);
+    Token *start_tok = arena_->tokens.New(0.0, 0.0, nullptr, nullptr, nullptr);
+    this->active_toks_[0].toks = start_tok;
+    table_.Insert(start_state)->tok = start_tok;
+    this->num_toks_++;
+
+    this->determinizer_.Init();
+    this->num_frames_in_lattice_ = 0;
+    this->token2label_map_.clear();
+    this->next_token_label_ = LatticeIncrementalDeterminizer::kTokenLabelOffset;
+    ProcessNonemitting(*this->fst_, this->config_.beam);
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::AdvanceDecoding(DecodableInterface *decodable, int32 max_num_frames) {
+    KALDI_ASSERT(!this->active_toks_.empty() && !this->decoding_finalized_ &&
+                 "You must call InitDecoding() before AdvanceDecoding()");
+    int32 num_frames_ready = decodable->NumFramesReady();
+    KALDI_ASSERT(num_frames_ready >= this->NumFramesDecoded());
+    int32 target_frames_decoded = num_frames_ready;
+    if (max_num_frames >= 0) {
+        target_frames_decoded = std::min(target_frames_decoded, this->NumFramesDecoded() + max_num_frames);
+    }
+    // As Kaldi does, the arc iterators of the concrete types are not virtual
+    const fst::Fst<fst::StdArc> *fst = StdFst(*this->fst_);
+    if (fst != nullptr && fst->Type() == "const") {
+        DecodeFrames(static_cast<const fst::ConstFst<fst::StdArc> &>(*fst), decodable, target_frames_decoded);
+        return;
+    } else if (fst != nullptr && fst->Type() == "vector") {
+        DecodeFrames(static_cast<const fst::VectorFst<fst::StdArc> &>(*fst), decodable, target_frames_decoded);
+        return;
+    }
+    DecodeFrames(*this->fst_, decodable, target_frames_decoded);
+}
+
+template <typename FST, template <typename, typename> class Table>
+template <typename Graph>
+void IncrementalDecoderTpl<FST, Table>::DecodeFrames(const Graph &graph, DecodableInterface *decodable,
+                                                     int32 target_frames_decoded) {
+    while (this->NumFramesDecoded() < target_frames_decoded) {
+        if (this->NumFramesDecoded() % this->config_.prune_interval == 0) {
+            PruneActiveTokens(this->config_.lattice_beam * this->config_.prune_scale);
+        }
+        BaseFloat cost_cutoff = ProcessEmitting(graph, decodable);
+        ProcessNonemitting(graph, cost_cutoff);
+    }
+    UpdateLatticeDeterminization();
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::FinalizeDecoding() {
+    int32 final_frame_plus_one = this->NumFramesDecoded();
+    int32 num_toks_begin = this->num_toks_;
+    // sets decoding_finalized_
+    PruneForwardLinksFinal();
+    for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+        bool extra_costs_changed, links_pruned;
+        PruneForwardLinks(f, &extra_costs_changed, &links_pruned, 0.0); // a delta of zero always updates
+        PruneTokensForFrame(f + 1);
+    }
+    PruneTokensForFrame(0);
+    KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin << " to " << this->num_toks_;
+}
+
+template <typename FST, template <typename, typename> class Table>
+typename IncrementalDecoderTpl<FST, Table>::Token *IncrementalDecoderTpl<FST, Table>::FindOrAddToken(
+        StateId state, int32 frame_plus_one, BaseFloat tot_cost, Token *backpointer, bool *changed) {
+    KALDI_ASSERT(frame_plus_one >= 0 && static_cast<size_t>(frame_plus_one) < this->active_toks_.size());
+    Token *&toks = this->active_toks_[frame_plus_one].toks;
+    Entry *entry = table_.Insert(state);
+    if (entry->tok == nullptr) {
+        // tokens on the frame being decoded have no extra cost, any of them
+        // could end up on the best path
+        Token *new_tok = arena_->tokens.New(tot_cost, 0.0, nullptr, toks, backpointer);
+        toks = new_tok;
+        this->num_toks_++;
+        entry->tok = new_tok;
+        if (changed) {
+            *changed = true;
+        }
+        return new_tok;
+    }
+    Token *tok = entry->tok;
+    if (tok->tot_cost > tot_cost) {
+        // the links into the old token stay, pruning removes them later
+        tok->tot_cost = tot_cost;
+        tok->SetBackpointer(backpointer);
+        if (changed) {
+            *changed = true;
+        }
+    } else if (changed) {
+        *changed = false;
+    }
+    return tok;
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::PruneForwardLinks(int32 frame_plus_one, bool *extra_costs_changed,
+                                                          bool *links_pruned, BaseFloat delta) {
+    *extra_costs_changed = false;
+    *links_pruned = false;
+    KALDI_ASSERT(frame_plus_one >= 0 && static_cast<size_t>(frame_plus_one) < this->active_toks_.size());
+    if (this->active_toks_[frame_plus_one].toks == nullptr && !this->warned_) {
+        KALDI_WARN << "No tokens alive [doing pruning].. warning first time only for each utterance";
+        this->warned_ = true;
+    }
+    // links are not in topological order, iterate until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Token *tok = this->active_toks_[frame_plus_one].toks; tok != nullptr; tok = tok->next) {
+            ForwardLinkT *link, *prev_link = nullptr;
+            BaseFloat tok_extra_cost = std::numeric_limits<BaseFloat>::infinity();
+            for (link = tok->links; link != nullptr; ) {
+                Token *next_tok = link->next_tok;
+                BaseFloat link_extra_cost = next_tok->extra_cost +
+                        ((tok->tot_cost + link->acoustic_cost + link->graph_cost) - next_tok->tot_cost);
+                KALDI_ASSERT(link_extra_cost == link_extra_cost); // NaN
+                if (link_extra_cost > this->config_.lattice_beam) {
+                    ForwardLinkT *next_link = link->next;
+                    if (prev_link != nullptr) {
+                        prev_link->next = next_link;
+                    } else {
+                        tok->links = next_link;
+                    }
+                    arena_->links.Delete(link);
+                    link = next_link;
+                    *links_pruned = true;
+                } else {
+                    if (link_extra_cost < 0.0) {
+                        if (link_extra_cost < -0.01) {
+                            KALDI_WARN << "Negative extra_cost: " << link_extra_cost;
+                        }
+                        link_extra_cost = 0.0;
+                    }
+                    tok_extra_cost = std::min(tok_extra_cost, link_extra_cost);
+                    prev_link = link;
+                    link = link->next;
+                }
+            }
+            if (std::fabs(tok_extra_cost - tok->extra_cost) > delta) {
+                changed = true;
+            }
+            // infinity when no link survived
+            tok->extra_cost = tok_extra_cost;
+        }
+        if (changed) {
+            *extra_costs_changed = true;
+        }
+    }
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::PruneForwardLinksFinal() {
+    KALDI_ASSERT(!this->active_toks_.empty());
+    int32 frame_plus_one = this->active_toks_.size() - 1;
+    if (this->active_toks_[frame_plus_one].toks == nullptr) {
+        KALDI_WARN << "No tokens alive at end of file";
+    }
+    this->ComputeFinalCosts(&this->final_costs_, &this->final_relative_cost_, &this->final_best_cost_);
+    this->decoding_finalized_ = true;
+    // the table would point to tokens pruned below
+    table_.Clear(&prev_toks_);
+
+    // as PruneForwardLinks(), with the final costs in the extra costs
+    bool changed = true;
+    BaseFloat delta = 1.0e-05;
+    while (changed) {
+        changed = false;
+        for (Token *tok = this->active_toks_[frame_plus_one].toks; tok != nullptr; tok = tok->next) {
+            ForwardLinkT *link, *prev_link = nullptr;
+            BaseFloat final_cost;
+            if (this->final_costs_.empty()) {
+                final_cost = 0.0;
+            } else {
+                typename unordered_map<Token *, BaseFloat>::const_iterator iter = this->final_costs_.find(tok);
+                final_cost = iter != this->final_costs_.end() ? iter->second
+                                                               : std::numeric_limits<BaseFloat>::infinity();
+            }
+            BaseFloat tok_extra_cost = tok->tot_cost + final_cost - this->final_best_cost_;
+            for (link = tok->links; link != nullptr; ) {
+                Token *next_tok = link->next_tok;
+                BaseFloat link_extra_cost = next_tok->extra_cost +
+                        ((tok->tot_cost + link->acoustic_cost + link->graph_cost) - next_tok->tot_cost);
+                if (link_extra_cost > this->config_.lattice_beam) {
+                    ForwardLinkT *next_link = link->next;
+                    if (prev_link != nullptr) {
+                        prev_link->next = next_link;
+                    } else {
+                        tok->links = next_link;
+                    }
+                    arena_->links.Delete(link);
+                    link = next_link;
+                } else {
+                    if (link_extra_cost < 0.0) {
+                        if (link_extra_cost < -0.01) {
+                            KALDI_WARN << "Negative extra_cost: " << link_extra_cost;
+                        }
+                        link_extra_cost = 0.0;
+                    }
+                    tok_extra_cost = std::min(tok_extra_cost, link_extra_cost);
+                    prev_link = link;
+                    link = link->next;
+                }
+            }
+            // tokens too far from the best final one go in PruneTokensForFrame()
+            if (tok_extra_cost > this->config_.lattice_beam) {
+                tok_extra_cost = std::numeric_limits<BaseFloat>::infinity();
+            }
+            if (!ApproxEqual(tok->extra_cost, tok_extra_cost, delta)) {
+                changed = true;
+            }
+            tok->extra_cost = tok_extra_cost;
+        }
+    }
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::PruneTokensForFrame(int32 frame_plus_one) {
+    KALDI_ASSERT(frame_plus_one >= 0 && static_cast<size_t>(frame_plus_one) < this->active_toks_.size());
+    Token *&toks = this->active_toks_[frame_plus_one].toks;
+    if (toks == nullptr) {
+        KALDI_WARN << "No tokens alive [doing pruning]";
+    }
+    Token *tok, *next_tok, *prev_tok = nullptr;
+    int32 num_toks = 0;
+    for (tok = toks; tok != nullptr; tok = next_tok) {
+        next_tok = tok->next;
+        if (tok->extra_cost == std::numeric_limits<BaseFloat>::infinity()) {
+            // no forward link survived, nothing reaches the end through it
+            if (prev_tok != nullptr) {
+                prev_tok->next = tok->next;
+            } else {
+                toks = tok->next;
+            }
+            arena_->tokens.Delete(tok);
+            this->num_toks_--;
+        } else {
+            prev_tok = tok;
+            num_toks++;
+        }
+    }
+    this->active_toks_[frame_plus_one].num_toks = num_toks;
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::PruneActiveTokens(BaseFloat delta) {
+    int32 cur_frame_plus_one = this->NumFramesDecoded();
+    int32 num_toks_begin = this->num_toks_;
+    if (this->active_toks_[cur_frame_plus_one].num_toks == -1) {
+        // the frame being decoded is never pruned, but the determinization
+        // needs its count
+        int32 num_toks = 0;
+        for (Token *tok = this->active_toks_[cur_frame_plus_one].toks; tok != nullptr; tok = tok->next) {
+            num_toks++;
+        }
+        this->active_toks_[cur_frame_plus_one].num_toks = num_toks;
+    }
+    for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+        if (this->active_toks_[f].must_prune_forward_links) {
+            bool extra_costs_changed = false, links_pruned = false;
+            PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
+            if (extra_costs_changed && f > 0) {
+                this->active_toks_[f - 1].must_prune_forward_links = true;
+            }
+            if (links_pruned) {
+                this->active_toks_[f].must_prune_tokens = true;
+            }
+            this->active_toks_[f].must_prune_forward_links = false;
+        }
+        if (f + 1 < cur_frame_plus_one && this->active_toks_[f + 1].must_prune_tokens) {
+            PruneTokensForFrame(f + 1);
+            this->active_toks_[f + 1].must_prune_tokens = false;
+        }
+    }
+    KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin << " to " << this->num_toks_;
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::UpdateLatticeDeterminization() {
+    if (this->NumFramesDecoded() - this->num_frames_in_lattice_ < this->config_.determinize_max_delay) {
+        return;
+    }
+    // does little if the tokens were just pruned
+    PruneActiveTokens(this->config_.lattice_beam * this->config_.prune_scale);
+
+    // determinize up to the frame with the fewest tokens
+    int32 first = this->num_frames_in_lattice_ + this->config_.determinize_min_chunk_size,
+          last = this->NumFramesDecoded(),
+          fewest_tokens = std::numeric_limits<int32>::max(),
+          best_frame = -1;
+    for (int32 t = last; t >= first; t--) {
+        KALDI_ASSERT(this->active_toks_[t].num_toks != -1);
+        if (this->active_toks_[t].num_toks < fewest_tokens) {
+            fewest_tokens = this->active_toks_[t].num_toks;
+            best_frame = t;
+        }
+    }
+    GetLattice(best_frame, false);
+}
+
+template <typename FST, template <typename, typename> class Table>
+const CompactLattice &IncrementalDecoderTpl<FST, Table>::GetLattice(int32 num_frames_to_include, bool use_final_probs) {
+    LatticeIncrementalDeterminizer &determinizer = this->determinizer_;
+    KALDI_ASSERT(num_frames_to_include >= this->num_frames_in_lattice_ &&
+                 num_frames_to_include <= this->NumFramesDecoded());
+    if (this->num_frames_in_lattice_ > 0 && determinizer.GetDeterminizedLattice().NumStates() == 0) {
+        // something went wrong before and the lattice stays empty
+        return determinizer.GetDeterminizedLattice();
+    }
+    if (this->decoding_finalized_ && !use_final_probs) {
+        KALDI_ERR << "You cannot get the lattice without final-probs after calling FinalizeDecoding().";
+    }
+    if (use_final_probs && num_frames_to_include != this->NumFramesDecoded()) {
+        KALDI_ERR << "use-final-probs may no be true if you are not getting a lattice for all frames "
+                     "decoded so far.";
+    }
+
+    if (num_frames_to_include > this->num_frames_in_lattice_) {
+        PruneActiveTokens(this->config_.lattice_beam * this->config_.prune_scale);
+        if (determinizer.GetDeterminizedLattice().NumStates() == 0 ||
+            determinizer.GetDeterminizedLattice().Final(0) != CompactLatticeWeight::Zero()) {
+            this->num_frames_in_lattice_ = 0;
+            determinizer.Init();
+        }
+
+        Lattice chunk_lat;
+        unordered_map<Label, LatticeArc::StateId> token_label2state;
+        if (this->num_frames_in_lattice_ != 0) {
+            determinizer.InitializeRawLatticeChunk(&chunk_lat, &token_label2state);
+        }
+        unordered_map<Token *, StateId> &tok2state_map = this->temp_token_map_;
+        tok2state_map.clear();
+        unordered_map<Token *, Label> &next_token2label_map = this->token2label_map_temp_;
+        next_token2label_map.clear();
+
+        // The last frame of the chunk gets its states and token labels first,
+        // but no arcs; the next chunk starts from them.
+        for (Token *tok = this->active_toks_[num_frames_to_include].toks; tok != nullptr; tok = tok->next) {
+            BaseFloat final_cost;
+            if (this->decoding_finalized_) {
+                if (this->final_costs_.empty()) {
+                    final_cost = 0.0; // no final state survived, all are final
+                } else {
+                    typename unordered_map<Token *, BaseFloat>::const_iterator iter = this->final_costs_.find(tok);
+                    final_cost = iter != this->final_costs_.end() ? iter->second
+                                                                   : std::numeric_limits<BaseFloat>::infinity();
+                }
+            } else {
+                // the beta that puts every token of the frame on a best path,
+                // only to guide the pruned determinization
+                final_cost = tok->extra_cost - tok->tot_cost;
+            }
+            StateId state = chunk_lat.AddState();
+            tok2state_map[tok] = state;
+            if (final_cost < std::numeric_limits<BaseFloat>::infinity()) {
+                Label token_label = this->AllocateNewTokenLabel();
+                next_token2label_map[tok] = token_label;
+                StateId token_final_state = chunk_lat.AddState();
+                chunk_lat.AddArc(state, LatticeArc(0, token_label, LatticeWeight::One(), token_final_state));
+                chunk_lat.SetFinal(token_final_state, LatticeWeight(final_cost, 0.0));
+            }
+        }
+
+        // backwards, so the destination states of the arcs already exist
+        for (int32 frame = num_frames_to_include; frame >= this->num_frames_in_lattice_; frame--) {
+            BaseFloat cost_offset = static_cast<size_t>(frame) < this->cost_offsets_.size() ?
+                                    this->cost_offsets_[frame] : 0.0;
+            if (frame == this->num_frames_in_lattice_ && this->num_frames_in_lattice_ != 0) {
+                // the first frame continues the states of the previous chunk
+                for (Token *tok = this->active_toks_[frame].toks; tok != nullptr; tok = tok->next) {
+                    typename unordered_map<Token *, Label>::const_iterator iter = this->token2label_map_.find(tok);
+                    KALDI_ASSERT(iter != this->token2label_map_.end());
+                    typename unordered_map<Label, LatticeArc::StateId>::const_iterator iter2 =
+                            token_label2state.find(iter->second);
+                    if (iter2 != token_label2state.end()) {
+                        tok2state_map[tok] = iter2->second;
+                    } else {
+                        // pruned by the previous determinization, may still
+                        // be on a chain of nonemitting arcs
+                        tok2state_map[tok] = chunk_lat.AddState();
+                    }
+                }
+            } else if (frame != num_frames_to_include) {
+                for (Token *tok = this->active_toks_[frame].toks; tok != nullptr; tok = tok->next) {
+                    tok2state_map[tok] = chunk_lat.AddState();
+                }
+            }
+            for (Token *tok = this->active_toks_[frame].toks; tok != nullptr; tok = tok->next) {
+                typename unordered_map<Token *, StateId>::const_iterator iter = tok2state_map.find(tok);
+                KALDI_ASSERT(iter != tok2state_map.end());
+                StateId cur_state = iter->second;
+                for (ForwardLinkT *l = tok->links; l != nullptr; l = l->next) {
+                    typename unordered_map<Token *, StateId>::const_iterator next_iter = tok2state_map.find(l->next_tok);
+                    if (next_iter == tok2state_map.end()) {
+                        // emitting arcs out of the last frame of the chunk
+                        KALDI_ASSERT(frame == num_frames_to_include);
+                        continue;
+                    }
+                    BaseFloat this_offset = l->ilabel != 0 ? cost_offset : 0;
+                    chunk_lat.AddArc(cur_state, LatticeArc(l->ilabel, l->olabel,
+                                                           LatticeWeight(l->graph_cost, l->acoustic_cost - this_offset),
+                                                           next_iter->second));
+                }
+            }
+        }
+        if (this->num_frames_in_lattice_ == 0) {
+            // tokens are added at the head of the list, the start token is last
+            Token *tok = this->active_toks_[0].toks;
+            if (tok == nullptr) {
+                KALDI_WARN << "No tokens exist on start frame";
+                return determinizer.GetDeterminizedLattice();
+            }
+            while (tok->next != nullptr) {
+                tok = tok->next;
+            }
+            typename unordered_map<Token *, StateId>::const_iterator iter = tok2state_map.find(tok);
+            KALDI_ASSERT(iter != tok2state_map.end());
+            chunk_lat.SetStart(iter->second);
+        }
+        this->token2label_map_.swap(next_token2label_map);
+        determinizer.AcceptRawLatticeChunk(&chunk_lat);
+        this->num_frames_in_lattice_ = num_frames_to_include;
+        if (determinizer.GetDeterminizedLattice().NumStates() == 0) {
+            return determinizer.GetDeterminizedLattice();
+        }
+    }
+
+    unordered_map<Label, BaseFloat> token_label2final_cost;
+    if (use_final_probs) {
+        unordered_map<Token *, BaseFloat> token2final_cost;
+        this->ComputeFinalCosts(&token2final_cost, nullptr, nullptr);
+        for (typename unordered_map<Token *, BaseFloat>::const_iterator it = token2final_cost.begin();
+             it != token2final_cost.end(); ++it) {
+            typename unordered_map<Token *, Label>::const_iterator iter = this->token2label_map_.find(it->first);
+            // some tokens did not survive the pruned determinization
+            if (iter != this->token2label_map_.end()) {
+                token_label2final_cost[iter->second] = it->second;
+            }
+        }
+    }
+    // only for the lattice returned, the next chunk does not see them
+    determinizer.SetFinalCosts(token_label2final_cost.empty() ? nullptr : &token_label2final_cost);
+    return determinizer.GetDeterminizedLattice();
+}
+
+template <typename FST, template <typename, typename> class Table>
+BaseFloat IncrementalDecoderTpl<FST, Table>::GetCutoff(const std::vector<Entry> &toks, BaseFloat *adaptive_beam,
+                                                       const Entry **best_entry) {
+    const LatticeIncrementalDecoderConfig &config = this->config_;
+    BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
+    if (config.max_active == std::numeric_limits<int32>::max() && config.min_active == 0) {
+        for (size_t i = 0; i < toks.size(); i++) {
+            BaseFloat w = static_cast<BaseFloat>(toks[i].tok->tot_cost);
+            if (w < best_weight) {
+                best_weight = w;
+                *best_entry = &toks[i];
+            }
+        }
+        *adaptive_beam = config.beam;
+        return best_weight + config.beam;
+    }
+
+    std::vector<BaseFloat> &tmp_array = this->tmp_array_;
+    tmp_array.resize(toks.size());
+    for (size_t i = 0; i < toks.size(); i++) {
+        BaseFloat w = toks[i].tok->tot_cost;
+        tmp_array[i] = w;
+        if (w < best_weight) {
+            best_weight = w;
+            *best_entry = &toks[i];
+        }
+    }
+    BaseFloat beam_cutoff = best_weight + config.beam,
+              min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
+              max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
+    KALDI_VLOG(6) << "Number of tokens active on frame " << this->NumFramesDecoded() << " is " << tmp_array.size();
+
+    if (tmp_array.size() > static_cast<size_t>(config.max_active)) {
+        std::nth_element(tmp_array.begin(), tmp_array.begin() + config.max_active, tmp_array.end());
+        max_active_cutoff = tmp_array[config.max_active];
+    }
+    if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam
+        *adaptive_beam = max_active_cutoff - best_weight + config.beam_delta;
+        return max_active_cutoff;
+    }
+    if (tmp_array.size() > static_cast<size_t>(config.min_active)) {
+        if (config.min_active == 0) {
+            min_active_cutoff = best_weight;
+        } else {
+            std::nth_element(tmp_array.begin(), tmp_array.begin() + config.min_active,
+                             tmp_array.size() > static_cast<size_t>(config.max_active)
+                             ? tmp_array.begin() + config.max_active : tmp_array.end());
+            min_active_cutoff = tmp_array[config.min_active];
+        }
+    }
+    if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam
+        *adaptive_beam = min_active_cutoff - best_weight + config.beam_delta;
+        return min_active_cutoff;
+    }
+    *adaptive_beam = config.beam;
+    return beam_cutoff;
+}
+
+template <typename FST, template <typename, typename> class Table>
+template <typename Graph>
+BaseFloat IncrementalDecoderTpl<FST, Table>::ProcessEmitting(const Graph &graph, DecodableInterface *decodable) {
+    KALDI_ASSERT(this->active_toks_.size() > 0);
+    // index into the decodable, zero-based
+    int32 frame = this->active_toks_.size() - 1;
+    this->active_toks_.resize(this->active_toks_.size() + 1);
+
+    // the table is empty after this, the last frame is expanded from prev_toks_
+    table_.Clear(&prev_toks_);
+    const Entry *best_entry = nullptr;
+    BaseFloat adaptive_beam;
+    BaseFloat cur_cutoff = GetCutoff(prev_toks_, &adaptive_beam, &best_entry);
+    KALDI_VLOG(6) << "Adaptive beam on frame " << this->NumFramesDecoded() << " is " << adaptive_beam;
+    // as many tokens as the last frame without growing, the load stays
+    // under a half whatever --hash-ratio says
+    table_.Reserve(prev_toks_.size());
+
+    BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
+    // keeps the scores in a good dynamic range
+    BaseFloat cost_offset = 0.0;
+
+    // the best token first, for a tight next_cutoff from the start
+    if (best_entry) {
+        StateId state = best_entry->state;
+        Token *tok = best_entry->tok;
+        cost_offset = -tok->tot_cost;
+        for (fst::ArcIterator<Graph> aiter(graph, state); !aiter.Done(); aiter.Next()) {
+            const typename Graph::Arc &arc = aiter.Value();
+            if (arc.ilabel != 0) {
+                BaseFloat new_weight = arc.weight.Value() + cost_offset -
+                        decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+                if (new_weight + adaptive_beam < next_cutoff) {
+                    next_cutoff = new_weight + adaptive_beam;
+                }
+            }
+        }
+    }
+    this->cost_offsets_.resize(frame + 1, 0.0);
+    this->cost_offsets_[frame] = cost_offset;
+
+    for (size_t i = 0; i < prev_toks_.size(); i++) {
+        StateId state = prev_toks_[i].state;
+        Token *tok = prev_toks_[i].tok;
+        if (tok->tot_cost <= cur_cutoff) {
+            for (fst::ArcIterator<Graph> aiter(graph, state); !aiter.Done(); aiter.Next()) {
+                const typename Graph::Arc &arc = aiter.Value();
+                if (arc.ilabel != 0) {
+                    BaseFloat ac_cost = cost_offset - decodable->LogLikelihood(frame, arc.ilabel),
+                              graph_cost = arc.weight.Value(),
+                              cur_cost = tok->tot_cost,
+                              tot_cost = cur_cost + ac_cost + graph_cost;
+                    if (tot_cost >= next_cutoff) {
+                        continue;
+                    } else if (tot_cost + adaptive_beam < next_cutoff) {
+                        next_cutoff = tot_cost + adaptive_beam;
+                    }
+                    // frames of active_toks_ are one-based
+                    Token *next_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost, tok, nullptr);
+                    tok->links = arena_->links.New(next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost, tok->links);
+                }
+            }
+        }
+    }
+    return next_cutoff;
+}
+
+template <typename FST, template <typename, typename> class Table>
+template <typename Graph>
+void IncrementalDecoderTpl<FST, Table>::ProcessNonemitting(const Graph &graph, BaseFloat cutoff) {
+    KALDI_ASSERT(!this->active_toks_.empty());
+    // the frame just decoded, -1 when called from InitDecoding()
+    int32 frame = static_cast<int32>(this->active_toks_.size()) - 2;
+    std::vector<StateId> &queue = this->queue_;
+    KALDI_ASSERT(queue.empty());
+
+    const std::vector<Entry> &toks = table_.Entries();
+    if (toks.empty() && !this->warned_) {
+        KALDI_WARN << "Error, no surviving tokens: frame is " << frame;
+        this->warned_ = true;
+    }
+    for (size_t i = 0; i < toks.size(); i++) {
+        if (graph.NumInputEpsilons(toks[i].state) != 0) {
+            queue.push_back(toks[i].state);
+        }
+    }
+    while (!queue.empty()) {
+        StateId state = queue.back();
+        queue.pop_back();
+        Token *tok = table_.Find(state)->tok;
+        BaseFloat cur_cost = tok->tot_cost;
+        if (cur_cost >= cutoff) {
+            continue;
+        }
+        // a state visited again regenerates its links
+        DeleteForwardLinks(tok);
+        for (fst::ArcIterator<Graph> aiter(graph, state); !aiter.Done(); aiter.Next()) {
+            const typename Graph::Arc &arc = aiter.Value();
+            if (arc.ilabel == 0) {
+                BaseFloat graph_cost = arc.weight.Value(), tot_cost = cur_cost + graph_cost;
+                if (tot_cost < cutoff) {
+                    bool changed;
+                    Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost, tok, &changed);
+                    tok->links = arena_->links.New(new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
+                    if (changed && graph.NumInputEpsilons(arc.nextstate) != 0) {
+                        queue.push_back(arc.nextstate);
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::DeleteForwardLinks(Token *tok) {
+    for (ForwardLinkT *l = tok->links, *m; l != nullptr; l = m) {
+        m = l->next;
+        arena_->links.Delete(l);
+    }
+    tok->links = nullptr;
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::ComputeFinalCosts(unordered_map<Token *, BaseFloat> *final_costs,
+                                                          BaseFloat *final_relative_cost,
+                                                          BaseFloat *final_best_cost) const {
+    if (this->decoding_finalized_) {
+        // the table is gone, these were kept by PruneForwardLinksFinal()
+        if (final_costs) {
+            *final_costs = this->final_costs_;
+        }
+        if (final_relative_cost) {
+            *final_relative_cost = this->final_relative_cost_;
+        }
+        if (final_best_cost) {
+            *final_best_cost = this->final_best_cost_;
+        }
+        return;
+    }
+    if (final_costs != nullptr) {
+        final_costs->clear();
+    }
+    const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+    BaseFloat best_cost = infinity, best_cost_with_final = infinity;
+    const std::vector<Entry> &toks = table_.Entries();
+    for (size_t i = 0; i < toks.size(); i++) {
+        BaseFloat final_cost = this->fst_->Final(toks[i].state).Value();
+        BaseFloat cost = toks[i].tok->tot_cost, cost_with_final = cost + final_cost;
+        best_cost = std::min(cost, best_cost);
+        best_cost_with_final = std::min(cost_with_final, best_cost_with_final);
+        if (final_costs != nullptr && final_cost != infinity) {
+            (*final_costs)[toks[i].tok] = final_cost;
+        }
+    }
+    if (final_relative_cost != nullptr) {
+        // infinite too when no token survived
+        *final_relative_cost = best_cost == infinity && best_cost_with_final == infinity
+                               ? infinity : best_cost_with_final - best_cost;
+    }
+    if (final_best_cost != nullptr) {
+        *final_best_cost = best_cost_with_final != infinity ? best_cost_with_final : best_cost;
+    }
+}
+
+template <typename FST, template <typename, typename> class Table>
+BaseFloat IncrementalDecoderTpl<FST, Table>::FinalRelativeCost() const {
+    BaseFloat relative_cost;
+    ComputeFinalCosts(nullptr, &relative_cost, nullptr);
+    return relative_cost;
+}
+
+template <typename FST, template <typename, typename> class Table>
+typename IncrementalDecoderTpl<FST, Table>::Base::BestPathIterator IncrementalDecoderTpl<FST, Table>::BestPathEnd(
+        bool use_final_probs, BaseFloat *final_cost_out) const {
+    if (this->decoding_finalized_ && !use_final_probs) {
+        KALDI_ERR << "You cannot call FinalizeDecoding() and then call BestPathEnd() with use_final_probs == false";
+    }
+    KALDI_ASSERT(this->NumFramesDecoded() > 0 && "You cannot call BestPathEnd if no frames were decoded.");
+    unordered_map<Token *, BaseFloat> final_costs;
+    if (use_final_probs) {
+        ComputeFinalCosts(&final_costs, nullptr, nullptr);
+    }
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity(), best_final_cost = 0;
+    Token *best_tok = nullptr;
+    for (Token *tok = this->active_toks_.back().toks; tok != nullptr; tok = tok->next) {
+        BaseFloat cost = tok->tot_cost, final_cost = 0.0;
+        // with no final token on the last frame, all of them count as final
+        if (use_final_probs && !final_costs.empty()) {
+            typename unordered_map<Token *, BaseFloat>::const_iterator iter = final_costs.find(tok);
+            if (iter != final_costs.end()) {
+                final_cost = iter->second;
+                cost += final_cost;
+            } else {
+                cost = std::numeric_limits<BaseFloat>::infinity();
+            }
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_tok = tok;
+            best_final_cost = final_cost;
+        }
+    }
+    if (best_tok == nullptr) {
+        KALDI_WARN << "No final token found.";
+    }
+    if (final_cost_out) {
+        *final_cost_out = best_final_cost;
+    }
+    return typename Base::BestPathIterator(best_tok, this->NumFramesDecoded() - 1);
+}
+
+template <typename FST, template <typename, typename> class Table>
+bool IncrementalDecoderTpl<FST, Table>::GetBestPath(Lattice *ofst, bool use_final_probs) const {
+    ofst->DeleteStates();
+    BaseFloat final_graph_cost;
+    typename Base::BestPathIterator iter = BestPathEnd(use_final_probs, &final_graph_cost);
+    if (iter.Done()) {
+        return false;
+    }
+    StateId state = ofst->AddState();
+    ofst->SetFinal(state, LatticeWeight(final_graph_cost, 0.0));
+    while (!iter.Done()) {
+        LatticeArc arc;
+        iter = this->TraceBackBestPath(iter, &arc);
+        arc.nextstate = state;
+        StateId new_state = ofst->AddState();
+        ofst->AddArc(new_state, arc);
+        state = new_state;
+    }
+    ofst->SetStart(state);
+    return true;
+}
+
+template <typename FST, template <typename, typename> class Table>
+void IncrementalDecoderTpl<FST, Table>::ClearActiveTokens() {
+    if (arena_->Heap()) {
+        // one by one back to the heap, as the Kaldi decoder does
+        for (size_t i = 0; i < this->active_toks_.size(); i++) {
+            for (Token *tok = this->active_toks_[i].toks, *next; tok != nullptr; tok = next) {
+                next = tok->next;
+                DeleteForwardLinks(tok);
+                arena_->tokens.Delete(tok);
+            }
+        }
+    }
+    // otherwise no walk over the tokens and links of the utterance, the
+    // arena is only used by this decoder
+    arena_->tokens.Release();
+    arena_->links.Release();
+    this->active_toks_.clear();
+    this->num_toks_ = 0;
+}
+
+template class IncrementalDecoderTpl<fst::Fst<fst::StdArc> >;
+template class IncrementalDecoderTpl<fst::ConstGrammarFst>;
+template class IncrementalDecoderTpl<fst::Fst<fst::StdArc>, HashListTokenTable>; // decoder_search_bench
@@ -0,0 +1,93 @@
+#ifndef KALDIANDROID_INCREMENTAL_DECODER_H
+#define KALDIANDROID_INCREMENTAL_DECODER_H
+
+#include "kaldi.h"
+
+#include "token_arena.h"
+#include "token_table.h"
+
+using namespace kaldi;
+
+// LatticeIncrementalOnlineDecoderTpl with its tokens and forward links in a
+// TokenArena instead of new and delete, and the tokens of the frame being
+// decoded in a TokenTable instead of a HashList. The Kaldi decoder is
+// prebuilt and cannot be given another allocator or map, so everything
+// that creates, frees or looks up tokens is redone here on its protected
+// state: the search, the pruning, the final costs, the best path and the
+// lattice chunks. The traceback, endpointing and silence weighting only
+// follow tokens already found and are left to the base class.
+//
+// Pruned tokens and links are recycled by the next frames. The ones still
+// alive back the lattice and the best-path traceback up to the start of the
+// utterance, they are dropped all at once by the next InitDecoding().
+//
+// The methods below hide those of the base, they do not override them:
+// always call them through this type. The HashList of the base stays empty,
+// so its FinalRelativeCost(), and kaldi::EndpointDetected() which calls it,
+// would find no final state.
+//
+// Table is the map of the frame being decoded; HashListTokenTable is only
+// there for decoder_search_bench to time TokenTable against.
+template <typename FST, template <typename, typename> class Table = TokenTable>
+class IncrementalDecoderTpl : public LatticeIncrementalOnlineDecoderTpl<FST> {
+public:
+    typedef LatticeIncrementalOnlineDecoderTpl<FST> Base;
+    typedef typename Base::Arc Arc;
+    typedef typename Base::Label Label;
+    typedef typename Base::StateId StateId;
+    typedef typename Base::Token Token;
+    typedef typename Base::ForwardLinkT ForwardLinkT;
+
+    // arena must outlive the decoder
+    IncrementalDecoderTpl(const FST &fst, const TransitionModel &trans_model,
+                          const LatticeIncrementalDecoderConfig &config, TokenArena *arena);
+    ~IncrementalDecoderTpl();
+
+    void InitDecoding();
+    void AdvanceDecoding(DecodableInterface *decodable, int32 max_num_frames = -1);
+    void FinalizeDecoding();
+    const CompactLattice &GetLattice(int32 num_frames_to_include, bool use_final_probs = false);
+    BaseFloat FinalRelativeCost() const;
+    bool ReachedFinal() const { return FinalRelativeCost() != std::numeric_limits<BaseFloat>::infinity(); }
+    typename Base::BestPathIterator BestPathEnd(bool use_final_probs, BaseFloat *final_cost = nullptr) const;
+    bool GetBestPath(Lattice *ofst, bool use_final_probs = true) const;
+    // would run the search of the base on tokens it did not allocate
+    bool Decode(DecodableInterface *decodable) = delete;
+
+    int32 NumActiveTokens() { return this->GetNumToksForFrame(this->NumFramesDecoded()); }
+
+private:
+    typedef Table<StateId, Token> TokenTableT;
+    typedef typename TokenTableT::Entry Entry;
+
+    template <typename Graph>
+    void DecodeFrames(const Graph &graph, DecodableInterface *decodable, int32 target_frames_decoded);
+    template <typename Graph>
+    BaseFloat ProcessEmitting(const Graph &graph, DecodableInterface *decodable);
+    template <typename Graph>
+    void ProcessNonemitting(const Graph &graph, BaseFloat cutoff);
+
+    Token *FindOrAddToken(StateId state, int32 frame_plus_one, BaseFloat tot_cost,
+                          Token *backpointer, bool *changed);
+    BaseFloat GetCutoff(const std::vector<Entry> &toks, BaseFloat *adaptive_beam, const Entry **best_entry);
+    void DeleteForwardLinks(Token *tok);
+    void ClearActiveTokens();
+    void ComputeFinalCosts(unordered_map<Token *, BaseFloat> *final_costs, BaseFloat *final_relative_cost,
+                           BaseFloat *final_best_cost) const;
+
+    void PruneForwardLinks(int32 frame_plus_one, bool *extra_costs_changed, bool *links_pruned,
+                           BaseFloat delta);
+    void PruneForwardLinksFinal();
+    void PruneTokensForFrame(int32 frame_plus_one);
+    void PruneActiveTokens(BaseFloat delta);
+    void UpdateLatticeDeterminization();
+
+    TokenArena *arena_;
+    TokenTableT table_;             // the frame being decoded, the HashList of the base stays empty
+    std::vector<Entry> prev_toks_;  // the frame before, while ProcessEmitting() expands it
+};
+
+typedef IncrementalDecoderTpl<fst::Fst<fst::StdArc> > IncrementalDecoder;
+typedef IncrementalDecoderTpl<fst::ConstGrammarFst> GrammarIncrementalDecoder;
+
+#endif // KALDIANDROID_INCREMENTAL_DECODER_H
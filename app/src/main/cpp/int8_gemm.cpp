@@ -0,0 +1,95 @@
+#include "int8_gemm.h"
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#elif defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+// This file is built without ISA flags: its own kernel is the base instruction
+// set one, plain NEON on arm64 and the portable loop elsewhere. The others are
+// separate files built with their flags (CMakeLists.txt) and only called once
+// the CPU was checked for them.
+#define INT8_GEMM_ADD Int8GemmAddBase
+#include "int8_gemm_kernel.h"
+
+typedef void (*Int8GemmAddFunction)(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step,
+                                    int32 num_rows, const int8 *w, const float *w_scale, int32 w_rows,
+                                    int32 depth, float *out, int32 out_stride);
+
+#if defined(__aarch64__)
+void Int8GemmAddSdot(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                     const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                     float *out, int32 out_stride);
+#if defined(KWANG_ARM_I8MM)
+void Int8GemmAddI8mm(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                     const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                     float *out, int32 out_stride);
+#endif
+#elif defined(__x86_64__)
+void Int8GemmAddAvx2(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                     const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                     float *out, int32 out_stride);
+#if defined(KWANG_AVXVNNI)
+void Int8GemmAddAvxVnni(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                        const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                        float *out, int32 out_stride);
+#endif
+#endif
+
+struct Int8Kernel {
+    const char *name;
+    Int8GemmAddFunction add;
+    bool simd; // the portable loop is slower than the float GEMM
+};
+
+static Int8Kernel SelectInt8Kernel() {
+#if defined(__aarch64__)
+#if defined(__linux__)
+    unsigned long hwcap = getauxval(AT_HWCAP), hwcap2 = getauxval(AT_HWCAP2);
+#if defined(KWANG_ARM_I8MM)
+    if ((hwcap2 & (1UL << 13)) != 0) { // HWCAP2_I8MM
+        return {"neon-i8mm", Int8GemmAddI8mm, true};
+    }
+#endif
+    if ((hwcap & (1UL << 20)) != 0) { // HWCAP_ASIMDDP
+        return {"neon-sdot", Int8GemmAddSdot, true};
+    }
+#endif
+    return {"neon", Int8GemmAddBase, true};
+#elif defined(__x86_64__)
+#if defined(KWANG_AVXVNNI)
+    unsigned int eax, ebx, ecx, edx;
+    if (__builtin_cpu_supports("avx2") && __get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx) &&
+        (eax & (1u << 4)) != 0) {
+        return {"avx-vnni", Int8GemmAddAvxVnni, true};
+    }
+#endif
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx2", Int8GemmAddAvx2, true};
+    }
+    return {"portable", Int8GemmAddBase, false};
+#else
+    return {"portable", Int8GemmAddBase, false};
+#endif
+}
+
+static const Int8Kernel &ActiveInt8Kernel() {
+    static const Int8Kernel kernel = SelectInt8Kernel();
+    return kernel;
+}
+
+void Int8GemmAdd(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                 const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                 float *out, int32 out_stride) {
+    ActiveInt8Kernel().add(a, a_scale, row_offset, row_step, num_rows, w, w_scale, w_rows, depth,
+                           out, out_stride);
+}
+
+const char *Int8KernelName() {
+    return ActiveInt8Kernel().name;
+}
+
+bool Int8KernelSupported() {
+    return ActiveInt8Kernel().simd;
+}
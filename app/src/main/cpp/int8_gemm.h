@@ -0,0 +1,32 @@
+#ifndef KALDIANDROID_INT8_GEMM_H
+#define KALDIANDROID_INT8_GEMM_H
+
+// Only the int types: the kernel files are built with ISA flags, and an inline
+// function or template instantiated there could end up as the one copy the
+// linker keeps for the whole library
+#include "base/kaldi-types.h"
+
+using namespace kaldi;
+
+// Rows are padded with zeros to a multiple of this, one AVX2 register or two
+// NEON ones, so the kernels have no tail loop
+static const int32 kInt8Depth = 32;
+
+// out[i * out_stride + o] += a_scale[r] * w_scale[o] * dot(a row r, w row o)
+// for r = row_offset + i * row_step, i < num_rows. Both a and w rows are depth
+// long, a multiple of kInt8Depth, and never hold -128. The dot products are
+// exact int32 sums, so every kernel gives the same result.
+void Int8GemmAdd(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                 const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                 float *out, int32 out_stride);
+
+// Kernel Int8GemmAdd() runs, picked on first use for this CPU among those the
+// library was built with: "neon-i8mm" (only with KWANG_ARM_I8MM), "neon-sdot"
+// or "neon" on arm64, "avx-vnni" (only with KWANG_AVXVNNI) or "avx2" on x86_64,
+// "portable" otherwise.
+const char *Int8KernelName();
+
+// False when only the portable loop is available, which is slower than float
+bool Int8KernelSupported();
+
+#endif // KALDIANDROID_INT8_GEMM_H
@@ -0,0 +1,3 @@
+// x86_64 kernel with AVX2 (maddubs), built with -mavx2
+#define INT8_GEMM_ADD Int8GemmAddAvx2
+#include "int8_gemm_kernel.h"
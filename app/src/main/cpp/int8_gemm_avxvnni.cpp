@@ -0,0 +1,3 @@
+// x86_64 kernel with AVX-VNNI (dpbusd), built with -mavxvnni when KWANG_AVXVNNI is on
+#define INT8_GEMM_ADD Int8GemmAddAvxVnni
+#include "int8_gemm_kernel.h"
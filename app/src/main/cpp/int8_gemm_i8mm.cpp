@@ -0,0 +1,4 @@
+// arm64 kernel with the Armv8.6 int8 matrix multiply (smmla), built with +i8mm
+// when KWANG_ARM_I8MM is on
+#define INT8_GEMM_ADD Int8GemmAddI8mm
+#include "int8_gemm_kernel.h"
@@ -0,0 +1,206 @@
+#ifndef KALDIANDROID_INT8_GEMM_KERNEL_H
+#define KALDIANDROID_INT8_GEMM_KERNEL_H
+
+// Body of one int8 kernel, included once by each kernel file with
+// INT8_GEMM_ADD set to the function name to define. The code is picked by the
+// ISA flags that file is built with (CMakeLists.txt), and nothing in here may
+// run before int8_gemm.cpp checked the CPU has them. Everything is static so no
+// copy built with wider instructions can stand in for another file's; keep it
+// to plain pointers.
+
+#include "int8_gemm.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifndef INT8_GEMM_ADD
+#error "Define INT8_GEMM_ADD before including int8_gemm_kernel.h"
+#endif
+
+// defined here, called through int8_gemm.cpp's Int8GemmAdd()
+void INT8_GEMM_ADD(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                   const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                   float *out, int32 out_stride);
+
+// Dot products of one activation row with 4 weight rows, n a multiple of kInt8Depth
+#if defined(__aarch64__) && defined(__ARM_FEATURE_DOTPROD)
+static inline void Dot4(const int8 *a, const int8 *w, int32 n, int32 *acc) {
+    int32x4_t s0 = vdupq_n_s32(0), s1 = s0, s2 = s0, s3 = s0;
+    for (int32 k = 0; k < n; k += 16) {
+        int8x16_t av = vld1q_s8(a + k);
+        s0 = vdotq_s32(s0, av, vld1q_s8(w + k));
+        s1 = vdotq_s32(s1, av, vld1q_s8(w + n + k));
+        s2 = vdotq_s32(s2, av, vld1q_s8(w + 2 * n + k));
+        s3 = vdotq_s32(s3, av, vld1q_s8(w + 3 * n + k));
+    }
+    acc[0] = vaddvq_s32(s0);
+    acc[1] = vaddvq_s32(s1);
+    acc[2] = vaddvq_s32(s2);
+    acc[3] = vaddvq_s32(s3);
+}
+
+static inline int32 Dot1(const int8 *a, const int8 *w, int32 n) {
+    int32x4_t s = vdupq_n_s32(0);
+    for (int32 k = 0; k < n; k += 16) {
+        s = vdotq_s32(s, vld1q_s8(a + k), vld1q_s8(w + k));
+    }
+    return vaddvq_s32(s);
+}
+#elif defined(__aarch64__)
+// two products of at most 127 * 127 fit an int16 lane before widening
+static inline int32x4_t DotStep(int32x4_t s, int8x16_t a, int8x16_t w) {
+    int16x8_t p = vmull_s8(vget_low_s8(a), vget_low_s8(w));
+    p = vmlal_s8(p, vget_high_s8(a), vget_high_s8(w));
+    return vpadalq_s16(s, p);
+}
+
+static inline void Dot4(const int8 *a, const int8 *w, int32 n, int32 *acc) {
+    int32x4_t s0 = vdupq_n_s32(0), s1 = s0, s2 = s0, s3 = s0;
+    for (int32 k = 0; k < n; k += 16) {
+        int8x16_t av = vld1q_s8(a + k);
+        s0 = DotStep(s0, av, vld1q_s8(w + k));
+        s1 = DotStep(s1, av, vld1q_s8(w + n + k));
+        s2 = DotStep(s2, av, vld1q_s8(w + 2 * n + k));
+        s3 = DotStep(s3, av, vld1q_s8(w + 3 * n + k));
+    }
+    acc[0] = vaddvq_s32(s0);
+    acc[1] = vaddvq_s32(s1);
+    acc[2] = vaddvq_s32(s2);
+    acc[3] = vaddvq_s32(s3);
+}
+
+static inline int32 Dot1(const int8 *a, const int8 *w, int32 n) {
+    int32x4_t s = vdupq_n_s32(0);
+    for (int32 k = 0; k < n; k += 16) {
+        s = DotStep(s, vld1q_s8(a + k), vld1q_s8(w + k));
+    }
+    return vaddvq_s32(s);
+}
+#elif defined(__AVX2__)
+// a * w as |a| * (w with the sign of a): unsigned times signed is what
+// maddubs and dpbusd multiply, and |a| <= 127 keeps maddubs from saturating
+static inline __m256i DotStep(__m256i s, __m256i a_abs, __m256i a, const int8 *w) {
+    __m256i ws = _mm256_sign_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(w)), a);
+#if defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(s, a_abs, ws);
+#else
+    return _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_maddubs_epi16(a_abs, ws), _mm256_set1_epi16(1)));
+#endif
+}
+
+static inline int32 HorizontalSum(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static inline void Dot4(const int8 *a, const int8 *w, int32 n, int32 *acc) {
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    for (int32 k = 0; k < n; k += 32) {
+        __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + k));
+        __m256i a_abs = _mm256_sign_epi8(av, av);
+        s0 = DotStep(s0, a_abs, av, w + k);
+        s1 = DotStep(s1, a_abs, av, w + n + k);
+        s2 = DotStep(s2, a_abs, av, w + 2 * n + k);
+        s3 = DotStep(s3, a_abs, av, w + 3 * n + k);
+    }
+    acc[0] = HorizontalSum(s0);
+    acc[1] = HorizontalSum(s1);
+    acc[2] = HorizontalSum(s2);
+    acc[3] = HorizontalSum(s3);
+}
+
+static inline int32 Dot1(const int8 *a, const int8 *w, int32 n) {
+    __m256i s = _mm256_setzero_si256();
+    for (int32 k = 0; k < n; k += 32) {
+        __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + k));
+        s = DotStep(s, _mm256_sign_epi8(av, av), av, w + k);
+    }
+    return HorizontalSum(s);
+}
+#else
+static inline int32 Dot1(const int8 *a, const int8 *w, int32 n) {
+    int32 s = 0;
+    for (int32 k = 0; k < n; k++) {
+        s += a[k] * w[k];
+    }
+    return s;
+}
+
+static inline void Dot4(const int8 *a, const int8 *w, int32 n, int32 *acc) {
+    for (int32 j = 0; j < 4; j++) {
+        acc[j] = Dot1(a, w + j * n, n);
+    }
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_MATMUL_INT8)
+// Two activation rows against 4 weight rows. smmla multiplies a 2x8 by an 8x2
+// block, lanes of the result are a0.w0, a0.w1, a1.w0, a1.w1.
+static inline void Dot2x4(const int8 *a0, const int8 *a1, const int8 *w, int32 n, int32 *acc0, int32 *acc1) {
+    int32x4_t s01 = vdupq_n_s32(0), s23 = s01;
+    for (int32 k = 0; k < n; k += 8) {
+        int8x16_t av = vcombine_s8(vld1_s8(a0 + k), vld1_s8(a1 + k));
+        s01 = vmmlaq_s32(s01, av, vcombine_s8(vld1_s8(w + k), vld1_s8(w + n + k)));
+        s23 = vmmlaq_s32(s23, av, vcombine_s8(vld1_s8(w + 2 * n + k), vld1_s8(w + 3 * n + k)));
+    }
+    acc0[0] = vgetq_lane_s32(s01, 0);
+    acc0[1] = vgetq_lane_s32(s01, 1);
+    acc1[0] = vgetq_lane_s32(s01, 2);
+    acc1[1] = vgetq_lane_s32(s01, 3);
+    acc0[2] = vgetq_lane_s32(s23, 0);
+    acc0[3] = vgetq_lane_s32(s23, 1);
+    acc1[2] = vgetq_lane_s32(s23, 2);
+    acc1[3] = vgetq_lane_s32(s23, 3);
+}
+#endif
+
+// Weight rows outside, 4 at a time, so each block stays in L1 while all
+// activation rows go past it and the weights are read from memory once
+void INT8_GEMM_ADD(const int8 *a, const float *a_scale, int32 row_offset, int32 row_step, int32 num_rows,
+                  const int8 *w, const float *w_scale, int32 w_rows, int32 depth,
+                  float *out, int32 out_stride) {
+    const int32 n = depth;
+    int32 o = 0;
+    for (; o + 4 <= w_rows; o += 4) {
+        const int8 *wo = w + static_cast<size_t>(o) * n;
+        const float *ws = w_scale + o;
+        int32 i = 0;
+#if defined(__aarch64__) && defined(__ARM_FEATURE_MATMUL_INT8)
+        for (; i + 2 <= num_rows; i += 2) {
+            int32 r0 = row_offset + i * row_step, r1 = r0 + row_step;
+            int32 acc0[4], acc1[4];
+            Dot2x4(a + static_cast<size_t>(r0) * n, a + static_cast<size_t>(r1) * n, wo, n, acc0, acc1);
+            float *out0 = out + static_cast<size_t>(i) * out_stride + o;
+            float *out1 = out0 + out_stride;
+            for (int32 j = 0; j < 4; j++) {
+                out0[j] += a_scale[r0] * ws[j] * acc0[j];
+                out1[j] += a_scale[r1] * ws[j] * acc1[j];
+            }
+        }
+#endif
+        for (; i < num_rows; i++) {
+            int32 r = row_offset + i * row_step;
+            int32 acc[4];
+            Dot4(a + static_cast<size_t>(r) * n, wo, n, acc);
+            float *out_row = out + static_cast<size_t>(i) * out_stride + o;
+            for (int32 j = 0; j < 4; j++) {
+                out_row[j] += a_scale[r] * ws[j] * acc[j];
+            }
+        }
+    }
+    for (; o < w_rows; o++) {
+        const int8 *wo = w + static_cast<size_t>(o) * n;
+        for (int32 i = 0; i < num_rows; i++) {
+            int32 r = row_offset + i * row_step;
+            out[static_cast<size_t>(i) * out_stride + o] +=
+                    a_scale[r] * w_scale[o] * Dot1(a + static_cast<size_t>(r) * n, wo, n);
+        }
+    }
+}
+
+#endif // KALDIANDROID_INT8_GEMM_KERNEL_H
@@ -0,0 +1,3 @@
+// arm64 kernel with the Armv8.2 dot product instructions (sdot), built with +dotprod
+#define INT8_GEMM_ADD Int8GemmAddSdot
+#include "int8_gemm_kernel.h"
@@ -88,11 +88,11 @@
 // 解码器相关
 // #include "decoder/biglm-faster-decoder.h"
 // #include "decoder/decodable-mapped.h"
-// #include "decoder/decodable-matrix.h"
+ #include "decoder/decodable-matrix.h"
 // #include "decoder/decodable-sum.h"
 // #include "decoder/decoder-wrappers.h"
-// #include "decoder/faster-decoder.h"
-// #include "decoder/grammar-fst.h"
+ #include "decoder/faster-decoder.h"
+ #include "decoder/grammar-fst.h"
 // #include "decoder/lattice-biglm-faster-decoder.h"
  #include "decoder/lattice-faster-decoder.h"
 // #include "decoder/lattice-faster-online-decoder.h"
@@ -116,7 +116,7 @@
 // #include "feat/pitch-functions.h"
 // #include "feat/resample.h"
 // #include "feat/signal.h"
-// #include "feat/wave-reader.h"
+ #include "feat/wave-reader.h"
 
 // OpenFST有限自动机 相关
 // #include "fst/accumulator.h"
@@ -239,7 +239,7 @@
  #include "fstext/fstext-lib.h"
 // #include "fstext/fstext-utils-inl.h"
  #include "fstext/fstext-utils.h"
-// #include "fstext/grammar-context-fst.h"
+ #include "fstext/grammar-context-fst.h"
 // #include "fstext/kaldi-fst-io-inl.h"
 // #include "fstext/kaldi-fst-io.h"
 // #include "fstext/lattice-utils-inl.h"
@@ -252,7 +252,7 @@
 // #include "fstext/push-special.h"
 // #include "fstext/rand-fst.h"
 // #include "fstext/remove-eps-local-inl.h"
-// #include "fstext/remove-eps-local.h"
+ #include "fstext/remove-eps-local.h"
 // #include "fstext/table-matcher.h"
 // #include "fstext/trivial-factor-weight.h"
 
@@ -282,7 +282,7 @@
 // HMM模型相关
 // #include "hmm/hmm-test-utils.h"
 // #include "hmm/hmm-topology.h"
-// #include "hmm/hmm-utils.h"
+ #include "hmm/hmm-utils.h"
 // #include "hmm/posterior.h"
 // #include "hmm/transition-model.h"
 // #include "hmm/tree-accu.h"
@@ -424,9 +424,9 @@
 // #include "nnet3/discriminative-training.h"
 // #include "nnet3/natural-gradient-online.h"
  #include "nnet3/nnet-am-decodable-simple.h"
-// #include "nnet3/nnet-analyze.h"
+ #include "nnet3/nnet-analyze.h"
 // #include "nnet3/nnet-attention-component.h"
-// #include "nnet3/nnet-batch-compute.h"
+ #include "nnet3/nnet-batch-compute.h"
 // #include "nnet3/nnet-chain-diagnostics.h"
 // #include "nnet3/nnet-chain-diagnostics2.h"
 // #include "nnet3/nnet-chain-example.h"
@@ -434,14 +434,14 @@
 // #include "nnet3/nnet-chain-training2.h"
 // #include "nnet3/nnet-combined-component.h"
 // #include "nnet3/nnet-common.h"
-// #include "nnet3/nnet-compile-looped.h"
+ #include "nnet3/nnet-compile-looped.h"
 // #include "nnet3/nnet-compile-utils.h"
 // #include "nnet3/nnet-compile.h"
 // #include "nnet3/nnet-component-itf.h"
 // #include "nnet3/nnet-computation-graph.h"
 // #include "nnet3/nnet-computation.h"
-// #include "nnet3/nnet-compute.h"
-// #include "nnet3/nnet-convolutional-component.h"
+ #include "nnet3/nnet-compute.h"
+ #include "nnet3/nnet-convolutional-component.h"
 // #include "nnet3/nnet-descriptor.h"
 // #include "nnet3/nnet-diagnostics.h"
 // #include "nnet3/nnet-discriminative-diagnostics.h"
@@ -452,11 +452,11 @@
 // #include "nnet3/nnet-general-component.h"
 // #include "nnet3/nnet-graph.h"
 // #include "nnet3/nnet-nnet.h"
-// #include "nnet3/nnet-normalize-component.h"
+ #include "nnet3/nnet-normalize-component.h"
 // #include "nnet3/nnet-optimize-utils.h"
 // #include "nnet3/nnet-optimize.h"
 // #include "nnet3/nnet-parse.h"
-// #include "nnet3/nnet-simple-component.h"
+ #include "nnet3/nnet-simple-component.h"
 // #include "nnet3/nnet-test-utils.h"
 // #include "nnet3/nnet-training.h"
  #include "nnet3/nnet-utils.h"
@@ -481,7 +481,7 @@
 // #include "online2/online-nnet2-feature-pipeline.h"
 // #include "online2/online-nnet3-decoding.h"
  #include "online2/online-nnet3-incremental-decoding.h"
-// #include "online2/online-nnet3-wake-word-faster-decoder.h"
+ #include "online2/online-nnet3-wake-word-faster-decoder.h"
 // #include "online2/online-speex-wrapper.h"
  #include "online2/online-timing.h"
  #include "online2/onlinebin-util.h"
@@ -534,7 +534,7 @@
 // #include "tree/build-tree.h"
 // #include "tree/cluster-utils.h"
 // #include "tree/clusterable-classes.h"
-// #include "tree/context-dep.h"
+ #include "tree/context-dep.h"
 // #include "tree/event-map.h"
 // #include "tree/tree-renderer.h"
 
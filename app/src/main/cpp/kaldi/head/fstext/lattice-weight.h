@@ -438,6 +438,9 @@ class CompactLatticeWeightTpl {
   CompactLatticeWeightTpl(const WeightType &w, const std::vector<IntType> &s):
       weight_(w), string_(s) { }
 
+  CompactLatticeWeightTpl(const CompactLatticeWeightTpl &other):
+      weight_(other.weight_), string_(other.string_) { }
+
   CompactLatticeWeightTpl &operator=(const CompactLatticeWeightTpl<WeightType, IntType> &w) {
     weight_ = w.weight_;
     string_ = w.string_;
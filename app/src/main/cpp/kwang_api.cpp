@@ -4,8 +4,12 @@
 
 #include "kwang_api.h"
 
+#include <cstring>
+
 #include "recognizer.h"
+#include "async_recognizer.h"
 #include "model.h"
+#include "wake_word.h"
 
 using namespace kaldi;
 
@@ -32,6 +36,28 @@ int kwang_model_find_word(VModel *model, const char *word)
     return (int) ((Model *)model)->FindWord(word);
 }
 
+int kwang_model_word_symbol(VModel *model, int word_id, char *buffer, int size)
+{
+    string word;
+    if (!((Model *)model)->WordSymbol(word_id, &word)) {
+        return -1;
+    }
+    if (static_cast<size_t>(size) > word.size()) {
+        memcpy(buffer, word.c_str(), word.size() + 1);
+    }
+    return word.size();
+}
+
+const char *kwang_model_load_stats(VModel *model)
+{
+    return ((Model *)model)->LoadStats();
+}
+
+void kwang_model_preload_rescoring(VModel *model)
+{
+    ((Model *)model)->PreloadRescoring();
+}
+
 VRecognizer *kwang_recognizer_new(VModel *model) {
     try {
         return (VRecognizer *)new Recognizer((Model *)model);
@@ -43,11 +69,46 @@ VRecognizer *kwang_recognizer_new(VModel *model) {
 void kwang_recognizer_free(VRecognizer *recognizer) {
     delete (Recognizer *)(recognizer);
 }
+
+VRecognizer *kwang_model_acquire_recognizer(VModel *model)
+{
+    try {
+        return (VRecognizer *)((Model *)model)->AcquireRecognizer();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void kwang_recognizer_release(VRecognizer *recognizer)
+{
+    if (recognizer == nullptr) {
+        return;
+    }
+    Recognizer *r = (Recognizer *)recognizer;
+    r->GetModel()->ReleaseRecognizer(r);
+}
+
+void kwang_model_prewarm_recognizers(VModel *model, int count)
+{
+    try {
+        ((Model *)model)->PrewarmRecognizers(count);
+    } catch (...) {
+    }
+}
 void kwang_recognizer_reset(VRecognizer *recognizer)
 {
     ((Recognizer *)recognizer)->Reset();
 }
 
+int kwang_recognizer_set_sub_grammar(VRecognizer *recognizer, const char *nonterminal, const char *phrases)
+{
+    try {
+        return ((Recognizer *)recognizer)->SetSubGrammar(nonterminal, phrases) ? 1 : 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
 int kwang_recognizer_accept_waveform(VRecognizer *recognizer, const char *data, int length)
 {
     try {
@@ -66,6 +127,15 @@ int kwang_recognizer_accept_waveform_s(VRecognizer *recognizer, const short *dat
     }
 }
 
+int kwang_recognizer_accept_waveform_f(VRecognizer *recognizer, const float *data, int length)
+{
+    try {
+        return ((Recognizer *)(recognizer))->AcceptWaveform(data, length);
+    } catch (...) {
+        return -1;
+    }
+}
+
 const char *kwang_recognizer_result(VRecognizer *recognizer)
 {
     return ((Recognizer *)recognizer)->Result();
@@ -81,3 +151,125 @@ const char *kwang_recognizer_final_result(VRecognizer *recognizer)
     return ((Recognizer *)recognizer)->FinalResult();
 }
 
+void kwang_recognizer_set_json(VRecognizer *recognizer, int json)
+{
+    ((Recognizer *)recognizer)->SetJson(json != 0);
+}
+
+int kwang_recognizer_result_words(VRecognizer *recognizer, int *words, int *start_frames,
+                                  int *end_frames, float *confs, int max_words)
+{
+    const std::vector<ResultWord> &result = ((Recognizer *)recognizer)->ResultWords();
+    int n = std::min(static_cast<int>(result.size()), max_words);
+    for (int i = 0; i < n; i++) {
+        if (words) words[i] = result[i].word;
+        if (start_frames) start_frames[i] = result[i].start;
+        if (end_frames) end_frames[i] = result[i].end;
+        if (confs) confs[i] = result[i].conf;
+    }
+    return result.size();
+}
+
+int kwang_recognizer_result_binary(VRecognizer *recognizer, void *buffer, int size)
+{
+    const std::vector<ResultWord> &result = ((Recognizer *)recognizer)->ResultWords();
+    int32 num_words = result.size();
+    int needed = sizeof(num_words) + num_words * KWANG_RESULT_WORD_BYTES;
+    if (buffer == nullptr || size < needed) {
+        return needed;
+    }
+    char *p = static_cast<char *>(buffer);
+    memcpy(p, &num_words, sizeof(num_words));
+    p += sizeof(num_words);
+    for (int32 i = 0; i < num_words; i++) {
+        memcpy(p, &result[i].word, 4);
+        memcpy(p + 4, &result[i].start, 4);
+        memcpy(p + 8, &result[i].end, 4);
+        memcpy(p + 12, &result[i].conf, 4);
+        p += KWANG_RESULT_WORD_BYTES;
+    }
+    return needed;
+}
+
+const char *kwang_recognizer_stats(VRecognizer *recognizer)
+{
+    return ((Recognizer *)recognizer)->Stats();
+}
+
+const char *kwang_recognizer_search_params(VRecognizer *recognizer)
+{
+    return ((Recognizer *)recognizer)->SearchParams();
+}
+
+VAsyncRecognizer *kwang_async_recognizer_new(VModel *model, float buffer_seconds,
+                                             kwang_result_callback callback, void *user_data)
+{
+    try {
+        return (VAsyncRecognizer *)new AsyncRecognizer((Model *)model, buffer_seconds,
+                                                       callback, user_data);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void kwang_async_recognizer_free(VAsyncRecognizer *recognizer)
+{
+    delete (AsyncRecognizer *)(recognizer);
+}
+
+int kwang_async_recognizer_accept_waveform_s(VAsyncRecognizer *recognizer, const short *data, int length)
+{
+    try {
+        return ((AsyncRecognizer *)(recognizer))->AcceptWaveform(data, length);
+    } catch (...) {
+        return -1;
+    }
+}
+
+void kwang_async_recognizer_input_finished(VAsyncRecognizer *recognizer)
+{
+    ((AsyncRecognizer *)recognizer)->InputFinished();
+}
+
+VWakeWordRecognizer *kwang_wake_word_recognizer_new(VModel *model)
+{
+    try {
+        return (VWakeWordRecognizer *)new WakeWordRecognizer((Model *)model);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void kwang_wake_word_recognizer_free(VWakeWordRecognizer *recognizer)
+{
+    delete (WakeWordRecognizer *)recognizer;
+}
+
+int kwang_wake_word_recognizer_accept_waveform_s(VWakeWordRecognizer *recognizer, const short *data, int length)
+{
+    try {
+        return ((WakeWordRecognizer *)recognizer)->AcceptWaveform(data, length);
+    } catch (...) {
+        return -1;
+    }
+}
+
+const char *kwang_wake_word_recognizer_keyword(VWakeWordRecognizer *recognizer)
+{
+    return ((WakeWordRecognizer *)recognizer)->Keyword();
+}
+
+const char *kwang_wake_word_recognizer_result(VWakeWordRecognizer *recognizer)
+{
+    return ((WakeWordRecognizer *)recognizer)->Result();
+}
+
+const char *kwang_wake_word_recognizer_partial_result(VWakeWordRecognizer *recognizer)
+{
+    return ((WakeWordRecognizer *)recognizer)->PartialResult();
+}
+
+const char *kwang_wake_word_recognizer_final_result(VWakeWordRecognizer *recognizer)
+{
+    return ((WakeWordRecognizer *)recognizer)->FinalResult();
+}
@@ -12,22 +12,105 @@ extern "C" {
 
 typedef struct VModel VModel;
 typedef struct VRecognizer VRecognizer;
+typedef struct VAsyncRecognizer VAsyncRecognizer;
+typedef struct VWakeWordRecognizer VWakeWordRecognizer;
+
+/* Events delivered to the async recognizer callback */
+#define KWANG_EVENT_PARTIAL 0
+#define KWANG_EVENT_RESULT 1
+#define KWANG_EVENT_FINAL 2
+
+/* Returned by kwang_wake_word_recognizer_accept_waveform_s */
+#define KWANG_WAKE_NONE 0
+#define KWANG_WAKE_RESULT 1
+#define KWANG_WAKE_KEYWORD 2
+
+/* Flat encoding of the last result, see kwang_recognizer_result_binary:
+ * int32 number of words, then per word int32 word id, int32 start frame,
+ * int32 end frame and float confidence, all in native byte order */
+#define KWANG_RESULT_WORD_BYTES 16
+
+/* Called on the decode thread, result is only valid during the call */
+typedef void (*kwang_result_callback)(void *user_data, int event, const char *result);
 
 VModel * kwang_model_new(const char *model_path);
 void kwang_model_free(VModel *model);
 int kwang_model_find_word(VModel *model, const char *word);
+/* Copies the word with this id into buffer, returns its length or -1 if the id is unknown.
+ * Nothing is copied if size is not larger than the length */
+int kwang_model_word_symbol(VModel *model, int word_id, char *buffer, int size);
+/* JSON with total and per-stage load time and resident memory growth, owned by the model */
+const char *kwang_model_load_stats(VModel *model);
+/* Rescoring LMs are loaded by the first final result that needs them, call this
+ * after kwang_model_new to load them in the background instead */
+void kwang_model_preload_rescoring(VModel *model);
 
 VRecognizer *kwang_recognizer_new(VModel *model);
 void kwang_recognizer_free(VRecognizer *recognizer);
+/* Pooled recognizers: acquire reuses one given back by kwang_recognizer_release,
+ * which resets it to a new stream instead of freeing it. Prewarm creates count
+ * idle recognizers up front. */
+VRecognizer *kwang_model_acquire_recognizer(VModel *model);
+void kwang_recognizer_release(VRecognizer *recognizer);
+void kwang_model_prewarm_recognizers(VModel *model, int count);
 void kwang_recognizer_reset(VRecognizer *recognizer);
+/* For models with a grammar graph: compiles phrases, a JSON array of strings,
+ * into the sub-graph of #nonterm:<nonterminal> for this recognizer only. Used
+ * from the next utterance on. Returns 1 on success, 0 if the model has no such
+ * nonterminal or phrases is not an array, -1 on failure. */
+int kwang_recognizer_set_sub_grammar(VRecognizer *recognizer, const char *nonterminal, const char *phrases);
 
 int kwang_recognizer_accept_waveform(VRecognizer *recognizer, const char *data, int length);
 int kwang_recognizer_accept_waveform_s(VRecognizer *recognizer, const short *data, int length);
+int kwang_recognizer_accept_waveform_f(VRecognizer *recognizer, const float *data, int length);
 
 const char *kwang_recognizer_result(VRecognizer *recognizer);
 const char *kwang_recognizer_partial_result(VRecognizer *recognizer);
 const char *kwang_recognizer_final_result(VRecognizer *recognizer);
 
+/* The string results above are a convenience layer. Words of the last result or
+ * partial result are also available without formatting: times are output frames
+ * (0.03s) from the start of the stream, -1 for partials without word times. */
+
+/* 0 turns off formatting, the string results are then "" */
+void kwang_recognizer_set_json(VRecognizer *recognizer, int json);
+/* Fills up to max_words entries of each non-null array, returns the number of words */
+int kwang_recognizer_result_words(VRecognizer *recognizer, int *words, int *start_frames,
+                                  int *end_frames, float *confs, int max_words);
+/* Writes the flat encoding if it fits in size bytes, returns the size it needs */
+int kwang_recognizer_result_binary(VRecognizer *recognizer, void *buffer, int size);
+
+/* Cumulative time and calls of every decoding stage (features, nnet, search,
+ * determinize, rescore, rnnlm, mbr), active tokens and result lattice sizes since
+ * the recognizer was created or acquired from the model, as JSON. Valid until
+ * the next call. */
+const char *kwang_recognizer_stats(VRecognizer *recognizer);
+
+/* Operating point of the search as JSON: beam, max_active and lattice_beam. With
+ * rtf-governor on in model.conf also the governor level, 0 at the model config
+ * and 1 at its lowest bounds, and the real-time factor of the last update.
+ * Valid until the next call. */
+const char *kwang_recognizer_search_params(VRecognizer *recognizer);
+
+VAsyncRecognizer *kwang_async_recognizer_new(VModel *model, float buffer_seconds,
+                                             kwang_result_callback callback, void *user_data);
+void kwang_async_recognizer_free(VAsyncRecognizer *recognizer);
+int kwang_async_recognizer_accept_waveform_s(VAsyncRecognizer *recognizer, const short *data, int length);
+void kwang_async_recognizer_input_finished(VAsyncRecognizer *recognizer);
+
+/* Low-power listening with the keyword model in the kws/ directory of the model.
+ * KWANG_WAKE_KEYWORD: a keyword was detected, the buffered audio and what follows
+ * now go to a full recognizer. KWANG_WAKE_RESULT: endpoint of that utterance,
+ * fetch it with kwang_wake_word_recognizer_result, listening resumes. -1 on failure.
+ * Returns NULL if the model has no kws/ directory. */
+VWakeWordRecognizer *kwang_wake_word_recognizer_new(VModel *model);
+void kwang_wake_word_recognizer_free(VWakeWordRecognizer *recognizer);
+int kwang_wake_word_recognizer_accept_waveform_s(VWakeWordRecognizer *recognizer, const short *data, int length);
+const char *kwang_wake_word_recognizer_keyword(VWakeWordRecognizer *recognizer);
+const char *kwang_wake_word_recognizer_result(VWakeWordRecognizer *recognizer);
+const char *kwang_wake_word_recognizer_partial_result(VWakeWordRecognizer *recognizer);
+const char *kwang_wake_word_recognizer_final_result(VWakeWordRecognizer *recognizer);
+
 #ifdef __cplusplus
 }
 #endif
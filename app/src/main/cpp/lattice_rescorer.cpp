@@ -0,0 +1,265 @@
+#include "lattice_rescorer.h"
+
+#include <algorithm>
+#include <cstring>
+
+ComposeLmDeterministicFst::ComposeLmDeterministicFst(fst::DeterministicOnDemandFst<fst::StdArc> *fst1,
+                                                     fst::DeterministicOnDemandFst<fst::StdArc> *fst2)
+        : fst1_(fst1), fst2_(fst2) {
+    Clear();
+}
+
+void ComposeLmDeterministicFst::Clear() {
+    state_map_.clear();
+    state_vec_.clear();
+    FindOrAddState(fst1_->Start(), fst2_->Start());
+}
+
+ComposeLmDeterministicFst::StateId ComposeLmDeterministicFst::FindOrAddState(StateId s1, StateId s2) {
+    uint64 key = (static_cast<uint64>(s1) << 32) | static_cast<uint32>(s2);
+    std::pair<std::unordered_map<uint64, StateId>::iterator, bool> result =
+            state_map_.insert(std::make_pair(key, static_cast<StateId>(state_vec_.size())));
+    if (result.second) {
+        state_vec_.push_back(std::make_pair(s1, s2));
+    }
+    return result.first->second;
+}
+
+ComposeLmDeterministicFst::Weight ComposeLmDeterministicFst::Final(StateId s) {
+    KALDI_ASSERT(s < static_cast<StateId>(state_vec_.size()));
+    const std::pair<StateId, StateId> &pr = state_vec_[s];
+    return fst::Times(fst1_->Final(pr.first), fst2_->Final(pr.second));
+}
+
+// Same as ComposeDeterministicOnDemandFst::GetArc
+bool ComposeLmDeterministicFst::GetArc(StateId s, Label ilabel, fst::StdArc *oarc) {
+    KALDI_ASSERT(s < static_cast<StateId>(state_vec_.size()));
+    std::pair<StateId, StateId> pr = state_vec_[s];
+    fst::StdArc arc1;
+    if (!fst1_->GetArc(pr.first, ilabel, &arc1)) {
+        return false;
+    }
+    if (arc1.olabel == 0) { // only the first state moves
+        oarc->ilabel = ilabel;
+        oarc->olabel = 0;
+        oarc->nextstate = FindOrAddState(arc1.nextstate, pr.second);
+        oarc->weight = arc1.weight;
+        return true;
+    }
+    fst::StdArc arc2;
+    if (!fst2_->GetArc(pr.second, arc1.olabel, &arc2)) {
+        return false;
+    }
+    oarc->ilabel = ilabel;
+    oarc->olabel = arc2.olabel;
+    oarc->nextstate = FindOrAddState(arc1.nextstate, arc2.nextstate);
+    oarc->weight = fst::Times(arc1.weight, arc2.weight);
+    return true;
+}
+
+
+IncrementalLatticeRescorer::IncrementalLatticeRescorer(fst::DeterministicOnDemandFst<fst::StdArc> *lm)
+        : lm_(lm) {
+}
+
+void IncrementalLatticeRescorer::Reset() {
+    tuples_.clear();
+    tuple_to_state_.clear();
+    arcs_.clear();
+    states_of_lat_state_.clear();
+    lat_state_signatures_.clear();
+    lat_state_preds_.clear();
+    unstable_lat_states_.clear();
+}
+
+static inline uint64 HashCombine(uint64 hash, uint64 value) {
+    return (hash ^ value) * 1099511628211ULL;
+}
+
+static inline uint64 FloatBits(float f) {
+    uint32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+uint64 IncrementalLatticeRescorer::ArcsSignature(const CompactLattice &clat, StateId lat_state) {
+    uint64 hash = 14695981039346656037ULL;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, lat_state); !aiter.Done(); aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        hash = HashCombine(hash, arc.olabel);
+        hash = HashCombine(hash, arc.nextstate);
+        hash = HashCombine(hash, FloatBits(arc.weight.Weight().Value1()));
+        hash = HashCombine(hash, FloatBits(arc.weight.Weight().Value2()));
+        const std::vector<int32> &tids = arc.weight.String();
+        hash = HashCombine(hash, tids.size());
+        for (size_t i = 0; i < tids.size(); i++) {
+            hash = HashCombine(hash, tids[i]);
+        }
+    }
+    return hash;
+}
+
+IncrementalLatticeRescorer::StateId IncrementalLatticeRescorer::FindOrAddState(StateId lat_state,
+                                                                               StateId lm_state) {
+    uint64 key = (static_cast<uint64>(lat_state) << 32) | static_cast<uint32>(lm_state);
+    std::unordered_map<uint64, StateId>::iterator it = tuple_to_state_.find(key);
+    if (it != tuple_to_state_.end()) {
+        return it->second;
+    }
+    StateId state = tuples_.size();
+    tuples_.push_back(std::make_pair(lat_state, lm_state));
+    arcs_.push_back(std::vector<CompactLatticeArc>());
+    tuple_to_state_[key] = state;
+    if (states_of_lat_state_.size() <= static_cast<size_t>(lat_state)) {
+        states_of_lat_state_.resize(lat_state + 1);
+    }
+    states_of_lat_state_[lat_state].push_back(state);
+    queue_.push_back(state);
+    return state;
+}
+
+// Same arc rule as ComposeCompactLatticeDeterministic: epsilons keep the LM
+// state, words follow the LM arc and add its cost to the graph cost
+void IncrementalLatticeRescorer::Expand(const CompactLattice &clat, StateId state) {
+    StateId lat_state = tuples_[state].first;
+    StateId lm_state = tuples_[state].second;
+    std::vector<CompactLatticeArc> arcs;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, lat_state); !aiter.Done(); aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        CompactLatticeArc composed_arc = arc;
+        if (arc.olabel == 0) {
+            composed_arc.nextstate = FindOrAddState(arc.nextstate, lm_state);
+        } else {
+            fst::StdArc lm_arc;
+            if (!lm_->GetArc(lm_state, arc.olabel, &lm_arc)) {
+                continue;
+            }
+            LatticeWeight weight = arc.weight.Weight();
+            weight.SetValue1(weight.Value1() + lm_arc.weight.Value());
+            composed_arc.weight.SetWeight(weight);
+            composed_arc.nextstate = FindOrAddState(arc.nextstate, lm_arc.nextstate);
+        }
+        arcs.push_back(composed_arc);
+    }
+    arcs_[state].swap(arcs);
+}
+
+void IncrementalLatticeRescorer::Update(const CompactLattice &clat) {
+    StateId num_lat_states = clat.NumStates();
+    if (num_lat_states == 0 || clat.Start() == fst::kNoStateId) {
+        return;
+    }
+    if (!tuples_.empty() && (tuples_[0].first != clat.Start() ||
+                             static_cast<size_t>(num_lat_states) < lat_state_signatures_.size())) {
+        Reset(); // not the lattice we were following
+    }
+    queue_.clear();
+    if (tuples_.empty()) {
+        FindOrAddState(clat.Start(), lm_->Start());
+    }
+    // Re-expand composed states whose lattice state got new or rewritten arcs.
+    // The determinizer only appends states and rewrites the unstable ones found
+    // at the previous call, everything before is final.
+    StateId num_checked = lat_state_signatures_.size();
+    StateId window_begin = num_checked;
+    lat_state_signatures_.resize(num_lat_states, 0);
+    lat_state_preds_.resize(num_lat_states);
+    for (size_t i = 0; i < unstable_lat_states_.size(); i++) {
+        StateId s = unstable_lat_states_[i];
+        if (s < num_checked) {
+            CheckState(clat, s);
+            window_begin = std::min(window_begin, s);
+        }
+    }
+    for (StateId s = num_checked; s < num_lat_states; s++) {
+        CheckState(clat, s);
+    }
+    FindUnstableStates(clat, window_begin);
+    // states found while expanding are appended to queue_ by FindOrAddState
+    for (size_t i = 0; i < queue_.size(); i++) {
+        Expand(clat, queue_[i]);
+    }
+    queue_.clear();
+}
+
+// Queues the composed states of lat_state if its arcs changed since the last expansion
+void IncrementalLatticeRescorer::CheckState(const CompactLattice &clat, StateId lat_state) {
+    uint64 signature = ArcsSignature(clat, lat_state);
+    if (signature == lat_state_signatures_[lat_state]) {
+        return;
+    }
+    lat_state_signatures_[lat_state] = signature;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, lat_state); !aiter.Done(); aiter.Next()) {
+        lat_state_preds_[aiter.Value().nextstate].push_back(lat_state);
+    }
+    if (static_cast<size_t>(lat_state) < states_of_lat_state_.size()) {
+        const std::vector<StateId> &states = states_of_lat_state_[lat_state];
+        queue_.insert(queue_.end(), states.begin(), states.end());
+    }
+}
+
+// States the next chunk may rewrite: those with a final weight (arcs to the next
+// chunk get added), the redeterminized states reachable from them, and the
+// predecessors of those (the arcs into a redeterminized state get reweighted).
+// All of them are new or were unstable before, so at or after window_begin.
+void IncrementalLatticeRescorer::FindUnstableStates(const CompactLattice &clat, StateId window_begin) {
+    unstable_lat_states_.clear();
+    std::unordered_set<StateId> seen;
+    StateId num_lat_states = clat.NumStates();
+    for (StateId s = window_begin; s < num_lat_states; s++) {
+        if (clat.Final(s) != CompactLatticeWeight::Zero()) {
+            unstable_lat_states_.push_back(s);
+            seen.insert(s);
+        }
+    }
+    for (size_t i = 0; i < unstable_lat_states_.size(); i++) {
+        for (fst::ArcIterator<CompactLattice> aiter(clat, unstable_lat_states_[i]); !aiter.Done(); aiter.Next()) {
+            StateId next = aiter.Value().nextstate;
+            if (seen.insert(next).second) {
+                unstable_lat_states_.push_back(next);
+            }
+        }
+    }
+    size_t num_redeterminized = unstable_lat_states_.size();
+    for (size_t i = 0; i < num_redeterminized; i++) {
+        const std::vector<StateId> &preds = lat_state_preds_[unstable_lat_states_[i]];
+        unstable_lat_states_.insert(unstable_lat_states_.end(), preds.begin(), preds.end());
+    }
+    std::sort(unstable_lat_states_.begin(), unstable_lat_states_.end());
+    unstable_lat_states_.erase(std::unique(unstable_lat_states_.begin(), unstable_lat_states_.end()),
+                               unstable_lat_states_.end());
+}
+
+void IncrementalLatticeRescorer::GetLattice(const CompactLattice &clat, CompactLattice *rescored) {
+    Update(clat);
+    rescored->DeleteStates();
+    if (tuples_.empty()) {
+        return;
+    }
+    rescored->ReserveStates(tuples_.size());
+    for (size_t s = 0; s < tuples_.size(); s++) {
+        rescored->AddState();
+    }
+    rescored->SetStart(0);
+    for (size_t s = 0; s < tuples_.size(); s++) {
+        StateId lat_state = tuples_[s].first;
+        if (lat_state >= clat.NumStates()) {
+            continue; // left behind by a rewritten chunk end, removed by Connect
+        }
+        const std::vector<CompactLatticeArc> &arcs = arcs_[s];
+        for (size_t a = 0; a < arcs.size(); a++) {
+            rescored->AddArc(s, arcs[a]);
+        }
+        const CompactLatticeWeight &final_weight = clat.Final(lat_state);
+        if (final_weight != CompactLatticeWeight::Zero()) {
+            fst::StdArc::Weight lm_final = lm_->Final(tuples_[s].second);
+            if (lm_final != fst::StdArc::Weight::Zero()) {
+                LatticeWeight weight = final_weight.Weight();
+                weight.SetValue1(weight.Value1() + lm_final.Value());
+                rescored->SetFinal(s, CompactLatticeWeight(weight, final_weight.String()));
+            }
+        }
+    }
+    fst::Connect(rescored);
+    TopSortCompactLatticeIfNeeded(rescored);
+}
@@ -0,0 +1,86 @@
+#ifndef KALDIANDROID_LATTICE_RESCORER_H
+#define KALDIANDROID_LATTICE_RESCORER_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+// fst::ComposeDeterministicOnDemandFst that can drop its states, so one instance
+// serves all utterances of a recognizer. fst1 and fst2 are not owned.
+class ComposeLmDeterministicFst: public fst::DeterministicOnDemandFst<fst::StdArc> {
+public:
+    typedef fst::StdArc::StateId StateId;
+    typedef fst::StdArc::Weight Weight;
+    typedef fst::StdArc::Label Label;
+
+    ComposeLmDeterministicFst(fst::DeterministicOnDemandFst<fst::StdArc> *fst1,
+                              fst::DeterministicOnDemandFst<fst::StdArc> *fst2);
+
+    virtual StateId Start() { return 0; }
+    virtual Weight Final(StateId s);
+    virtual bool GetArc(StateId s, Label ilabel, fst::StdArc *oarc);
+
+    // Forget all states but the start state. State ids handed out before are invalid.
+    void Clear();
+
+private:
+    StateId FindOrAddState(StateId s1, StateId s2);
+
+    fst::DeterministicOnDemandFst<fst::StdArc> *fst1_;
+    fst::DeterministicOnDemandFst<fst::StdArc> *fst2_;
+    std::unordered_map<uint64, StateId> state_map_;
+    std::vector<std::pair<StateId, StateId> > state_vec_;
+};
+
+// Incremental version of ComposeCompactLatticeDeterministic for the lattice of
+// LatticeIncrementalDecoder. Between chunks the determinizer appends states and
+// rewrites the arcs of the few states at the previous chunk end, so each
+// Update() only expands lattice states whose arcs are new or changed against
+// the LM; by the endpoint most of the composition is already done. Only states
+// added since the last Update() and the states the next chunk can still rewrite
+// (those with a final weight, what is reachable from them, and their
+// predecessors) are hashed; of those, a changed state is found by a hash of
+// its arcs.
+class IncrementalLatticeRescorer {
+public:
+    // lm is typically old LM scaled by -1 composed with the new LM, not owned.
+    // Its state ids must stay valid until Reset().
+    explicit IncrementalLatticeRescorer(fst::DeterministicOnDemandFst<fst::StdArc> *lm);
+
+    // Start over for a new utterance
+    void Reset();
+
+    // Bring the composition up to date with the decoder's current lattice
+    void Update(const CompactLattice &clat);
+
+    // Composition of the lattice last passed to Update() with the LM, trimmed
+    // and topologically sorted, same as ComposeCompactLatticeDeterministic
+    void GetLattice(const CompactLattice &clat, CompactLattice *rescored);
+
+private:
+    typedef CompactLatticeArc::StateId StateId;
+
+    StateId FindOrAddState(StateId lat_state, StateId lm_state);
+    void Expand(const CompactLattice &clat, StateId state);
+    void CheckState(const CompactLattice &clat, StateId lat_state);
+    void FindUnstableStates(const CompactLattice &clat, StateId window_begin);
+    static uint64 ArcsSignature(const CompactLattice &clat, StateId lat_state);
+
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_;
+
+    // composed state -> (lattice state, lm state) and back
+    std::vector<std::pair<StateId, StateId> > tuples_;
+    std::unordered_map<uint64, StateId> tuple_to_state_;
+    std::vector<std::vector<CompactLatticeArc> > arcs_; // expanded arcs per composed state
+    std::vector<std::vector<StateId> > states_of_lat_state_;
+    std::vector<uint64> lat_state_signatures_; // arcs of the lattice state at the last expansion
+    std::vector<std::vector<StateId> > lat_state_preds_; // may hold stale entries, never misses one
+    std::vector<StateId> unstable_lat_states_; // may still be rewritten by the determinizer
+    std::vector<StateId> queue_;
+};
+
+#endif // KALDIANDROID_LATTICE_RESCORER_H
@@ -0,0 +1,177 @@
+#include "looped_computation_cache.h"
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const int32 kLoopedCacheVersion = 2;
+// the key hashes this much of the model file on top of its size and mtime
+static const size_t kKeyHeaderBytes = 64 * 1024;
+
+// FNV-1a, enough to tell model files apart, not meant to be cryptographic
+static uint64 HashBytes(const char *data, size_t len, uint64 hash) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64 LoopedComputationCacheKey(const string &model_filename,
+                                 const nnet3::NnetSimpleLoopedComputationOptions &opts) {
+    uint64 hash = 14695981039346656037ULL;
+    // Hashing the whole model would cost a good part of the load time the cache
+    // saves; a replaced model changes its size or mtime, and almost surely its
+    // header (transition model, nnet config).
+    std::ifstream is(model_filename.c_str(), std::ios::binary);
+    std::vector<char> header(kKeyHeaderBytes);
+    is.read(header.data(), header.size());
+    hash = HashBytes(header.data(), is.gcount(), hash);
+    struct stat st;
+    int64 size = 0, mtime = 0;
+    if (stat(model_filename.c_str(), &st) == 0) {
+        size = st.st_size;
+        mtime = st.st_mtime;
+    }
+    // acoustic_scale and debug_computation are applied at run time, not compiled in
+    std::ostringstream os;
+    WriteBasicType(os, true, kLoopedCacheVersion);
+    WriteBasicType(os, true, size);
+    WriteBasicType(os, true, mtime);
+    WriteBasicType(os, true, opts.extra_left_context_initial);
+    WriteBasicType(os, true, opts.frame_subsampling_factor);
+    WriteBasicType(os, true, opts.frames_per_chunk);
+    opts.optimize_config.Write(os, true);
+    string opts_str = os.str();
+    return HashBytes(opts_str.data(), opts_str.size(), hash);
+}
+
+nnet3::DecodableNnetSimpleLoopedInfo *ReadLoopedComputationCache(
+        const string &cache_filename, uint64 key,
+        const nnet3::NnetSimpleLoopedComputationOptions &opts,
+        nnet3::AmNnetSimple *am_nnet) {
+    int32 left_context, right_context, frames_per_chunk, output_dim;
+    bool has_ivectors;
+    nnet3::ComputationRequest request1, request2, request3;
+    nnet3::NnetComputation computation;
+    nnet3::Nnet nnet;
+    Vector<BaseFloat> priors;
+    struct stat buffer;
+    if (stat(cache_filename.c_str(), &buffer) != 0) {
+        return nullptr;
+    }
+    try {
+        bool binary;
+        Input ki(cache_filename, &binary);
+        std::istream &is = ki.Stream();
+        ExpectToken(is, binary, "<LoopedComputationCache>");
+        uint64 cached_key;
+        ReadBasicType(is, binary, &cached_key);
+        if (cached_key != key) {
+            KALDI_LOG << "Looped computation cache " << cache_filename << " is stale";
+            return nullptr;
+        }
+        ExpectToken(is, binary, "<Context>");
+        ReadBasicType(is, binary, &left_context);
+        ReadBasicType(is, binary, &right_context);
+        ReadBasicType(is, binary, &frames_per_chunk);
+        ReadBasicType(is, binary, &output_dim);
+        ReadBasicType(is, binary, &has_ivectors);
+        ExpectToken(is, binary, "<Requests>");
+        request1.Read(is, binary);
+        request2.Read(is, binary);
+        request3.Read(is, binary);
+        ExpectToken(is, binary, "<Computation>");
+        computation.Read(is, binary);
+        ExpectToken(is, binary, "<Nnet>");
+        nnet.Read(is, binary);
+        ExpectToken(is, binary, "<Priors>");
+        priors.Read(is, binary);
+        ExpectToken(is, binary, "</LoopedComputationCache>");
+    } catch (const std::exception &) {
+        KALDI_WARN << "Ignoring unreadable looped computation cache " << cache_filename;
+        return nullptr;
+    }
+
+    // DecodableNnetSimpleLoopedInfo always compiles in its constructor and keeps a
+    // reference to the nnet. Build it around a context-only stub so compilation is
+    // trivial, then move the cached nnet into the same Nnet object and fill in the
+    // cached computation.
+    nnet3::Nnet &am_net = am_nnet->GetNnet();
+    std::istringstream stub_config(
+            "input-node name=input dim=1\n"
+            "output-node name=output input=Append(Offset(input, -1), input, Offset(input, 1))\n");
+    am_net.ReadConfig(stub_config);
+    nnet3::DecodableNnetSimpleLoopedInfo *info;
+    try {
+        info = new nnet3::DecodableNnetSimpleLoopedInfo(opts, &am_net);
+    } catch (const std::exception &) {
+        nnet3::Nnet empty;
+        am_net.Swap(&empty);
+        KALDI_WARN << "Could not set up looped computation from cache " << cache_filename;
+        return nullptr;
+    }
+    am_net.Swap(&nnet);
+    am_nnet->SetPriors(priors);
+
+    info->log_priors = priors;
+    if (info->log_priors.Dim() != 0) {
+        info->log_priors.ApplyLog();
+    }
+    info->frames_left_context = left_context;
+    info->frames_right_context = right_context;
+    info->frames_per_chunk = frames_per_chunk;
+    info->output_dim = output_dim;
+    info->has_ivectors = has_ivectors;
+    info->request1 = request1;
+    info->request2 = request2;
+    info->request3 = request3;
+    info->computation = computation;
+    info->computation.ComputeCudaIndexes();
+    KALDI_LOG << "Loaded looped computation from " << cache_filename;
+    return info;
+}
+
+void WriteLoopedComputationCache(const string &cache_filename, uint64 key,
+                                 const nnet3::DecodableNnetSimpleLoopedInfo &info,
+                                 const VectorBase<BaseFloat> &priors) {
+    // write aside and rename, so a concurrent or interrupted load never sees half a file
+    string tmp_filename = cache_filename + ".tmp";
+    try {
+        bool binary = true;
+        {
+            Output ko(tmp_filename, binary);
+            std::ostream &os = ko.Stream();
+            WriteToken(os, binary, "<LoopedComputationCache>");
+            WriteBasicType(os, binary, key);
+            WriteToken(os, binary, "<Context>");
+            WriteBasicType(os, binary, info.frames_left_context);
+            WriteBasicType(os, binary, info.frames_right_context);
+            WriteBasicType(os, binary, info.frames_per_chunk);
+            WriteBasicType(os, binary, info.output_dim);
+            WriteBasicType(os, binary, info.has_ivectors);
+            WriteToken(os, binary, "<Requests>");
+            info.request1.Write(os, binary);
+            info.request2.Write(os, binary);
+            info.request3.Write(os, binary);
+            WriteToken(os, binary, "<Computation>");
+            info.computation.Write(os, binary);
+            WriteToken(os, binary, "<Nnet>");
+            info.nnet.Write(os, binary);
+            WriteToken(os, binary, "<Priors>");
+            priors.Write(os, binary);
+            WriteToken(os, binary, "</LoopedComputationCache>");
+            ko.Close();
+        }
+        if (rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+            KALDI_WARN << "Could not move looped computation cache to " << cache_filename;
+            remove(tmp_filename.c_str());
+            return;
+        }
+        KALDI_LOG << "Wrote looped computation cache " << cache_filename;
+    } catch (const std::exception &) {
+        KALDI_WARN << "Could not write looped computation cache " << cache_filename;
+        remove(tmp_filename.c_str());
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef KALDIANDROID_LOOPED_COMPUTATION_CACHE_H
+#define KALDIANDROID_LOOPED_COMPUTATION_CACHE_H
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+// On-disk cache of nnet3::DecodableNnetSimpleLoopedInfo. Building the looped
+// info collapses the nnet and compiles/optimizes the looped computation, which
+// takes seconds on big TDNN-F models; the cache stores the final nnet (collapsed,
+// test mode, ivector period set) and the priors together with the compiled
+// computation, so on a hit only the transition model is read from final.mdl.
+
+// Key of the cache entry: hash of the model file size, mtime and first 64 KiB,
+// and of every option that changes the compiled computation
+uint64 LoopedComputationCacheKey(const string &model_filename,
+                                 const nnet3::NnetSimpleLoopedComputationOptions &opts);
+
+// am_nnet must be empty. Returns nullptr if the cache file is missing, stale or
+// unreadable, in which case am_nnet stays empty. On success am_nnet holds the
+// cached nnet and priors, and the returned info refers to its nnet.
+nnet3::DecodableNnetSimpleLoopedInfo *ReadLoopedComputationCache(
+        const string &cache_filename, uint64 key,
+        const nnet3::NnetSimpleLoopedComputationOptions &opts,
+        nnet3::AmNnetSimple *am_nnet);
+
+// Failures only produce a warning, the cache is an optimization
+void WriteLoopedComputationCache(const string &cache_filename, uint64 key,
+                                 const nnet3::DecodableNnetSimpleLoopedInfo &info,
+                                 const VectorBase<BaseFloat> &priors);
+
+#endif // KALDIANDROID_LOOPED_COMPUTATION_CACHE_H
@@ -1,6 +1,14 @@
 #include "model.h"
+#include "json.h"
+#include "nnet_fusion.h"
+#include "recognizer.h"
+#include "wake_word.h"
 
 #include <sys/stat.h>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <thread>
 
 namespace fst {
 
@@ -9,6 +17,7 @@ namespace fst {
 
 }  // namespace fst
 
+#ifdef __ANDROID__
 #include <android/log.h>
 static void KaldiLogHandler(const LogMessageEnvelope &env, const char *message)
 {
@@ -42,11 +51,102 @@ static void KaldiLogHandler(const LogMessageEnvelope &env, const char *message)
 
     __android_log_print(priority, "kwang", "%s", full_message.str().c_str());
 }
+#endif
+
+// Value in kB of a field of /proc/self/status such as VmRSS or VmHWM, 0 if unavailable
+static int64 ReadProcStatusKb(const char *key) {
+    std::ifstream status("/proc/self/status");
+    string line;
+    size_t key_len = strlen(key);
+    while (std::getline(status, line)) {
+        if (line.compare(0, key_len, key) == 0 && line.size() > key_len && line[key_len] == ':') {
+            return atoll(line.c_str() + key_len + 1);
+        }
+    }
+    return 0;
+}
+
 
 
+// Read an FST asking OpenFst to memory map it. A ConstFst written aligned
+// (fstconvert --fst_type=const --fst_align=true HCLG.fst HCLG.fst) is mapped
+// read-only, so loading is close to free and every process on the host shares
+// one page-cache copy. Unaligned or vector FSTs fall back to a normal read.
+static fst::Fst<fst::StdArc> *ReadFstMapped(const string &filename) {
+    std::ifstream strm(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!strm) {
+        KALDI_ERR << "Could not open FST " << filename;
+    }
+    fst::FstReadOptions ropts(filename);
+    ropts.mode = fst::FstReadOptions::MAP;
+    fst::Fst<fst::StdArc> *fst = fst::Fst<fst::StdArc>::Read(strm, ropts);
+    if (!fst) {
+        KALDI_ERR << "Could not read FST from " << filename;
+    }
+    return fst;
+}
+
+// Times one loading step on the calling thread. With parallel loading the VmRSS
+// delta is process wide, so it includes whatever the other loaders allocated meanwhile.
+class Model::LoadStage {
+public:
+    LoadStage(Model *model, const char *name)
+            : model_(model), name_(name), rss_start_kb_(ReadProcStatusKb("VmRSS")) { }
+    ~LoadStage() {
+        ModelLoadStage stage;
+        stage.name = name_;
+        stage.seconds = timer_.Elapsed();
+        stage.rss_delta_kb = ReadProcStatusKb("VmRSS") - rss_start_kb_;
+        KALDI_VLOG(1) << "Model load stage " << stage.name << " took " << stage.seconds
+                      << "s, rss +" << stage.rss_delta_kb << "kB";
+        std::lock_guard<std::mutex> lock(model_->load_stages_mutex_);
+        model_->load_stages_.push_back(stage);
+    }
+private:
+    Model *model_;
+    const char *name_;
+    int64 rss_start_kb_;
+    Timer timer_;
+};
+
+// Runs the tasks on up to num_threads threads and waits for all of them. If any
+// task fails, the exception of the first failing task in list order is rethrown,
+// so the reported error does not depend on thread scheduling.
+static void RunLoadTasks(const vector<std::function<void()>> &tasks, int32 num_threads) {
+    vector<std::exception_ptr> errors(tasks.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < tasks.size()) {
+            try {
+                tasks[i]();
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    size_t num_workers = std::min<size_t>(std::max<int32>(num_threads, 1), tasks.size());
+    vector<std::thread> threads;
+    for (size_t i = 1; i < num_workers; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker(); // the calling thread takes a share too
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    for (size_t i = 0; i < errors.size(); i++) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+    }
+}
 
 Model::Model(const char* model_path): model_path_(model_path) {
+#ifdef __ANDROID__
     SetLogHandler(KaldiLogHandler);
+#endif
+    Timer load_timer;
+    int64 rss_start_kb = ReadProcStatusKb("VmRSS");
     // new configuration with parameters initialized in model.conf
     string am_path_v2 = model_path_ + "/am/final.mdl";
     string model_conf_path_v2 = model_path_ + "/conf/model.conf"; // create it yourself for default decoding beams and silence phones.
@@ -75,17 +175,41 @@ Model::Model(const char* model_path): model_path_(model_path) {
 
     struct stat buffer; // <sys/stat.h> check file existing stat
     if (stat(am_path_v2.c_str(), &buffer) == 0 && stat(model_conf_path_v2.c_str(), &buffer) == 0) {
-        ConfigureV2();
+        {
+            LoadStage stage(this, "config");
+            ConfigureV2();
+        }
         ReadDataFiles();
     } else if (stat(am_path_v1.c_str(), &buffer) == 0 && stat(mfcc_path_v1.c_str(), &buffer) == 0) {
-        ConfigureV1();
+        {
+            LoadStage stage(this, "config");
+            ConfigureV1();
+        }
         ReadDataFiles();
     } else {
         KALDI_ERR << "Folder '" << model_path_ << "' does not contain model files. " <<
                   "Make sure you specified the model path properly in Model constructor. " <<
                   "If you are not sure about relative path, use absolute path specification.";
     }
+    StoreLoadStats(load_timer.Elapsed(), rss_start_kb);
+}
 
+void Model::StoreLoadStats(double seconds, int64 rss_start_kb) {
+    json::JSON obj;
+    obj["seconds"] = seconds;
+    obj["rss_kb"] = ReadProcStatusKb("VmRSS");
+    obj["rss_delta_kb"] = obj["rss_kb"].ToInt() - rss_start_kb;
+    obj["peak_rss_kb"] = ReadProcStatusKb("VmHWM");
+    obj["stages"] = json::Array();
+    for (size_t i = 0; i < load_stages_.size(); i++) {
+        json::JSON stage;
+        stage["name"] = load_stages_[i].name;
+        stage["seconds"] = load_stages_[i].seconds;
+        stage["rss_delta_kb"] = load_stages_[i].rss_delta_kb;
+        obj["stages"].append(stage);
+    }
+    load_stats_ = obj.dump();
+    KALDI_LOG << "Model loaded in " << seconds << "s";
 }
 
 void Model::ConfigureV1() {
@@ -129,6 +253,24 @@ void Model::ConfigureV1() {
     //    rule4.RegisterWithPrefix("endpoint.rule4", opts); times out after 2.0 seconds of silence even if we did not reach a final-state
     //    rule5.RegisterWithPrefix("endpoint.rule5", opts); times out after the utterance is 20 seconds long regardless of anything else
     decodable_opts_.Register(&po); // nnet3::NnetSimpleLoopedComputationOptions, decodable object based on breaking up the input into fixed chunks
+    batch_opts_.Register(&po); // BatchComputeOptions, off by default
+    vad_opts_.Register(&po); // VoiceActivityOptions, off by default
+    governor_opts_.Register(&po); // RtfGovernorOptions, off by default
+    po.Register("load-threads", &load_threads_, "Threads used to read model files in parallel");
+    po.Register("use-computation-cache", &use_computation_cache_,
+                "Save the compiled looped nnet3 computation next to final.mdl and reuse it on later loads");
+    po.Register("recognizer-pool-size", &recognizer_pool_size_,
+                "Idle recognizers the model keeps for reuse by new streams");
+    po.Register("nnet-weights", &nnet_weights_,
+                "Weights the acoustic model runs with: float, or int8, fp16 or bf16 for the affine, linear "
+                "and TDNN layers. int8 uses the fastest kernel the CPU has (NEON, dot product or i8mm on "
+                "arm64, AVX2 or AVX-VNNI on x86_64); the model stays float when the CPU has none");
+    po.Register("rnnlm-weights", &rnnlm_weights_,
+                "Weights and word embeddings of the RNNLM: float, fp16 or bf16");
+    po.Register("fuse-nnet-layers", &fuse_nnet_layers_,
+                "Run affine/TDNN, ReLU and batchnorm of a layer as one command of the looped computation. "
+                "Off by default; nnet_quantize_drift --fuse-nnet-layers checks the output against the "
+                "unfused model");
     //    extra_left_context_initial(0),
     //    frame_subsampling_factor(1),
     //    frames_per_chunk(20),
@@ -160,6 +302,9 @@ void Model::ConfigureV1() {
     rnnlm_feat_embedding_final_mat_rxfilename_ = model_path_ + "/rnnlm/feat_embedding.final.mat";
     rnnlm_special_symbol_opts_conf_rxfilename_ = model_path_ + "/rnnlm/special_symbol_opts.conf";
     rnnlm_final_raw_rxfilename_ = model_path_ + "/rnnlm/final.raw";
+    tree_rxfilename_ = model_path_ + "/tree";
+    grammar_dir_ = model_path_ + "/grammar";
+    kws_dir_ = model_path_ + "/kws";
 }
 
 void Model::ConfigureV2() {
@@ -170,6 +315,24 @@ void Model::ConfigureV2() {
     nnet3_decoding_config_.Register(&po);
     endpoint_config_.Register(&po);
     decodable_opts_.Register(&po);
+    batch_opts_.Register(&po);
+    vad_opts_.Register(&po);
+    governor_opts_.Register(&po);
+    po.Register("load-threads", &load_threads_, "Threads used to read model files in parallel");
+    po.Register("use-computation-cache", &use_computation_cache_,
+                "Save the compiled looped nnet3 computation next to final.mdl and reuse it on later loads");
+    po.Register("recognizer-pool-size", &recognizer_pool_size_,
+                "Idle recognizers the model keeps for reuse by new streams");
+    po.Register("nnet-weights", &nnet_weights_,
+                "Weights the acoustic model runs with: float, or int8, fp16 or bf16 for the affine, linear "
+                "and TDNN layers. int8 uses the fastest kernel the CPU has (NEON, dot product or i8mm on "
+                "arm64, AVX2 or AVX-VNNI on x86_64); the model stays float when the CPU has none");
+    po.Register("rnnlm-weights", &rnnlm_weights_,
+                "Weights and word embeddings of the RNNLM: float, fp16 or bf16");
+    po.Register("fuse-nnet-layers", &fuse_nnet_layers_,
+                "Run affine/TDNN, ReLU and batchnorm of a layer as one command of the looped computation. "
+                "Off by default; nnet_quantize_drift --fuse-nnet-layers checks the output against the "
+                "unfused model");
 
     // read po args
     po.ReadConfigFile(model_path_ + "/conf/model.conf");
@@ -193,6 +356,9 @@ void Model::ConfigureV2() {
     rnnlm_feat_embedding_final_mat_rxfilename_ = model_path_ + "/rnnlm/feat_embedding.final.mat";
     rnnlm_special_symbol_opts_conf_rxfilename_ = model_path_ + "/rnnlm/special_symbol_opts.conf";
     rnnlm_final_raw_rxfilename_ = model_path_ + "/rnnlm/final.raw";
+    tree_rxfilename_ = model_path_ + "/am/tree";
+    grammar_dir_ = model_path_ + "/graph/grammar";
+    kws_dir_ = model_path_ + "/kws";
 }
 
 void Model::ReadDataFiles() {
@@ -203,37 +369,205 @@ void Model::ReadDataFiles() {
                  " max-active=" << nnet3_decoding_config_.max_active <<
                  " lattice-beam=" << nnet3_decoding_config_.lattice_beam;
     KALDI_LOG << "Silence phones " << endpoint_config_.silence_phones;
+    if (vad_opts_.enabled) {
+        KALDI_LOG << "Voice activity gate hangover=" << vad_opts_.hangover_seconds <<
+                     " lookback=" << vad_opts_.lookback_seconds;
+    }
+    if (governor_opts_.enabled) {
+        KALDI_LOG << "RTF governor rt-min=" << governor_opts_.rt_min << " rt-max=" << governor_opts_.rt_max <<
+                     " min-beam=" << governor_opts_.min_beam << " min-max-active=" << governor_opts_.min_max_active <<
+                     " min-lattice-beam=" << governor_opts_.min_lattice_beam;
+    }
 
-    // OnlineNnet2FeaturePipelineInfo, init feature info
-    if (stat(mfcc_conf_rxfilename_.c_str(), &buffer) == 0) {
-        feature_info_.feature_type = "mfcc";
-        ReadConfigFromFile(mfcc_conf_rxfilename_, &feature_info_.mfcc_opts); // MfccOptions
-        feature_info_.mfcc_opts.frame_opts.allow_downsample = true; // MfccOptions, FrameExtractionOptions
-    } else if (stat(fbank_conf_rxfilename_.c_str(), &buffer) == 0) {
-        feature_info_.feature_type = "fbank";
-        ReadConfigFromFile(fbank_conf_rxfilename_, &feature_info_.fbank_opts);
-        feature_info_.fbank_opts.frame_opts.allow_downsample = true; // It is safe to downsample
-    } else {
-        KALDI_ERR << "Failed to find feature config file";
-    }
-    // OnlineSilenceWeightingConfig, Config for weighting silence in iVector adaptation.
-    feature_info_.silence_weighting_config.silence_weight = 1e-3;
-    feature_info_.silence_weighting_config.silence_phones_str = endpoint_config_.silence_phones;
-
-    // Create transition model and nnet
-    trans_model_ = new kaldi::TransitionModel();
-    nnet_ = new kaldi::nnet3::AmNnetSimple();
-    { // 先初始化模型对象，再通过Input 类保存文件内容，最后模型读取以文件流的形式进行读取，所有模型类都配有Read 这一成员函数
-        bool binary;
-        kaldi::Input ki(final_mdl_rxfilename_, &binary); // Open(rxfilename, *binary)
-        trans_model_->Read(ki.Stream(), binary); // Read phone, state, pdf from std::istream&
-        nnet_->Read(ki.Stream(), binary); // Read contexts, priors
-        kaldi::nnet3::SetBatchnormTestMode(true, &(nnet_->GetNnet())); // Use batch norm
-        kaldi::nnet3::SetDropoutTestMode(true, &(nnet_->GetNnet())); // Use dropout mask containing (1-dropout_prob) in all elements.
-        kaldi::nnet3::CollapseModel(kaldi::nnet3::CollapseModelConfig(), &(nnet_->GetNnet())); // compile final.mdl
-    }
-    decodable_info_ = new kaldi::nnet3::DecodableNnetSimpleLoopedInfo(decodable_opts_, nnet_);
+    {
+        LoadStage stage(this, "features");
+        // OnlineNnet2FeaturePipelineInfo, init feature info
+        if (stat(mfcc_conf_rxfilename_.c_str(), &buffer) == 0) {
+            feature_info_.feature_type = "mfcc";
+            ReadConfigFromFile(mfcc_conf_rxfilename_, &feature_info_.mfcc_opts); // MfccOptions
+            feature_info_.mfcc_opts.frame_opts.allow_downsample = true; // MfccOptions, FrameExtractionOptions
+        } else if (stat(fbank_conf_rxfilename_.c_str(), &buffer) == 0) {
+            feature_info_.feature_type = "fbank";
+            ReadConfigFromFile(fbank_conf_rxfilename_, &feature_info_.fbank_opts);
+            feature_info_.fbank_opts.frame_opts.allow_downsample = true; // It is safe to downsample
+        } else {
+            KALDI_ERR << "Failed to find feature config file";
+        }
+        // OnlineSilenceWeightingConfig, Config for weighting silence in iVector adaptation.
+        feature_info_.silence_weighting_config.silence_weight = 1e-3;
+        feature_info_.silence_weighting_config.silence_phones_str = endpoint_config_.silence_phones;
+    }
+
+    {
+        LoadStage stage(this, "cmvn_pitch");
+        // cmvn feature info
+        if (stat(global_cmvn_stats_rxfilename_.c_str(), &buffer) == 0) {
+            KALDI_LOG << "Reading CMVN stats from " << global_cmvn_stats_rxfilename_;
+            feature_info_.use_cmvn = true;
+            kaldi::ReadKaldiObject(global_cmvn_stats_rxfilename_, &feature_info_.global_cmvn_stats);
+            //        bool binary_in;
+            //        Input ki(filename, &binary_in);
+            //        c->Read(ki.Stream(), binary_in);
+        }
+        // pitch
+        if (stat(pitch_conf_rxfilename_.c_str(), &buffer) == 0) {
+            KALDI_LOG << "Using pitch in feature pipeline";
+            feature_info_.add_pitch = true;
+            kaldi::ReadConfigsFromFile(pitch_conf_rxfilename_,
+                                       &feature_info_.pitch_opts,
+                                       &feature_info_.pitch_process_opts);
+            //        std::ostringstream usage_str;
+            //        usage_str << "Parsing config from "
+            //                  << "from '" << conf << "'";
+            //        ParseOptions po(usage_str.str().c_str());
+            //        c1->Register(&po);
+            //        c2->Register(&po);
+            //        po.ReadConfigFile(conf);
+
+        }
+    }
+
+    {
+        LoadStage stage(this, "word_boundary");
+        // word boundary info
+        if (stat(word_boundary_int_rxfilename_.c_str(), &buffer) == 0) {
+            KALDI_LOG << "Loading word boundary info " << word_boundary_int_rxfilename_;
+            kaldi::WordBoundaryInfoNewOpts opts;
+            word_boundary_info_ = new kaldi::WordBoundaryInfo(opts, word_boundary_int_rxfilename_);
+        }
+    }
+
+    // The big files do not depend on each other, read them in parallel.
+    // Each task only writes its own members.
+    vector<std::function<void()>> tasks;
+    tasks.push_back([this]() { ReadAcousticModel(); });
+    tasks.push_back([this]() { ReadGraph(); });
+    tasks.push_back([this]() { ReadIvectorExtractor(); });
+    if (stat((kws_dir_ + "/final.mdl").c_str(), &buffer) == 0) {
+        tasks.push_back([this]() {
+            LoadStage stage(this, "wake_word");
+            wake_word_model_ = new WakeWordModel(kws_dir_);
+        });
+    }
+    RunLoadTasks(tasks, load_threads_);
+    if (HasGrammar()) {
+        ReadGrammar(); // needs the transition model and the words
+    }
+    // rescore/ and rnnlm/ are loaded on demand, see EnsureRescoring()
+}
+
+void Model::ReadAcousticModel() {
+    bool use_cache = use_computation_cache_ && batch_opts_.max_batch_size < 2;
+    string cache_rxfilename = final_mdl_rxfilename_ + ".looped_cache";
+    uint64 cache_key = 0;
+    {
+        LoadStage stage(this, "acoustic_model");
+        // Create transition model and nnet
+        trans_model_ = new kaldi::TransitionModel();
+        nnet_ = new kaldi::nnet3::AmNnetSimple();
+        if (use_cache) {
+            // the cached nnet is already collapsed and in test mode, and comes with the priors
+            cache_key = LoopedComputationCacheKey(final_mdl_rxfilename_, decodable_opts_);
+            decodable_info_ = ReadLoopedComputationCache(cache_rxfilename, cache_key, decodable_opts_, nnet_);
+        }
+        { // 先初始化模型对象，再通过Input 类保存文件内容，最后模型读取以文件流的形式进行读取，所有模型类都配有Read 这一成员函数
+            bool binary;
+            kaldi::Input ki(final_mdl_rxfilename_, &binary); // Open(rxfilename, *binary)
+            trans_model_->Read(ki.Stream(), binary); // Read phone, state, pdf from std::istream&
+            if (!decodable_info_) {
+                nnet_->Read(ki.Stream(), binary); // Read contexts, priors
+            }
+        }
+        if (!decodable_info_) {
+            kaldi::nnet3::SetBatchnormTestMode(true, &(nnet_->GetNnet())); // Use batch norm
+            kaldi::nnet3::SetDropoutTestMode(true, &(nnet_->GetNnet())); // Use dropout mask containing (1-dropout_prob) in all elements.
+            kaldi::nnet3::CollapseModel(kaldi::nnet3::CollapseModelConfig(), &(nnet_->GetNnet())); // compile final.mdl
+        }
+    }
+
+    {
+        LoadStage stage(this, "nnet_computation");
+        if (batch_opts_.max_batch_size >= 2) {
+            // chunks of all recognizers go through one shared computation, no looped computation needed
+            batch_computer_ = new BatchNnetComputer(batch_opts_, *nnet_,
+                                                    decodable_opts_.frame_subsampling_factor,
+                                                    decodable_opts_.acoustic_scale);
+        } else if (!decodable_info_) {
+            decodable_info_ = new kaldi::nnet3::DecodableNnetSimpleLoopedInfo(decodable_opts_, nnet_);
+            if (use_cache) {
+                WriteLoopedComputationCache(cache_rxfilename, cache_key, *decodable_info_, nnet_->Priors());
+            }
+        }
+    }
+
+    if (nnet_weights_ != "float") {
+        // after the cache was written, it holds the float nnet
+        LoadStage stage(this, "nnet_weights");
+        ConvertNnetWeights(nnet_weights_);
+    }
+
+    if (fuse_nnet_layers_) {
+        // also after the cache write, the fused components cannot be written
+        LoadStage stage(this, "nnet_fusion");
+        FuseNnetLayers();
+    }
+}
+
+int32 Model::FuseNnetLayers() {
+    if (decodable_info_ == nullptr || nnet_layers_fused_) {
+        return 0;
+    }
+    int32 num_fused = ::FuseNnetLayers(&nnet_->GetNnet(), &decodable_info_->computation);
+    KALDI_LOG << "Fused " << num_fused << " layers of the looped computation";
+    nnet_layers_fused_ = true;
+    return num_fused;
+}
+
+void Model::ComputeNnetOutput(const WaveData &wave, Matrix<BaseFloat> *output) const {
+    if (decodable_info_ == nullptr) {
+        output->Resize(0, 0);
+        return;
+    }
+    OnlineNnet2FeaturePipeline pipeline(feature_info_);
+    SubVector<BaseFloat> samples(wave.Data(), 0); // first channel
+    pipeline.AcceptWaveform(wave.SampFreq(), samples);
+    pipeline.InputFinished();
+
+    nnet3::DecodableNnetLoopedOnline decodable(*decodable_info_, pipeline.InputFeature(),
+                                               pipeline.IvectorFeature());
+    int32 num_frames = decodable.NumFramesReady(), dim = decodable.NumIndices();
+    output->Resize(num_frames, dim, kUndefined);
+    for (int32 t = 0; t < num_frames; t++) {
+        for (int32 i = 0; i < dim; i++) {
+            (*output)(t, i) = decodable.LogLikelihood(t, i + 1);
+        }
+    }
+}
+
+bool Model::ConvertNnetWeights(const string &type) {
+    if (type == "float") {
+        return nnet_weights_ == "float";
+    }
+    WeightStorage storage;
+    if (!ParseWeightStorage(type, &storage)) {
+        KALDI_ERR << "Unknown --nnet-weights=" << type << ", expected float, int8, fp16 or bf16";
+    }
+    if (!WeightStorageSupported(storage)) {
+        KALDI_WARN << "No " << type << " kernel for this CPU, built with " << WeightKernelName(storage) <<
+                      ", the acoustic model stays in float";
+        nnet_weights_ = "float";
+        return false;
+    }
+    int32 num_quantized = QuantizeNnet(storage, &nnet_->GetNnet());
+    KALDI_LOG << "Converted " << num_quantized << " acoustic model components to " << type << ", kernel " <<
+                 WeightKernelName(storage);
+    nnet_weights_ = type;
+    return true;
+}
 
+void Model::ReadIvectorExtractor() {
+    LoadStage stage(this, "ivector");
+    struct stat buffer;
     // ivector feature info
     if (stat(ivector_final_ie_rxfilename_.c_str(), &buffer) == 0) {
         KALDI_LOG << "Loading i-vector extractor from " << ivector_final_ie_rxfilename_;
@@ -252,69 +586,124 @@ void Model::ReadDataFiles() {
     } else {
         feature_info_.use_ivectors = false;
     }
-    // cmvn feature info
-    if (stat(global_cmvn_stats_rxfilename_.c_str(), &buffer) == 0) {
-        KALDI_LOG << "Reading CMVN stats from " << global_cmvn_stats_rxfilename_;
-        feature_info_.use_cmvn = true;
-        kaldi::ReadKaldiObject(global_cmvn_stats_rxfilename_, &feature_info_.global_cmvn_stats);
-        //        bool binary_in;
-        //        Input ki(filename, &binary_in);
-        //        c->Read(ki.Stream(), binary_in);
-    }
-    // pitch
-    if (stat(pitch_conf_rxfilename_.c_str(), &buffer) == 0) {
-        KALDI_LOG << "Using pitch in feature pipeline";
-        feature_info_.add_pitch = true;
-        kaldi::ReadConfigsFromFile(pitch_conf_rxfilename_,
-                                   &feature_info_.pitch_opts,
-                                   &feature_info_.pitch_process_opts);
-        //        std::ostringstream usage_str;
-        //        usage_str << "Parsing config from "
-        //                  << "from '" << conf << "'";
-        //        ParseOptions po(usage_str.str().c_str());
-        //        c1->Register(&po);
-        //        c2->Register(&po);
-        //        po.ReadConfigFile(conf);
-
-    }
-
-    // HCLG
-    if (stat(HCLG_fst_rxfilename_.c_str(), &buffer) == 0) {
-        KALDI_LOG << "Loading HCLG from " << HCLG_fst_rxfilename_;
-        HCLG_fst_ = fst::ReadFstKaldiGeneric(HCLG_fst_rxfilename_); // Create const FST or vector FST
-        assert(HCLG_fst_);
-    } else {
-        KALDI_LOG << "Loading HCL and G from " << HCLr_fst_rxfilename_ << " " << Gr_fst_rxfilename_;
-        HCLr_fst_ = fst::StdFst::Read(HCLr_fst_rxfilename_);
-        Gr_fst_ = fst::StdFst::Read(Gr_fst_rxfilename_);
-        kaldi::ReadIntegerVectorSimple(disambig_tid_int_rxfilename_, &disambig_);
-        assert(HCLr_fst_);
-        assert(Gr_fst_);
-    }
-
-    // word symbols
-    if (HCLG_fst_ && HCLG_fst_->OutputSymbols()) {
-        word_syms_ = HCLG_fst_->OutputSymbols();
-    } else if (Gr_fst_ && Gr_fst_->OutputSymbols()) {
-        word_syms_ = Gr_fst_->OutputSymbols();
-    }
-    if (! word_syms_) {
-        KALDI_LOG << "Loading words from " << words_txt_rxfilename_;
-        if (! (word_syms_ = fst::SymbolTable::ReadText(words_txt_rxfilename_))) {
-            KALDI_ERR << "Could not read symbol table from file "
-                      << words_txt_rxfilename_;
+}
+
+void Model::ReadGraph() {
+    struct stat buffer;
+    {
+        LoadStage stage(this, "graph");
+        // HCLG
+        if (stat((grammar_dir_ + "/HCLG.fst").c_str(), &buffer) == 0) {
+            ReadGrammarTop();
+        } else if (stat(HCLG_fst_rxfilename_.c_str(), &buffer) == 0) {
+            KALDI_LOG << "Loading HCLG from " << HCLG_fst_rxfilename_;
+            HCLG_fst_ = ReadFstMapped(HCLG_fst_rxfilename_); // Mapped const FST, or read const/vector FST
+            assert(HCLG_fst_);
+        } else {
+            KALDI_LOG << "Loading HCL and G from " << HCLr_fst_rxfilename_ << " " << Gr_fst_rxfilename_;
+            HCLr_fst_ = ReadFstMapped(HCLr_fst_rxfilename_);
+            Gr_fst_ = ReadFstMapped(Gr_fst_rxfilename_);
+            kaldi::ReadIntegerVectorSimple(disambig_tid_int_rxfilename_, &disambig_);
+            assert(HCLr_fst_);
+            assert(Gr_fst_);
+        }
+    }
+
+    {
+        LoadStage stage(this, "words");
+        // word symbols, from the graph when it carries them
+        if (HCLG_fst_ && HCLG_fst_->OutputSymbols()) {
+            word_syms_ = HCLG_fst_->OutputSymbols();
+        } else if (grammar_top_fst_ && grammar_top_fst_->OutputSymbols()) {
+            word_syms_ = grammar_top_fst_->OutputSymbols();
+        } else if (Gr_fst_ && Gr_fst_->OutputSymbols()) {
+            word_syms_ = Gr_fst_->OutputSymbols();
+        }
+        if (! word_syms_) {
+            KALDI_LOG << "Loading words from " << words_txt_rxfilename_;
+            if (! (word_syms_ = fst::SymbolTable::ReadText(words_txt_rxfilename_))) {
+                KALDI_ERR << "Could not read symbol table from file "
+                          << words_txt_rxfilename_;
+            }
+            word_syms_loaded_ = word_syms_; // boolean = ptr
+        }
+        KALDI_ASSERT(word_syms_);
+    }
+}
+
+// Top-level graph of a GrammarFst. Nonterminals are found by name in the
+// phones.txt the graph was built with.
+void Model::ReadGrammarTop() {
+    string phones_txt = grammar_dir_ + "/phones.txt";
+    std::unique_ptr<fst::SymbolTable> phone_syms(fst::SymbolTable::ReadText(phones_txt));
+    if (!phone_syms) {
+        KALDI_ERR << "Could not read symbol table from file " << phones_txt;
+    }
+    nonterm_phones_offset_ = phone_syms->Find("#nonterm_bos");
+    if (nonterm_phones_offset_ == fst::kNoSymbol) {
+        KALDI_ERR << "No #nonterm_bos in " << phones_txt << ", not a grammar lang directory";
+    }
+    const string prefix = "#nonterm:";
+    for (fst::SymbolTableIterator it(*phone_syms); !it.Done(); it.Next()) {
+        if (it.Symbol().compare(0, prefix.size(), prefix) == 0) {
+            nonterminals_[it.Symbol().substr(prefix.size())] = it.Value();
         }
-        word_syms_loaded_ = word_syms_; // boolean = ptr
     }
-    KALDI_ASSERT(word_syms_);
 
-    // word boundary info
-    if (stat(word_boundary_int_rxfilename_.c_str(), &buffer) == 0) {
-        KALDI_LOG << "Loading word boundary info " << word_boundary_int_rxfilename_;
-        kaldi::WordBoundaryInfoNewOpts opts;
-        word_boundary_info_ = new kaldi::WordBoundaryInfo(opts, word_boundary_int_rxfilename_);
+    string top_fst = grammar_dir_ + "/HCLG.fst";
+    KALDI_LOG << "Loading grammar top-level graph from " << top_fst << " with "
+              << nonterminals_.size() << " nonterminals";
+    fst::VectorFst<fst::StdArc> *fst = fst::CastOrConvertToVectorFst(fst::ReadFstKaldiGeneric(top_fst));
+    fst::PrepareForGrammarFst(nonterm_phones_offset_, fst);
+    grammar_top_fst_.reset(new fst::ConstFst<fst::StdArc>(*fst));
+    delete fst;
+}
+
+// Everything needed to compile sub-graphs at runtime, and the default
+// sub-graph of every nonterminal from <name>.txt, one phrase per line, or
+// empty when there is none
+void Model::ReadGrammar() {
+    LoadStage stage(this, "grammar");
+    ContextDependency *ctx_dep = new ContextDependency();
+    ReadKaldiObject(tree_rxfilename_, ctx_dep);
+    fst::VectorFst<fst::StdArc> *lexicon = fst::ReadFstKaldi(grammar_dir_ + "/L_disambig.fst");
+    vector<int32> disambig_phones;
+    if (!kaldi::ReadIntegerVectorSimple(grammar_dir_ + "/disambig.int", &disambig_phones)) {
+        KALDI_ERR << "Could not read disambiguation symbols from " << grammar_dir_ << "/disambig.int";
     }
+    subgraph_compiler_ = new SubGraphCompiler(*trans_model_, ctx_dep, lexicon, disambig_phones,
+                                              nonterm_phones_offset_, *word_syms_);
+
+    for (std::map<string, int32>::const_iterator it = nonterminals_.begin(); it != nonterminals_.end(); ++it) {
+        vector<string> phrases;
+        std::ifstream is((grammar_dir_ + "/" + it->first + ".txt").c_str());
+        string line;
+        while (std::getline(is, line)) {
+            phrases.push_back(line);
+        }
+        if (phrases.empty()) {
+            KALDI_WARN << "No default phrases for nonterminal " << it->first
+                       << ", it is skipped until a recognizer sets it";
+        }
+        default_subgraphs_.push_back(std::make_pair(it->second, CompileSubGraph(phrases)));
+    }
+}
+
+int32 Model::NonterminalId(const string &name) const {
+    std::map<string, int32>::const_iterator it = nonterminals_.find(name);
+    return it == nonterminals_.end() ? -1 : it->second;
+}
+
+SubGraphPtr Model::CompileSubGraph(const vector<string> &phrases) const {
+    KALDI_ASSERT(subgraph_compiler_);
+    vector<vector<int32> > ids;
+    subgraph_compiler_->LookupPhrases(phrases, &ids);
+    return subgraph_compiler_->Compile(ids);
+}
 
+void Model::ReadRescoreLm() {
+    LoadStage stage(this, "rescore_lm");
+    struct stat buffer;
     // rescore G fst, const arpa model
     if (stat(rescore_G_carpa_rxfilename_.c_str(), &buffer) == 0) {
         KALDI_LOG << "Loading subtract G.fst model from " << rescore_G_fst_rxfilename_;
@@ -322,7 +711,11 @@ void Model::ReadDataFiles() {
         KALDI_LOG << "Loading const ARPA model from " << rescore_G_carpa_rxfilename_;
         kaldi::ReadKaldiObject(rescore_G_carpa_rxfilename_, &const_arpa_);
     }
+}
 
+void Model::ReadRnnlm() {
+    LoadStage stage(this, "rnnlm");
+    struct stat buffer;
     // RNN rescoring ???
     if (stat(rnnlm_final_raw_rxfilename_.c_str(), &buffer) == 0) {
         KALDI_LOG << "Loading RNNLM model from " << rnnlm_final_raw_rxfilename_;
@@ -339,15 +732,68 @@ void Model::ReadDataFiles() {
         }
         Matrix<BaseFloat> wm(word_feature_mat.NumRows(), feature_embedding_mat.NumCols());
         wm.AddSmatMat(1.0, word_feature_mat, kNoTrans, feature_embedding_mat, 0.0);
-        word_embedding_mat_.Resize(wm.NumRows(), wm.NumCols(), kUndefined);
-        word_embedding_mat_.CopyFromMat(wm);
+        WeightStorage storage;
+        if (rnnlm_weights_ == "float") {
+            word_embedding_mat_.Resize(wm.NumRows(), wm.NumCols(), kUndefined);
+            word_embedding_mat_.CopyFromMat(wm);
+        } else if (!ParseWeightStorage(rnnlm_weights_, &storage) || storage == kInt8Weights) {
+            KALDI_ERR << "Unknown --rnnlm-weights=" << rnnlm_weights_ << ", expected float, fp16 or bf16";
+        } else if (!WeightStorageSupported(storage)) {
+            KALDI_WARN << "No " << rnnlm_weights_ << " kernel for this CPU, the RNNLM stays in float";
+            word_embedding_mat_.Resize(wm.NumRows(), wm.NumCols(), kUndefined);
+            word_embedding_mat_.CopyFromMat(wm);
+        } else {
+            // see HalfRnnlmDeterministicFst
+            word_embedding_half_.Convert(wm.Data(), wm.NumRows(), wm.NumCols(), wm.Stride(),
+                                         storage == kBf16Weights);
+            int32 num_quantized = QuantizeNnet(storage, &rnnlm_);
+            KALDI_LOG << "RNNLM word embeddings and " << num_quantized << " components in " << rnnlm_weights_ <<
+                         ", embedding relative error " << word_embedding_half_.RelativeError(wm.Data(), wm.Stride());
+        }
 
         kaldi::ReadConfigFromFile(rnnlm_special_symbol_opts_conf_rxfilename_, &rnnlm_compute_opts_);
         rnnlm_enabled_ = true;
     }
 }
 
+void Model::LoadRescoring() {
+    vector<std::function<void()>> tasks;
+    tasks.push_back([this]() { ReadRescoreLm(); });
+    tasks.push_back([this]() { ReadRnnlm(); });
+    try {
+        RunLoadTasks(tasks, load_threads_);
+    } catch (const std::exception &e) {
+        // Partial results never need these, so keep decoding without rescoring
+        KALDI_WARN << "Failed to load rescoring models, rescoring disabled: " << e.what();
+        delete graph_lm_fst_;
+        graph_lm_fst_ = nullptr;
+        rnnlm_enabled_ = false;
+    }
+    rescore_loaded_ = true;
+}
+
+// Loads the rescoring LMs once, the first caller waits for them, returns true if
+// const ARPA rescoring is available
+bool Model::EnsureRescoring() {
+    std::call_once(rescore_once_, &Model::LoadRescoring, this);
+    return graph_lm_fst_ != nullptr;
+}
+
+void Model::PreloadRescoring() {
+    std::lock_guard<std::mutex> lock(preload_mutex_);
+    if (!preload_thread_.joinable()) {
+        preload_thread_ = std::thread([this]() { EnsureRescoring(); });
+    }
+}
+
 Model::~Model() {
+    if (preload_thread_.joinable()) {
+        preload_thread_.join();
+    }
+    for (size_t i = 0; i < idle_recognizers_.size(); i++) {
+        delete idle_recognizers_[i];
+    }
+    delete batch_computer_;
     delete trans_model_;
     delete nnet_;
     delete decodable_info_;
@@ -356,6 +802,8 @@ Model::~Model() {
     delete Gr_fst_;
     delete graph_lm_fst_;
     delete word_boundary_info_;
+    delete subgraph_compiler_;
+    delete wake_word_model_;
     if (word_syms_loaded_) {
         delete word_syms_;
     }
@@ -368,6 +816,58 @@ int Model::FindWord(const char *word) {
     return word_syms_->Find(word);
 }
 
+bool Model::WordSymbol(int32 word_id, string *word) const {
+    if (!word_syms_)
+        return false;
+    *word = word_syms_->Find(word_id);
+    return !word->empty();
+}
+
+Recognizer *Model::AcquireRecognizer() {
+    Recognizer *recognizer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(recognizer_pool_mutex_);
+        if (!idle_recognizers_.empty()) {
+            recognizer = idle_recognizers_.back();
+            idle_recognizers_.pop_back();
+        }
+    }
+    if (recognizer == nullptr) {
+        return new Recognizer(this);
+    }
+    Ref(); // dropped when it went idle
+    recognizer->pooled_ = false;
+    return recognizer;
+}
+
+void Model::ReleaseRecognizer(Recognizer *recognizer) {
+    recognizer->ResetStream();
+    {
+        std::lock_guard<std::mutex> lock(recognizer_pool_mutex_);
+        if (idle_recognizers_.size() < static_cast<size_t>(recognizer_pool_size_)) {
+            recognizer->pooled_ = true;
+            idle_recognizers_.push_back(recognizer);
+            recognizer = nullptr;
+        }
+    }
+    if (recognizer) {
+        delete recognizer;
+    } else {
+        Unref(); // an idle recognizer must not keep the model alive, may delete this
+    }
+}
+
+void Model::PrewarmRecognizers(int32 count) {
+    std::lock_guard<std::mutex> lock(recognizer_pool_mutex_);
+    recognizer_pool_size_ = std::max(recognizer_pool_size_, count);
+    while (idle_recognizers_.size() < static_cast<size_t>(count)) {
+        Recognizer *recognizer = new Recognizer(this);
+        recognizer->pooled_ = true;
+        idle_recognizers_.push_back(recognizer);
+        Unref(); // the caller still holds its own reference
+    }
+}
+
 void Model::Ref() {
     std::atomic_fetch_add_explicit(&ref_cnt_, 1, std::memory_order_relaxed);
     // 多线程内存序
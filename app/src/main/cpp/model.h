@@ -4,17 +4,67 @@
 #define KALDIANDROID_MODEL_H
 
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include "kaldi.h"
 
+#include "batch_nnet_computer.h"
+#include "looped_computation_cache.h"
+#include "quantized_nnet.h"
+#include "rtf_governor.h"
+#include "subgraph_compiler.h"
+#include "voice_activity.h"
+
 using namespace std;
 using namespace kaldi;
 
+// Wall time and resident memory growth of one step of ReadDataFiles
+struct ModelLoadStage {
+    string name;
+    double seconds;
+    int64 rss_delta_kb;
+};
+
+class Recognizer;
+class WakeWordModel;
+
 class Model {
 
 public:
     Model(const char* model_path);
     int FindWord(const char* word);
+    bool WordSymbol(int32 word_id, string *word) const;
+    const char* LoadStats() const { return load_stats_.c_str(); } // JSON report of the load
+    void PreloadRescoring(); // start loading the rescoring LMs in the background
+    // Recognizers given back with ReleaseRecognizer() are reset in place and
+    // handed out again, so a new stream starts on warm decoder storage
+    Recognizer *AcquireRecognizer();
+    void ReleaseRecognizer(Recognizer *recognizer);
+    void PrewarmRecognizers(int32 count); // fill the pool ahead of the first streams
+    // Runtime sub-grammars, for models with a graph/grammar directory: the
+    // top-level graph has nonterminals (#nonterm:name in phones.txt) and each
+    // recognizer splices in its own sub-graphs, see Recognizer::SetSubGrammar()
+    bool HasGrammar() const { return grammar_top_fst_ != nullptr; }
+    int32 NonterminalId(const string &name) const; // phone id of #nonterm:name, -1 if unknown
+    SubGraphPtr CompileSubGraph(const vector<string> &phrases) const; // thread safe
+    bool HasWakeWord() const { return wake_word_model_ != nullptr; } // kws/, see WakeWordRecognizer
+    // Swaps the acoustic model weights to "int8", "fp16" or "bf16" in place,
+    // as --nnet-weights does at load. Only before the first recognizer or
+    // transcriber is made. False if this CPU has no kernel for it and the
+    // model stays in float.
+    bool ConvertNnetWeights(const string &type);
+    const string &NnetWeights() const { return nnet_weights_; } // what the acoustic model runs with
+    // Fuses the layers of the looped computation in place, as
+    // --fuse-nnet-layers does at load after ConvertNnetWeights(). Same
+    // restriction. Returns the number of layers fused, 0 in batched mode,
+    // which compiles its own computations.
+    int32 FuseNnetLayers();
+    bool NnetLayersFused() const { return nnet_layers_fused_; }
+    // Acoustic model output the recognizers score for wave, one row per
+    // output frame, from the looped computation. 0 rows in batched mode.
+    void ComputeNnetOutput(const WaveData &wave, Matrix<BaseFloat> *output) const;
     void Ref();
     void Unref();
 private:
@@ -22,8 +72,23 @@ private:
     void ConfigureV1();
     void ConfigureV2();
     void ReadDataFiles();
+    void ReadAcousticModel();
+    void ReadIvectorExtractor();
+    void ReadGraph();
+    void ReadGrammarTop();
+    void ReadGrammar();
+    void ReadRescoreLm();
+    void ReadRnnlm();
+    void LoadRescoring();
+    bool EnsureRescoring();
+    bool RescoringReady() const { return rescore_loaded_; } // loaded, EnsureRescoring() will not block
+    void StoreLoadStats(double seconds, int64 rss_start_kb);
+
+    class LoadStage; // scoped timer, appends to load_stages_
 
     friend class Recognizer;
+    friend class BatchTranscriber;
+    friend class WakeWordRecognizer;
 
     string model_path_;
     string final_mdl_rxfilename_;
@@ -44,15 +109,29 @@ private:
     string rnnlm_feat_embedding_final_mat_rxfilename_;
     string rnnlm_special_symbol_opts_conf_rxfilename_;
     string rnnlm_final_raw_rxfilename_;
+    string tree_rxfilename_;
+    string grammar_dir_; // HCLG.fst, phones.txt, L_disambig.fst, disambig.int, <nonterminal>.txt
+    string kws_dir_;
 
     kaldi::LatticeIncrementalDecoderConfig nnet3_decoding_config_; // compared to LatticeFasterDecoder, spread out the time of lattice determinization
     kaldi::OnlineEndpointConfig endpoint_config_; //  terminate decoding if ANY of these rules evaluates to "true".
     kaldi::nnet3::NnetSimpleLoopedComputationOptions decodable_opts_; // decodable object based on breaking up the input into fixed chunks
     kaldi::OnlineNnet2FeaturePipelineInfo feature_info_; // feature_type("mfcc"), add_pitch(false)
+    BatchComputeOptions batch_opts_; // max-batch-size >= 2 switches all recognizers to batched scoring
+    int32 load_threads_ = 4; // threads reading independent model files, 1 loads them one after another
+    bool use_computation_cache_ = true; // reuse the compiled looped computation saved next to final.mdl
+    int32 recognizer_pool_size_ = 4; // idle recognizers kept by ReleaseRecognizer()
+    VoiceActivityOptions vad_opts_; // off by default, each recognizer runs its own gate
+    RtfGovernorOptions governor_opts_; // off by default, each recognizer adapts its own search
+    string nnet_weights_ = "float"; // --nnet-weights, set back to float when the CPU cannot run it
+    bool fuse_nnet_layers_ = false; // FuseNnetLayers() on the looped computation
+    bool nnet_layers_fused_ = false;
+    string rnnlm_weights_ = "float"; // --rnnlm-weights, fp16 or bf16 keep the word embeddings in word_embedding_half_
 
     kaldi::TransitionModel* trans_model_ = nullptr;
     kaldi::nnet3::AmNnetSimple* nnet_ = nullptr;
-    kaldi::nnet3::DecodableNnetSimpleLoopedInfo* decodable_info_ = nullptr;
+    kaldi::nnet3::DecodableNnetSimpleLoopedInfo* decodable_info_ = nullptr; // looped mode only
+    BatchNnetComputer* batch_computer_ = nullptr; // batched mode only, shared by all recognizers
 
     fst::Fst<fst::StdArc>* HCLG_fst_ = nullptr;
     fst::Fst<fst::StdArc>* HCLr_fst_ = nullptr;
@@ -62,15 +141,36 @@ private:
     bool word_syms_loaded_ = false;
     kaldi::WordBoundaryInfo *word_boundary_info_ = nullptr;
 
+    SubGraphPtr grammar_top_fst_; // replaces HCLG.fst when present
+    int32 nonterm_phones_offset_ = -1; // phone id of #nonterm_bos
+    std::map<string, int32> nonterminals_;
+    vector<pair<int32, SubGraphPtr> > default_subgraphs_; // one per nonterminal
+    SubGraphCompiler *subgraph_compiler_ = nullptr;
+
+    WakeWordModel *wake_word_model_ = nullptr; // separate small acoustic model and keyword graph
+
     fst::VectorFst<fst::StdArc>* graph_lm_fst_ = nullptr;
     kaldi::ConstArpaLm const_arpa_;
 
     kaldi::nnet3::Nnet rnnlm_;
-    CuMatrix<BaseFloat> word_embedding_mat_;
+    CuMatrix<BaseFloat> word_embedding_mat_; // empty if word_embedding_half_ is used
+    HalfMatrix word_embedding_half_;
     kaldi::rnnlm::RnnlmComputeStateComputationOptions rnnlm_compute_opts_;
     bool rnnlm_enabled_ = false;
+    // rescoring LMs are only read when the first Result() needs them or on PreloadRescoring()
+    std::once_flag rescore_once_;
+    std::atomic<bool> rescore_loaded_{false};
+    std::thread preload_thread_;
+    std::mutex preload_mutex_;
+
+    vector<ModelLoadStage> load_stages_;
+    std::mutex load_stages_mutex_; // stages of parallel loads finish on different threads
+    string load_stats_;
+
+    vector<Recognizer *> idle_recognizers_;
+    std::mutex recognizer_pool_mutex_;
 
-    std::atomic<int> ref_cnt_;
+    std::atomic<int> ref_cnt_{1}; // the creator's reference
 };
 
 #endif // KALDIANDROID_MODEL_H
\ No newline at end of file
@@ -0,0 +1,352 @@
+#include "nnet_fusion.h"
+
+#include <algorithm>
+#include <map>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using nnet3::NnetComputation;
+
+FusedLayerComponent::FusedLayerComponent(const nnet3::Nnet &nnet, int32 first,
+                                         const nnet3::BatchNormComponent *batchnorm)
+        : nnet_(&nnet), first_(first) {
+    if (batchnorm) {
+        // the batchnorm statistics are per block of block-dim columns
+        int32 dim = First()->OutputDim(), block_dim = batchnorm->Scale().Dim();
+        KALDI_ASSERT(block_dim > 0 && dim % block_dim == 0);
+        Vector<BaseFloat> scale(block_dim), offset(block_dim);
+        batchnorm->Scale().CopyToVec(&scale);
+        batchnorm->Offset().CopyToVec(&offset);
+        scale_.Resize(dim, kUndefined);
+        offset_.Resize(dim, kUndefined);
+        for (int32 j = 0; j < dim; j++) {
+            scale_(j) = scale(j % block_dim);
+            offset_(j) = offset(j % block_dim);
+        }
+    }
+}
+
+std::string FusedLayerComponent::Info() const {
+    std::ostringstream os;
+    os << Component::Info() << ", first=" << nnet_->GetComponentName(first_) << " (" << First()->Type() <<
+          "), relu, batchnorm=" << (scale_.Dim() != 0 ? "true" : "false");
+    return os.str();
+}
+
+// out = max(in, 0) * scale + offset, rounded the way RectifiedLinearComponent
+// and BatchNormComponent round it: multiply, then add
+static void ReluScaleOffset(const float *in, const float *scale, const float *offset, int32 n, float *out) {
+    int32 i = 0;
+#if defined(__aarch64__)
+    float32x4_t zero = vdupq_n_f32(0);
+    if (scale) {
+        for (; i + 4 <= n; i += 4) {
+            float32x4_t v = vmulq_f32(vmaxq_f32(vld1q_f32(in + i), zero), vld1q_f32(scale + i));
+            vst1q_f32(out + i, vaddq_f32(v, vld1q_f32(offset + i)));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(out + i, vmaxq_f32(vld1q_f32(in + i), zero));
+        }
+    }
+#elif defined(__SSE2__)
+    __m128 zero = _mm_setzero_ps();
+    if (scale) {
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(in + i), zero), _mm_loadu_ps(scale + i));
+            _mm_storeu_ps(out + i, _mm_add_ps(v, _mm_loadu_ps(offset + i)));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(out + i, _mm_max_ps(_mm_loadu_ps(in + i), zero));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        float v = std::max(in[i], 0.0f);
+        out[i] = scale ? v * scale[i] + offset[i] : v;
+    }
+}
+
+void *FusedLayerComponent::Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                                     const CuMatrixBase<BaseFloat> &in,
+                                     CuMatrixBase<BaseFloat> *out) const {
+    const nnet3::Component *first = First();
+    // one scratch matrix for all fused layers, it stays in cache from one to the next
+    static thread_local CuMatrix<BaseFloat> scratch;
+    int32 rows = out->NumRows(), cols = out->NumCols();
+    if (scratch.NumRows() < rows || scratch.NumCols() < cols) {
+        scratch.Resize(std::max(rows, scratch.NumRows()), std::max(cols, scratch.NumCols()), kUndefined);
+    }
+    CuSubMatrix<BaseFloat> product(scratch, 0, rows, 0, cols);
+    if (first->Properties() & nnet3::kPropagateAdds) {
+        product.SetZero();
+    }
+    void *memo = first->Propagate(indexes, in, &product);
+    KALDI_ASSERT(memo == nullptr);
+    const float *scale = scale_.Dim() != 0 ? scale_.Data() : nullptr;
+    const float *offset = scale_.Dim() != 0 ? offset_.Data() : nullptr;
+    for (int32 r = 0; r < rows; r++) {
+        ReluScaleOffset(product.RowData(r), scale, offset, cols, out->RowData(r));
+    }
+    return nullptr;
+}
+
+void FusedLayerComponent::Backprop(const std::string &debug_info,
+                                   const nnet3::ComponentPrecomputedIndexes *indexes,
+                                   const CuMatrixBase<BaseFloat> &in_value,
+                                   const CuMatrixBase<BaseFloat> &out_value,
+                                   const CuMatrixBase<BaseFloat> &out_deriv, void *memo,
+                                   Component *to_update, CuMatrixBase<BaseFloat> *in_deriv) const {
+    KALDI_ERR << Type() << " is for inference only";
+}
+
+void FusedLayerComponent::InitFromConfig(ConfigLine *cfl) {
+    KALDI_ERR << Type() << " is made from a compiled computation by FuseNnetLayers()";
+}
+
+void FusedLayerComponent::Read(std::istream &is, bool binary) {
+    KALDI_ERR << Type() << " is made from a compiled computation by FuseNnetLayers()";
+}
+
+void FusedLayerComponent::Write(std::ostream &os, bool binary) const {
+    KALDI_ERR << Type() << " is made at load time and never written, write the model before fusing";
+}
+
+static int32 MatrixOf(const NnetComputation &computation, int32 submatrix) {
+    return computation.submatrices[submatrix].matrix_index;
+}
+
+static bool SameSubMatrix(const NnetComputation &computation, int32 a, int32 b) {
+    const NnetComputation::SubMatrixInfo &x = computation.submatrices[a], &y = computation.submatrices[b];
+    return x.matrix_index == y.matrix_index && x.row_offset == y.row_offset && x.num_rows == y.num_rows &&
+           x.col_offset == y.col_offset && x.num_cols == y.num_cols;
+}
+
+static bool Covers(const NnetComputation &computation, int32 outer, int32 inner) {
+    const NnetComputation::SubMatrixInfo &x = computation.submatrices[outer], &y = computation.submatrices[inner];
+    return x.matrix_index == y.matrix_index && x.row_offset <= y.row_offset &&
+           x.row_offset + x.num_rows >= y.row_offset + y.num_rows && x.col_offset <= y.col_offset &&
+           x.col_offset + x.num_cols >= y.col_offset + y.num_cols;
+}
+
+// Loop labels and chunk markers: NnetComputer::Run() may stop or jump there,
+// so no command is moved across one
+static bool IsBoundary(const NnetComputation::Command &command) {
+    return command.command_type == nnet3::kNoOperationLabel || command.command_type == nnet3::kGotoLabel ||
+           command.command_type == nnet3::kNoOperationMarker;
+}
+
+static bool NoBoundary(const NnetComputation &computation, int32 from, int32 to) {
+    for (int32 c = from + 1; c <= to; c++) {
+        if (IsBoundary(computation.commands[c])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Propagate without memo or stats, as in test mode
+static bool IsPlainPropagate(const NnetComputation::Command &command) {
+    return command.command_type == nnet3::kPropagate && command.arg5 <= 0 && command.arg6 <= 0;
+}
+
+static bool TouchesMatrix(const NnetComputation &computation, const nnet3::CommandAttributes &attributes,
+                          int32 c, int32 matrix) {
+    const NnetComputation::Command &command = computation.commands[c];
+    switch (command.command_type) {
+        case nnet3::kAllocMatrix:
+        case nnet3::kDeallocMatrix:
+            return MatrixOf(computation, command.arg1) == matrix;
+        case nnet3::kSwapMatrix:
+            return MatrixOf(computation, command.arg1) == matrix || MatrixOf(computation, command.arg2) == matrix;
+        default:
+            return std::binary_search(attributes.matrices_read.begin(), attributes.matrices_read.end(), matrix) ||
+                   std::binary_search(attributes.matrices_written.begin(), attributes.matrices_written.end(), matrix);
+    }
+}
+
+// The next command after p that touches the output matrix of p, if it is a
+// propagate reading exactly that output. -1 otherwise.
+static int32 NextPropagate(const NnetComputation &computation, const std::vector<nnet3::CommandAttributes> &attributes,
+                           int32 p) {
+    int32 output = computation.commands[p].arg4, matrix = MatrixOf(computation, output);
+    for (int32 c = p + 1; c < static_cast<int32>(computation.commands.size()); c++) {
+        const NnetComputation::Command &command = computation.commands[c];
+        if (IsBoundary(command)) {
+            return -1;
+        }
+        if (TouchesMatrix(computation, attributes[c], c, matrix)) {
+            return IsPlainPropagate(command) && SameSubMatrix(computation, command.arg3, output) ? c : -1;
+        }
+    }
+    return -1;
+}
+
+static bool CanFuseFirst(const nnet3::Component *component) {
+    string type = component->Type();
+    return type == "AffineComponent" || type == "NaturalGradientAffineComponent" || type == "LinearComponent" ||
+           type == "TdnnComponent" || type == "QuantizedAffineComponent" || type == "QuantizedTdnnComponent";
+}
+
+typedef std::map<std::pair<int32, const nnet3::BatchNormComponent *>, int32> FusedComponentMap;
+
+// Replaces the chain of propagates by one on its first command. Leaves the
+// computation alone and returns false when that would change a result.
+static bool FuseChain(const std::vector<nnet3::CommandAttributes> &attributes, const std::vector<int32> &chain,
+                      const nnet3::BatchNormComponent *batchnorm, nnet3::Nnet *nnet, NnetComputation *computation,
+                      FusedComponentMap *fused) {
+    const NnetComputation &cc = *computation;
+    int32 begin = chain.front(), end = chain.back();
+    int32 first_input = cc.commands[begin].arg3, output = cc.commands[end].arg4;
+    int32 output_matrix = MatrixOf(cc, output);
+
+    // results between the commands, their matrices go away
+    std::vector<int32> intermediate;
+    for (size_t k = 0; k + 1 < chain.size(); k++) {
+        int32 result = cc.commands[chain[k]].arg4;
+        if (MatrixOf(cc, result) != output_matrix) {
+            intermediate.push_back(MatrixOf(cc, result));
+        } else if (!SameSubMatrix(cc, result, output)) {
+            return false; // in place but for a different region, it would keep a stale value
+        }
+    }
+    std::sort(intermediate.begin(), intermediate.end());
+    intermediate.erase(std::unique(intermediate.begin(), intermediate.end()), intermediate.end());
+    if (MatrixOf(cc, first_input) == output_matrix ||
+        std::binary_search(intermediate.begin(), intermediate.end(), MatrixOf(cc, first_input))) {
+        return false;
+    }
+
+    std::vector<int32> no_ops(chain.begin() + 1, chain.end());
+    int32 output_alloc = -1, num_output_allocs = 0, first_alloc = -1;
+    for (int32 c = 0; c < static_cast<int32>(cc.commands.size()); c++) {
+        if (std::find(chain.begin(), chain.end(), c) != chain.end()) {
+            continue;
+        }
+        const NnetComputation::Command &command = cc.commands[c];
+        for (size_t i = 0; i < intermediate.size(); i++) {
+            if (!TouchesMatrix(cc, attributes[c], c, intermediate[i])) {
+                continue;
+            }
+            if (command.command_type != nnet3::kAllocMatrix && command.command_type != nnet3::kDeallocMatrix &&
+                command.command_type != nnet3::kSetConst) {
+                return false; // someone else reads an intermediate result
+            }
+            no_ops.push_back(c);
+            if (command.command_type == nnet3::kAllocMatrix && intermediate[i] == MatrixOf(cc, cc.commands[begin].arg4)) {
+                first_alloc = c;
+            }
+        }
+        if (TouchesMatrix(cc, attributes[c], c, output_matrix)) {
+            if (command.command_type == nnet3::kAllocMatrix) {
+                output_alloc = c;
+                num_output_allocs++;
+            } else if (c > begin && c < end) {
+                return false; // the output would be written before this command instead of after
+            }
+        }
+    }
+
+    // the fused command runs where the first one did, the output has to exist by then
+    int32 move_alloc = -1;
+    if (num_output_allocs > 1) {
+        return false;
+    }
+    if (output_alloc > begin) {
+        if (output_alloc > end || first_alloc < 0 || first_alloc > begin ||
+            !NoBoundary(cc, first_alloc, end)) {
+            return false;
+        }
+        move_alloc = output_alloc;
+    }
+
+    // the first component may add to its output, which then has to be zero
+    // before it; the fused one overwrites
+    if (nnet->GetComponent(cc.commands[begin].arg1)->Properties() & nnet3::kPropagateAdds) {
+        int32 first_output = cc.commands[begin].arg4;
+        bool zeroed = false;
+        for (int32 c = begin - 1; c >= 0 && !IsBoundary(cc.commands[c]); c--) {
+            const std::vector<int32> &written = attributes[c].matrices_written;
+            if (std::binary_search(written.begin(), written.end(), MatrixOf(cc, first_output))) {
+                const NnetComputation::Command &command = cc.commands[c];
+                zeroed = command.command_type == nnet3::kSetConst && command.alpha == 0 &&
+                         Covers(cc, command.arg1, first_output);
+                break;
+            }
+        }
+        if (!zeroed) {
+            return false;
+        }
+    }
+
+    // one component per distinct chain, the looped computation runs each layer in several places
+    NnetComputation::Command &first = computation->commands[begin];
+    std::pair<int32, const nnet3::BatchNormComponent *> key(first.arg1, batchnorm);
+    FusedComponentMap::const_iterator it = fused->find(key);
+    int32 component;
+    if (it != fused->end()) {
+        component = it->second;
+    } else {
+        component = nnet->AddComponent(nnet->GetComponentName(first.arg1) + ".fused",
+                                       new FusedLayerComponent(*nnet, first.arg1, batchnorm));
+        (*fused)[key] = component;
+        KALDI_VLOG(1) << nnet->GetComponentName(component) << ": " << nnet->GetComponent(component)->Info();
+    }
+    first.arg1 = component;
+    first.arg4 = output;
+    if (move_alloc >= 0) {
+        computation->commands[first_alloc] = computation->commands[move_alloc];
+        no_ops.erase(std::remove(no_ops.begin(), no_ops.end(), first_alloc), no_ops.end());
+        no_ops.push_back(move_alloc);
+    }
+    for (size_t i = 0; i < no_ops.size(); i++) {
+        computation->commands[no_ops[i]].command_type = nnet3::kNoOperation;
+    }
+    return true;
+}
+
+int32 FuseNnetLayers(nnet3::Nnet *nnet, NnetComputation *computation) {
+    FusedComponentMap fused;
+    std::vector<nnet3::CommandAttributes> attributes;
+    bool analyzed = false;
+    int32 num_fused = 0;
+    for (int32 c = 0; c < static_cast<int32>(computation->commands.size()); c++) {
+        const NnetComputation::Command &command = computation->commands[c];
+        if (!IsPlainPropagate(command) || !CanFuseFirst(nnet->GetComponent(command.arg1))) {
+            continue;
+        }
+        if (!analyzed) {
+            nnet3::ComputationVariables variables;
+            variables.Init(*computation);
+            nnet3::ComputeCommandAttributes(*nnet, *computation, variables, &attributes);
+            analyzed = true;
+        }
+        std::vector<int32> chain(1, c);
+        int32 relu = NextPropagate(*computation, attributes, c);
+        if (relu < 0 || nnet->GetComponent(computation->commands[relu].arg1)->Type() != "RectifiedLinearComponent") {
+            continue;
+        }
+        chain.push_back(relu);
+        const nnet3::BatchNormComponent *batchnorm = nullptr;
+        int32 next = NextPropagate(*computation, attributes, relu);
+        if (next >= 0) {
+            batchnorm = dynamic_cast<const nnet3::BatchNormComponent *>(
+                    nnet->GetComponent(computation->commands[next].arg1));
+            if (batchnorm && batchnorm->Scale().Dim() != 0) { // test mode
+                chain.push_back(next);
+            } else {
+                batchnorm = nullptr;
+            }
+        }
+        if (FuseChain(attributes, chain, batchnorm, nnet, computation, &fused)) {
+            num_fused++;
+            analyzed = false; // the attributes of the rewritten commands changed
+        }
+    }
+    return num_fused;
+}
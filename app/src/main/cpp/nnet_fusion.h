@@ -0,0 +1,77 @@
+#ifndef KALDIANDROID_NNET_FUSION_H
+#define KALDIANDROID_NNET_FUSION_H
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+// One TDNN-F style layer of a compiled computation as a single propagate:
+// affine, linear or TDNN (float or quantized), then ReLU, then an optional
+// test-mode batchnorm. The product goes to a per-thread scratch matrix that
+// every fused layer reuses, the ReLU and the batchnorm scale and offset are
+// applied in the same pass that writes the output, with the same float
+// operations in the same order as the three separate commands. The outputs are
+// bit-identical only if the multiply and add are not contracted to an FMA,
+// which is why CMakeLists.txt builds nnet_fusion.cpp with -ffp-contract=off.
+class FusedLayerComponent : public nnet3::Component {
+public:
+    // first is a component of nnet and looked up on every call, so
+    // QuantizeNnet() may still replace it. batchnorm may be null.
+    FusedLayerComponent(const nnet3::Nnet &nnet, int32 first, const nnet3::BatchNormComponent *batchnorm);
+    FusedLayerComponent(const FusedLayerComponent &other)
+            : nnet_(other.nnet_), first_(other.first_), scale_(other.scale_), offset_(other.offset_) {}
+
+    std::string Type() const override { return "FusedLayerComponent"; }
+    std::string Info() const override;
+    void InitFromConfig(ConfigLine *cfl) override;
+    int32 InputDim() const override { return First()->InputDim(); }
+    int32 OutputDim() const override { return First()->OutputDim(); }
+    int32 Properties() const override {
+        // writes all of the output, whatever the first component does
+        return First()->Properties() & (nnet3::kSimpleComponent | nnet3::kReordersIndexes);
+    }
+    void *Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                    const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const override;
+    void Backprop(const std::string &debug_info, const nnet3::ComponentPrecomputedIndexes *indexes,
+                  const CuMatrixBase<BaseFloat> &in_value, const CuMatrixBase<BaseFloat> &out_value,
+                  const CuMatrixBase<BaseFloat> &out_deriv, void *memo, Component *to_update,
+                  CuMatrixBase<BaseFloat> *in_deriv) const override;
+    void ReorderIndexes(std::vector<nnet3::Index> *input_indexes,
+                        std::vector<nnet3::Index> *output_indexes) const override {
+        First()->ReorderIndexes(input_indexes, output_indexes);
+    }
+    void GetInputIndexes(const nnet3::MiscComputationInfo &misc_info, const nnet3::Index &output_index,
+                         std::vector<nnet3::Index> *desired_indexes) const override {
+        First()->GetInputIndexes(misc_info, output_index, desired_indexes);
+    }
+    bool IsComputable(const nnet3::MiscComputationInfo &misc_info, const nnet3::Index &output_index,
+                      const nnet3::IndexSet &input_index_set, std::vector<nnet3::Index> *used_inputs) const override {
+        return First()->IsComputable(misc_info, output_index, input_index_set, used_inputs);
+    }
+    nnet3::ComponentPrecomputedIndexes *PrecomputeIndexes(const nnet3::MiscComputationInfo &misc_info,
+                                                          const std::vector<nnet3::Index> &input_indexes,
+                                                          const std::vector<nnet3::Index> &output_indexes,
+                                                          bool need_backprop) const override {
+        return First()->PrecomputeIndexes(misc_info, input_indexes, output_indexes, need_backprop);
+    }
+    void Read(std::istream &is, bool binary) override;
+    void Write(std::ostream &os, bool binary) const override;
+    Component *Copy() const override { return new FusedLayerComponent(*this); }
+
+private:
+    const nnet3::Component *First() const { return nnet_->GetComponent(first_); }
+
+    const nnet3::Nnet *nnet_;
+    int32 first_;
+    Vector<BaseFloat> scale_;  // batchnorm, expanded to the output dim, empty without
+    Vector<BaseFloat> offset_;
+};
+
+// Rewrites chains of kPropagate commands of a compiled computation, such as
+// the looped one of DecodableNnetSimpleLoopedInfo, into one command of a
+// FusedLayerComponent added to nnet. A chain is only fused when nothing else
+// reads the intermediate results; their matrices are no longer allocated.
+// Returns the number of chains fused.
+int32 FuseNnetLayers(nnet3::Nnet *nnet, nnet3::NnetComputation *computation);
+
+#endif // KALDIANDROID_NNET_FUSION_H
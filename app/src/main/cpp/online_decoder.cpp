@@ -0,0 +1,214 @@
+#include "online_decoder.h"
+
+OnlineIncrementalDecoder::OnlineIncrementalDecoder(const LatticeIncrementalDecoderConfig &decoder_opts,
+                                                   const TransitionModel &trans_model,
+                                                   const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                                                   BatchNnetComputer *batch_computer,
+                                                   const fst::Fst<fst::StdArc> &fst,
+                                                   OnlineNnet2FeaturePipeline *features)
+        : trans_model_(trans_model),
+          info_(info),
+          input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
+          decoder_opts_(decoder_opts) {
+    InitDecodable(info, batch_computer, features);
+    decoder_ = new IncrementalDecoder(fst, trans_model, decoder_opts_, &arena_);
+    decoder_->InitDecoding();
+}
+
+OnlineIncrementalDecoder::OnlineIncrementalDecoder(const LatticeIncrementalDecoderConfig &decoder_opts,
+                                                   const TransitionModel &trans_model,
+                                                   const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                                                   BatchNnetComputer *batch_computer,
+                                                   const fst::ConstGrammarFst &grammar_fst,
+                                                   OnlineNnet2FeaturePipeline *features)
+        : trans_model_(trans_model),
+          info_(info),
+          input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
+          decoder_opts_(decoder_opts) {
+    InitDecodable(info, batch_computer, features);
+    grammar_decoder_ = new GrammarIncrementalDecoder(grammar_fst, trans_model, decoder_opts_, &arena_);
+    grammar_decoder_->InitDecoding();
+}
+
+void OnlineIncrementalDecoder::InitDecodable(const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                                             BatchNnetComputer *batch_computer,
+                                             OnlineNnet2FeaturePipeline *features) {
+    if (batch_computer) {
+        batch_decodable_ = new DecodableAmNnetBatchOnline(batch_computer, trans_model_,
+                                                          features->InputFeature(),
+                                                          features->IvectorFeature());
+        decodable_ = batch_decodable_;
+        frames_per_chunk_ = batch_computer->FramesPerChunk() / batch_computer->FrameSubsamplingFactor();
+    } else {
+        KALDI_ASSERT(info);
+        looped_decodable_ = new nnet3::DecodableAmNnetLoopedOnline(trans_model_, *info,
+                                                                   features->InputFeature(),
+                                                                   features->IvectorFeature());
+        decodable_ = looped_decodable_;
+        frames_per_chunk_ = info->frames_per_chunk / info->opts.frame_subsampling_factor;
+    }
+    frames_per_chunk_ = std::max(frames_per_chunk_, 1);
+}
+
+void OnlineIncrementalDecoder::InitDecoding(int32 frame_offset) {
+    if (decoder_) {
+        decoder_->InitDecoding();
+    } else {
+        grammar_decoder_->InitDecoding();
+    }
+    frame_offset_ = frame_offset;
+    if (batch_decodable_) {
+        batch_decodable_->SetFrameOffset(frame_offset);
+    } else {
+        looped_decodable_->SetFrameOffset(frame_offset);
+    }
+}
+
+void OnlineIncrementalDecoder::Reset(OnlineNnet2FeaturePipeline *features) {
+    if (batch_decodable_) {
+        batch_decodable_->Reset(features->InputFeature(), features->IvectorFeature());
+    } else {
+        // binds its features at construction, it is small next to the decoder
+        delete looped_decodable_;
+        looped_decodable_ = new nnet3::DecodableAmNnetLoopedOnline(trans_model_, *info_,
+                                                                   features->InputFeature(),
+                                                                   features->IvectorFeature());
+        decodable_ = looped_decodable_;
+    }
+    if (decoder_) {
+        decoder_->InitDecoding();
+    } else {
+        grammar_decoder_->InitDecoding();
+    }
+    frame_offset_ = 0;
+}
+
+void OnlineIncrementalDecoder::SetGrammar(const fst::ConstGrammarFst &grammar_fst) {
+    KALDI_ASSERT(grammar_decoder_);
+    // the decoder keeps a pointer to its graph and has no way to swap it
+    delete grammar_decoder_;
+    grammar_decoder_ = new GrammarIncrementalDecoder(grammar_fst, trans_model_, decoder_opts_, &arena_);
+    grammar_decoder_->InitDecoding();
+}
+
+void OnlineIncrementalDecoder::SetSearchLimits(BaseFloat beam, int32 max_active, BaseFloat lattice_beam) {
+    decoder_opts_.beam = beam;
+    decoder_opts_.max_active = max_active;
+    decoder_opts_.lattice_beam = lattice_beam;
+    // the decoder has its own copy, its determinizer reads decoder_opts_
+    if (decoder_) {
+        decoder_->SetOptions(decoder_opts_);
+    } else {
+        grammar_decoder_->SetOptions(decoder_opts_);
+    }
+}
+
+void OnlineIncrementalDecoder::AdvanceDecoding(RecognizerStats *stats) {
+    if (decoder_) {
+        AdvanceDecoding(decoder_, stats);
+    } else {
+        AdvanceDecoding(grammar_decoder_, stats);
+    }
+}
+
+template <typename Decoder>
+void OnlineIncrementalDecoder::AdvanceDecoding(Decoder *decoder, RecognizerStats *stats) {
+    if (stats == nullptr) {
+        decoder->AdvanceDecoding(decodable_);
+        return;
+    }
+    // One nnet3 chunk at a time: asking for the first frame of the chunk runs
+    // the network, so what AdvanceDecoding() spends after that is search
+    int32 frames_before = decoder->NumFramesDecoded();
+    while (decodable_->NumFramesReady() > decoder->NumFramesDecoded()) {
+        int32 frame = decoder->NumFramesDecoded();
+        {
+            StageTimer timer(stats, STAGE_NNET);
+            decodable_->LogLikelihood(frame, 1);
+        }
+        StageTimer timer(stats, STAGE_SEARCH);
+        decoder->AdvanceDecoding(decodable_, frames_per_chunk_ - (frame + frame_offset_) % frames_per_chunk_);
+    }
+    if (decoder->NumFramesDecoded() > frames_before) {
+        stats->frames += decoder->NumFramesDecoded() - frames_before;
+        stats->AddTokens(decoder->NumActiveTokens());
+    }
+    AccumulateSlabPoolStats(arena_.tokens.Stats(), &reported_tokens_, &stats->token_arena);
+    AccumulateSlabPoolStats(arena_.links.Stats(), &reported_links_, &stats->link_arena);
+}
+
+void OnlineIncrementalDecoder::FinalizeDecoding() {
+    if (decoder_) {
+        decoder_->FinalizeDecoding();
+    } else {
+        grammar_decoder_->FinalizeDecoding();
+    }
+}
+
+int32 OnlineIncrementalDecoder::NumFramesDecoded() const {
+    return decoder_ ? decoder_->NumFramesDecoded() : grammar_decoder_->NumFramesDecoded();
+}
+
+int32 OnlineIncrementalDecoder::NumFramesInLattice() const {
+    return decoder_ ? decoder_->NumFramesInLattice() : grammar_decoder_->NumFramesInLattice();
+}
+
+const CompactLattice &OnlineIncrementalDecoder::GetLattice(int32 num_frames_to_include,
+                                                           bool use_final_probs) {
+    if (decoder_) {
+        return decoder_->GetLattice(num_frames_to_include, use_final_probs);
+    }
+    return grammar_decoder_->GetLattice(num_frames_to_include, use_final_probs);
+}
+
+void OnlineIncrementalDecoder::GetBestPath(bool end_of_utterance, Lattice *best_path) const {
+    if (decoder_) {
+        decoder_->GetBestPath(best_path, end_of_utterance);
+    } else {
+        grammar_decoder_->GetBestPath(best_path, end_of_utterance);
+    }
+}
+
+int32 OnlineIncrementalDecoder::FrameSubsamplingFactor() const {
+    return batch_decodable_ ? batch_decodable_->FrameSubsamplingFactor()
+                            : looped_decodable_->FrameSubsamplingFactor();
+}
+
+// kaldi::EndpointDetected() on the decoder itself, except for the final
+// cost: the one of the base would look for final states in its empty
+// HashList. The trailing silence is traced back on the base type, the one
+// the library has TrailingSilenceLength() for.
+template <typename DEC>
+static bool DecoderEndpointDetected(const OnlineEndpointConfig &config, const TransitionModel &trans_model,
+                                    BaseFloat frame_shift_in_seconds, const DEC &decoder) {
+    if (decoder.NumFramesDecoded() == 0) {
+        return false;
+    }
+    const typename DEC::Base &base = decoder;
+    int32 trailing_silence_frames = kaldi::TrailingSilenceLength(trans_model, config.silence_phones, base);
+    return kaldi::EndpointDetected(config, decoder.NumFramesDecoded(), trailing_silence_frames,
+                                   frame_shift_in_seconds, decoder.FinalRelativeCost());
+}
+
+bool OnlineIncrementalDecoder::EndpointDetected(const OnlineEndpointConfig &config) {
+    BaseFloat output_frame_shift = input_feature_frame_shift_in_seconds_ * FrameSubsamplingFactor();
+    if (decoder_) {
+        return DecoderEndpointDetected(config, trans_model_, output_frame_shift, *decoder_);
+    }
+    return DecoderEndpointDetected(config, trans_model_, output_frame_shift, *grammar_decoder_);
+}
+
+void OnlineIncrementalDecoder::ComputeCurrentTraceback(OnlineSilenceWeighting *silence_weighting) const {
+    if (decoder_) {
+        silence_weighting->ComputeCurrentTraceback(*decoder_);
+    } else {
+        silence_weighting->ComputeCurrentTraceback(*grammar_decoder_);
+    }
+}
+
+OnlineIncrementalDecoder::~OnlineIncrementalDecoder() {
+    delete decoder_;
+    delete grammar_decoder_;
+    delete looped_decodable_;
+    delete batch_decodable_;
+}
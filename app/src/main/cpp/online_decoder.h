@@ -0,0 +1,90 @@
+#ifndef KALDIANDROID_ONLINE_DECODER_H
+#define KALDIANDROID_ONLINE_DECODER_H
+
+#include "kaldi.h"
+
+#include "batch_nnet_computer.h"
+#include "incremental_decoder.h"
+#include "recognizer_stats.h"
+
+using namespace kaldi;
+
+// Same interface as kaldi::SingleUtteranceNnet3IncrementalDecoder, but the
+// acoustic scores come either from the per-stream looped nnet3 computation or,
+// in batched mode, from the computer shared by all recognizers of the model.
+// The graph is either a plain FST or a GrammarFst with sub-graphs spliced in
+// at decode time.
+class OnlineIncrementalDecoder {
+public:
+    // Exactly one of info and batch_computer is expected to be non-null.
+    // The feature pipeline and the graph are owned externally.
+    OnlineIncrementalDecoder(const LatticeIncrementalDecoderConfig &decoder_opts,
+                             const TransitionModel &trans_model,
+                             const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                             BatchNnetComputer *batch_computer,
+                             const fst::Fst<fst::StdArc> &fst,
+                             OnlineNnet2FeaturePipeline *features);
+    OnlineIncrementalDecoder(const LatticeIncrementalDecoderConfig &decoder_opts,
+                             const TransitionModel &trans_model,
+                             const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                             BatchNnetComputer *batch_computer,
+                             const fst::ConstGrammarFst &grammar_fst,
+                             OnlineNnet2FeaturePipeline *features);
+
+    // Restart decoding at an endpoint but keep the decodable and its features
+    void InitDecoding(int32 frame_offset = 0);
+    // Restart on the features of a new stream. The search keeps its token and
+    // hash storage, only the decodable is bound to the new features.
+    void Reset(OnlineNnet2FeaturePipeline *features);
+    // Switch to another GrammarFst before InitDecoding() or Reset(). Only the
+    // search is recreated, the decodable and its features are kept.
+    void SetGrammar(const fst::ConstGrammarFst &grammar_fst);
+    // stats, if given, get the nnet3 and search time, the active tokens and
+    // what the search took from its TokenArena
+    void AdvanceDecoding(RecognizerStats *stats = nullptr);
+    // Changes beam, max_active and lattice_beam from the next frame on, also
+    // for the rest of the current utterance. Kept across InitDecoding(),
+    // Reset() and SetGrammar().
+    void SetSearchLimits(BaseFloat beam, int32 max_active, BaseFloat lattice_beam);
+    void FinalizeDecoding();
+
+    int32 NumFramesDecoded() const;
+    int32 NumFramesInLattice() const;
+
+    const CompactLattice &GetLattice(int32 num_frames_to_include,
+                                     bool use_final_probs = false);
+    void GetBestPath(bool end_of_utterance, Lattice *best_path) const;
+    bool EndpointDetected(const OnlineEndpointConfig &config);
+    void ComputeCurrentTraceback(OnlineSilenceWeighting *silence_weighting) const;
+
+    ~OnlineIncrementalDecoder();
+private:
+    void InitDecodable(const nnet3::DecodableNnetSimpleLoopedInfo *info,
+                       BatchNnetComputer *batch_computer, OnlineNnet2FeaturePipeline *features);
+    template <typename Decoder>
+    void AdvanceDecoding(Decoder *decoder, RecognizerStats *stats);
+    int32 FrameSubsamplingFactor() const;
+
+    const TransitionModel &trans_model_;
+    const nnet3::DecodableNnetSimpleLoopedInfo *info_;
+    int32 frames_per_chunk_; // output frames of one nnet3 chunk
+    int32 frame_offset_ = 0;
+    BaseFloat input_feature_frame_shift_in_seconds_;
+
+    nnet3::DecodableAmNnetLoopedOnline *looped_decodable_ = nullptr;
+    DecodableAmNnetBatchOnline *batch_decodable_ = nullptr;
+    DecodableInterface *decodable_ = nullptr;
+
+    // the decoders and their lattice determinizer read this one, see SetSearchLimits()
+    LatticeIncrementalDecoderConfig decoder_opts_;
+    TokenArena arena_; // kept for the next graph by SetGrammar()
+    SlabPoolStats reported_tokens_; // arena stats last added to RecognizerStats
+    SlabPoolStats reported_links_;
+    // exactly one of them
+    IncrementalDecoder *decoder_ = nullptr;
+    GrammarIncrementalDecoder *grammar_decoder_ = nullptr;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineIncrementalDecoder);
+};
+
+#endif // KALDIANDROID_ONLINE_DECODER_H
@@ -0,0 +1,109 @@
+#include "partial_result.h"
+
+#include <cstring>
+
+void IncrementalPartialMbr::Reset() {
+    commit_time_ = 0;
+    commit_hash_ = 0;
+    committed_.clear();
+}
+
+// Independent of state numbering, which WordAlignLattice does not keep stable
+static uint64 ArcHash(const CompactLatticeArc &arc, int32 start_time, int32 end_time) {
+    float v[2] = {arc.weight.Weight().Value1(), arc.weight.Weight().Value2()};
+    uint32 bits[2];
+    memcpy(bits, v, sizeof(bits));
+    uint64 hash = 14695981039346656037ULL;
+    uint64 fields[5] = {static_cast<uint64>(arc.olabel), static_cast<uint64>(start_time),
+                        static_cast<uint64>(end_time), bits[0], bits[1]};
+    for (int i = 0; i < 5; i++) {
+        hash = (hash ^ fields[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+void IncrementalPartialMbr::Decode(const CompactLattice &clat, const std::vector<int32> &times,
+                                   int32 begin, int32 end, std::vector<PartialWord> *words) {
+    int32 last = end >= 0 ? end : clat.NumStates() - 1;
+    CompactLattice part;
+    for (int32 s = begin; s <= last; s++) {
+        part.AddState();
+    }
+    part.SetStart(0);
+    for (int32 s = begin; s <= last; s++) {
+        if (s == end) {
+            part.SetFinal(s - begin, CompactLatticeWeight::One());
+            break;
+        }
+        for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
+            CompactLatticeArc arc = aiter.Value();
+            arc.nextstate -= begin;
+            part.AddArc(s - begin, arc);
+        }
+        part.SetFinal(s - begin, clat.Final(s));
+    }
+
+    MinimumBayesRisk mbr(part);
+    const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+    const std::vector<int32> &one_best = mbr.GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &one_best_times = mbr.GetOneBestTimes();
+    for (size_t i = 0; i < one_best.size(); i++) {
+        PartialWord word;
+        word.word = one_best[i];
+        word.start = times[begin] + one_best_times[i].first;
+        word.end = times[begin] + one_best_times[i].second;
+        word.conf = conf[i];
+        words->push_back(word);
+    }
+}
+
+void IncrementalPartialMbr::Compute(const CompactLattice &aligned, int32 stable_frame,
+                                    std::vector<PartialWord> *words) {
+    words->clear();
+    CompactLattice clat(aligned);
+    TopSortCompactLatticeIfNeeded(&clat);
+    int32 num_states = clat.NumStates();
+    if (num_states == 0 || clat.Start() != 0) {
+        Reset();
+        return;
+    }
+    std::vector<int32> times;
+    CompactLatticeStateTimes(clat, &times);
+
+    // Sweep in topological order: s is a pinch if no arc from an earlier state
+    // jumps past it and no path ended before it. Along the way compare the
+    // committed prefix with what the lattice has now.
+    int32 commit_state = commit_time_ == 0 ? 0 : -1, new_commit_state = -1;
+    int32 max_next = 0;
+    bool final_seen = false;
+    uint64 prefix_hash = 0, new_commit_hash = 0;
+    for (int32 s = 0; s < num_states && times[s] <= stable_frame; s++) {
+        if (s > 0 && max_next <= s && !final_seen) {
+            if (commit_state < 0 && times[s] == commit_time_ && prefix_hash == commit_hash_) {
+                commit_state = s;
+            }
+            new_commit_state = s;
+            new_commit_hash = prefix_hash;
+        }
+        for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
+            const CompactLatticeArc &arc = aiter.Value();
+            max_next = std::max(max_next, static_cast<int32>(arc.nextstate));
+            prefix_hash += ArcHash(arc, times[s], times[arc.nextstate]);
+        }
+        final_seen = final_seen || clat.Final(s) != CompactLatticeWeight::Zero();
+    }
+
+    if (commit_state < 0) {
+        // prefix was rewritten, start from the beginning
+        Reset();
+        commit_state = 0;
+    }
+    if (new_commit_state > commit_state) {
+        Decode(clat, times, commit_state, new_commit_state, &committed_);
+        commit_state = new_commit_state;
+        commit_time_ = times[new_commit_state];
+        commit_hash_ = new_commit_hash;
+    }
+    *words = committed_;
+    Decode(clat, times, commit_state, -1, words);
+}
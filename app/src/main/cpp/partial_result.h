@@ -0,0 +1,42 @@
+#ifndef KALDIANDROID_PARTIAL_RESULT_H
+#define KALDIANDROID_PARTIAL_RESULT_H
+
+#include <vector>
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+struct PartialWord {
+    int32 word;
+    BaseFloat start; // frames from the start of the lattice
+    BaseFloat end;
+    BaseFloat conf;
+};
+
+// MBR one-best of the growing word-aligned lattice of one utterance, for
+// partial results. If every path goes through a state (a "pinch", typically in
+// a pause), word posteriors before it do not depend on what comes after it, so
+// the words of that prefix are kept and only the part after the last pinch is
+// re-decoded with MinimumBayesRisk. The prefix is reused only while its arcs are
+// unchanged, so a rewrite by the determinizer just falls back to a full pass.
+class IncrementalPartialMbr {
+public:
+    void Reset();
+
+    // aligned: output of WordAlignLattice for the utterance so far. Pinches later
+    // than stable_frame are not committed, they are likely to change again.
+    void Compute(const CompactLattice &aligned, int32 stable_frame,
+                 std::vector<PartialWord> *words);
+
+private:
+    // words of the lattice between states begin and end, end == -1 for the tail
+    static void Decode(const CompactLattice &clat, const std::vector<int32> &times,
+                       int32 begin, int32 end, std::vector<PartialWord> *words);
+
+    int32 commit_time_ = 0; // frame of the pinch that ends the committed prefix
+    uint64 commit_hash_ = 0;
+    std::vector<PartialWord> committed_;
+};
+
+#endif // KALDIANDROID_PARTIAL_RESULT_H
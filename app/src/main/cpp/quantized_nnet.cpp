@@ -0,0 +1,338 @@
+#include "quantized_nnet.h"
+
+#include <cmath>
+#include <sstream>
+
+const char *WeightStorageName(WeightStorage storage) {
+    switch (storage) {
+        case kInt8Weights: return "int8";
+        case kFp16Weights: return "fp16";
+        case kBf16Weights: return "bf16";
+    }
+    return "";
+}
+
+bool ParseWeightStorage(const string &name, WeightStorage *storage) {
+    const WeightStorage storages[] = {kInt8Weights, kFp16Weights, kBf16Weights};
+    for (size_t i = 0; i < sizeof(storages) / sizeof(storages[0]); i++) {
+        if (name == WeightStorageName(storages[i])) {
+            *storage = storages[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void Int8Matrix::Quantize(const float *m, int32 num_rows, int32 num_cols, int32 m_stride) {
+    rows = num_rows;
+    cols = num_cols;
+    stride = (num_cols + kInt8Depth - 1) / kInt8Depth * kInt8Depth;
+    data.resize(static_cast<size_t>(rows) * stride);
+    scale.resize(rows);
+    for (int32 r = 0; r < rows; r++) {
+        const float *x = m + static_cast<size_t>(r) * m_stride;
+        int8 *q = &data[static_cast<size_t>(r) * stride];
+        float max = 0;
+        for (int32 c = 0; c < cols; c++) {
+            max = std::max(max, std::fabs(x[c]));
+        }
+        float inv = max > 0 ? 127.0f / max : 0.0f;
+        scale[r] = max / 127.0f;
+        for (int32 c = 0; c < cols; c++) {
+            float v = x[c] * inv;
+            q[c] = static_cast<int8>(static_cast<int32>(v + (v >= 0 ? 0.5f : -0.5f)));
+        }
+        std::fill(q + cols, q + stride, 0);
+    }
+}
+
+BaseFloat Int8Matrix::RelativeError(const float *m, int32 m_stride) const {
+    double error = 0, norm = 0;
+    for (int32 r = 0; r < rows; r++) {
+        const float *x = m + static_cast<size_t>(r) * m_stride;
+        const int8 *q = &data[static_cast<size_t>(r) * stride];
+        for (int32 c = 0; c < cols; c++) {
+            double d = x[c] - scale[r] * q[c];
+            error += d * d;
+            norm += x[c] * x[c];
+        }
+    }
+    return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+void Int8Matrix::MultiplyAdd(const Int8Matrix &a, int32 row_offset, int32 row_step,
+                             CuMatrixBase<BaseFloat> *out) const {
+    KALDI_ASSERT(a.cols == cols && out->NumCols() == rows &&
+                 row_offset + (out->NumRows() - 1) * row_step < a.rows);
+    Int8GemmAdd(a.data.data(), a.scale.data(), row_offset, row_step, out->NumRows(),
+                data.data(), scale.data(), rows, stride, out->Data(), out->Stride());
+}
+
+void HalfMatrix::Convert(const float *m, int32 num_rows, int32 num_cols, int32 m_stride, bool use_bf16) {
+    rows = num_rows;
+    cols = num_cols;
+    bf16 = use_bf16;
+    data.resize(static_cast<size_t>(rows) * cols);
+    for (int32 r = 0; r < rows; r++) {
+        FloatToHalf(m + static_cast<size_t>(r) * m_stride, cols, bf16, &data[static_cast<size_t>(r) * cols]);
+    }
+}
+
+BaseFloat HalfMatrix::RelativeError(const float *m, int32 m_stride) const {
+    std::vector<float> row(cols);
+    double error = 0, norm = 0;
+    for (int32 r = 0; r < rows; r++) {
+        const float *x = m + static_cast<size_t>(r) * m_stride;
+        Row(r, row.data());
+        for (int32 c = 0; c < cols; c++) {
+            double d = x[c] - row[c];
+            error += d * d;
+            norm += x[c] * x[c];
+        }
+    }
+    return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+// Weight rows widened per block, the float copy of a block stays in L2
+static const int32 kHalfBlockRows = 64;
+
+void HalfMatrix::MultiplyAdd(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const {
+    KALDI_ASSERT(in.NumCols() == cols && out->NumCols() == rows && in.NumRows() == out->NumRows());
+    static thread_local CuMatrix<BaseFloat> block;
+    if (block.NumRows() < kHalfBlockRows || block.NumCols() < cols) {
+        block.Resize(kHalfBlockRows, std::max(cols, block.NumCols()), kUndefined);
+    }
+    for (int32 o = 0; o < rows; o += kHalfBlockRows) {
+        int32 n = std::min(kHalfBlockRows, rows - o);
+        CuSubMatrix<BaseFloat> weights(block, 0, n, 0, cols);
+        for (int32 r = 0; r < n; r++) {
+            Row(o + r, weights.RowData(r));
+        }
+        CuSubMatrix<BaseFloat> out_block(out->ColRange(o, n));
+        out_block.AddMatMat(1.0, in, kNoTrans, weights, kTrans, 1.0);
+    }
+}
+
+void QuantizedInput::Prepare(WeightStorage storage, const CuMatrixBase<BaseFloat> &input) {
+    in = &input;
+    if (storage == kInt8Weights) {
+        int8.Quantize(input);
+    }
+}
+
+void QuantizedMatrix::Init(WeightStorage storage, const float *m, int32 num_rows, int32 num_cols, int32 m_stride) {
+    storage_ = storage;
+    if (storage == kInt8Weights) {
+        int8_.Quantize(m, num_rows, num_cols, m_stride);
+    } else {
+        half_.Convert(m, num_rows, num_cols, m_stride, storage == kBf16Weights);
+    }
+}
+
+BaseFloat QuantizedMatrix::RelativeError(const float *m, int32 m_stride) const {
+    return storage_ == kInt8Weights ? int8_.RelativeError(m, m_stride) : half_.RelativeError(m, m_stride);
+}
+
+void QuantizedMatrix::MultiplyAdd(const QuantizedInput &input, int32 row_offset, int32 row_step,
+                                  CuMatrixBase<BaseFloat> *out) const {
+    if (storage_ == kInt8Weights) {
+        int8_.MultiplyAdd(input.int8, row_offset, row_step, out);
+        return;
+    }
+    // rows row_offset, row_offset + row_step, ... as one matrix, the way TdnnComponent does it
+    const CuMatrixBase<BaseFloat> &in = *input.in;
+    KALDI_ASSERT(row_offset + (out->NumRows() - 1) * row_step < in.NumRows());
+    CuSubMatrix<BaseFloat> rows(in.Data() + static_cast<size_t>(row_offset) * in.Stride(),
+                                out->NumRows(), in.NumCols(), in.Stride() * row_step);
+    half_.MultiplyAdd(rows, out);
+}
+
+// The components are shared by all recognizers of a model, each on its own thread
+static QuantizedInput &InputScratch() {
+    static thread_local QuantizedInput input;
+    return input;
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(WeightStorage storage,
+                                                   const CuMatrixBase<BaseFloat> &linear_params,
+                                                   const CuVectorBase<BaseFloat> *bias_params) {
+    weights_.Init(storage, linear_params.Data(), linear_params.NumRows(), linear_params.NumCols(),
+                  linear_params.Stride());
+    error_ = weights_.RelativeError(linear_params.Data(), linear_params.Stride());
+    if (bias_params) {
+        bias_params_ = *bias_params;
+    }
+}
+
+std::string QuantizedAffineComponent::Info() const {
+    std::ostringstream os;
+    os << Component::Info() << ", weights=" << WeightStorageName(weights_.Storage()) <<
+          ", relative-error=" << error_;
+    return os.str();
+}
+
+void *QuantizedAffineComponent::Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                                          const CuMatrixBase<BaseFloat> &in,
+                                          CuMatrixBase<BaseFloat> *out) const {
+    if (bias_params_.Dim() != 0) {
+        out->CopyRowsFromVec(bias_params_);
+    }
+    QuantizedInput &input = InputScratch();
+    input.Prepare(weights_.Storage(), in);
+    weights_.MultiplyAdd(input, 0, 1, out);
+    return nullptr;
+}
+
+void QuantizedAffineComponent::Backprop(const std::string &debug_info,
+                                        const nnet3::ComponentPrecomputedIndexes *indexes,
+                                        const CuMatrixBase<BaseFloat> &in_value,
+                                        const CuMatrixBase<BaseFloat> &out_value,
+                                        const CuMatrixBase<BaseFloat> &out_deriv, void *memo,
+                                        Component *to_update, CuMatrixBase<BaseFloat> *in_deriv) const {
+    KALDI_ERR << Type() << " is for inference only";
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+    KALDI_ERR << Type() << " is made from a float component by QuantizeNnet()";
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+    KALDI_ERR << Type() << " is made from a float component by QuantizeNnet()";
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+    KALDI_ERR << Type() << " is made at load time and never written, write the float model";
+}
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(WeightStorage storage, nnet3::TdnnComponent *tdnn) {
+    // The time offsets have no accessor, they are read back from Write()
+    std::vector<int32> time_offsets;
+    {
+        std::ostringstream os;
+        tdnn->Write(os, true);
+        string component = os.str();
+        size_t pos = component.find("<TimeOffsets>");
+        if (pos == string::npos) {
+            KALDI_ERR << "No <TimeOffsets> in " << tdnn->Type();
+        }
+        std::istringstream is(component);
+        is.seekg(pos);
+        ExpectToken(is, true, "<TimeOffsets>");
+        ReadIntegerVector(is, true, &time_offsets);
+    }
+
+    const CuMatrixBase<BaseFloat> &linear_params = tdnn->LinearParams();
+    int32 num_offsets = time_offsets.size(), input_dim = linear_params.NumCols() / num_offsets;
+    output_dim_ = linear_params.NumRows();
+    weights_.resize(num_offsets);
+    double error = 0;
+    for (int32 i = 0; i < num_offsets; i++) {
+        const float *block = linear_params.Data() + i * input_dim;
+        weights_[i].Init(storage, block, output_dim_, input_dim, linear_params.Stride());
+        error += weights_[i].RelativeError(block, linear_params.Stride()) / num_offsets;
+    }
+    error_ = error;
+    bias_params_ = tdnn->BiasParams();
+
+    std::ostringstream config;
+    config << "input-dim=" << input_dim << " output-dim=1 use-bias=false time-offsets=";
+    for (int32 i = 0; i < num_offsets; i++) {
+        config << (i ? "," : "") << time_offsets[i];
+    }
+    ConfigLine cfl;
+    cfl.ParseLine(config.str());
+    shape_ = new nnet3::TdnnComponent();
+    shape_->InitFromConfig(&cfl);
+}
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(const QuantizedTdnnComponent &other)
+        : shape_(static_cast<nnet3::TdnnComponent *>(other.shape_->Copy())),
+          output_dim_(other.output_dim_),
+          weights_(other.weights_),
+          bias_params_(other.bias_params_),
+          error_(other.error_) {
+}
+
+QuantizedTdnnComponent::~QuantizedTdnnComponent() {
+    delete shape_;
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+    std::ostringstream os;
+    os << Component::Info() << ", time-offsets=" << weights_.size() << ", weights=" <<
+          WeightStorageName(weights_[0].Storage()) << ", relative-error=" << error_;
+    return os.str();
+}
+
+void *QuantizedTdnnComponent::Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                                        const CuMatrixBase<BaseFloat> &in,
+                                        CuMatrixBase<BaseFloat> *out) const {
+    const nnet3::TdnnComponent::PrecomputedIndexes *tdnn_indexes =
+            dynamic_cast<const nnet3::TdnnComponent::PrecomputedIndexes *>(indexes);
+    KALDI_ASSERT(tdnn_indexes && tdnn_indexes->row_offsets.size() == weights_.size());
+    if (bias_params_.Dim() != 0) {
+        out->CopyRowsFromVec(bias_params_);
+    }
+    // the input is prepared once, the time offsets read overlapping rows
+    QuantizedInput &input = InputScratch();
+    input.Prepare(weights_[0].Storage(), in);
+    for (size_t i = 0; i < weights_.size(); i++) {
+        weights_[i].MultiplyAdd(input, tdnn_indexes->row_offsets[i], tdnn_indexes->row_stride, out);
+    }
+    return nullptr;
+}
+
+void QuantizedTdnnComponent::Backprop(const std::string &debug_info,
+                                      const nnet3::ComponentPrecomputedIndexes *indexes,
+                                      const CuMatrixBase<BaseFloat> &in_value,
+                                      const CuMatrixBase<BaseFloat> &out_value,
+                                      const CuMatrixBase<BaseFloat> &out_deriv, void *memo,
+                                      Component *to_update, CuMatrixBase<BaseFloat> *in_deriv) const {
+    KALDI_ERR << Type() << " is for inference only";
+}
+
+void QuantizedTdnnComponent::InitFromConfig(ConfigLine *cfl) {
+    KALDI_ERR << Type() << " is made from a float component by QuantizeNnet()";
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+    KALDI_ERR << Type() << " is made from a float component by QuantizeNnet()";
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+    KALDI_ERR << Type() << " is made at load time and never written, write the float model";
+}
+
+bool WeightStorageSupported(WeightStorage storage) {
+    // fp16 and bf16 fall back to scalar conversion, which still halves the weights
+    return storage == kInt8Weights ? Int8KernelSupported() : true;
+}
+
+const char *WeightKernelName(WeightStorage storage) {
+    return storage == kInt8Weights ? Int8KernelName() : HalfKernelName();
+}
+
+int32 QuantizeNnet(WeightStorage storage, nnet3::Nnet *nnet) {
+    int32 num_quantized = 0;
+    for (int32 c = 0; c < nnet->NumComponents(); c++) {
+        nnet3::Component *component = nnet->GetComponent(c);
+        string type = component->Type();
+        nnet3::Component *quantized = nullptr;
+        if (type == "AffineComponent" || type == "NaturalGradientAffineComponent") {
+            nnet3::AffineComponent *affine = static_cast<nnet3::AffineComponent *>(component);
+            quantized = new QuantizedAffineComponent(storage, affine->LinearParams(), &affine->BiasParams());
+        } else if (type == "LinearComponent") {
+            quantized = new QuantizedAffineComponent(storage,
+                                                     static_cast<nnet3::LinearComponent *>(component)->Params(),
+                                                     nullptr);
+        } else if (type == "TdnnComponent") {
+            quantized = new QuantizedTdnnComponent(storage, static_cast<nnet3::TdnnComponent *>(component));
+        }
+        if (quantized) {
+            KALDI_VLOG(1) << nnet->GetComponentName(c) << ": " << quantized->Info();
+            nnet->SetComponent(c, quantized); // deletes the float one
+            num_quantized++;
+        }
+    }
+    return num_quantized;
+}
@@ -0,0 +1,182 @@
+#ifndef KALDIANDROID_QUANTIZED_NNET_H
+#define KALDIANDROID_QUANTIZED_NNET_H
+
+#include <vector>
+
+#include "kaldi.h"
+#include "half_float.h"
+#include "int8_gemm.h"
+
+using namespace kaldi;
+
+// Weight storage of the quantized components, picked by --nnet-weights
+enum WeightStorage {
+    kInt8Weights,
+    kFp16Weights,
+    kBf16Weights
+};
+
+const char *WeightStorageName(WeightStorage storage);
+bool ParseWeightStorage(const string &name, WeightStorage *storage); // "int8", "fp16" or "bf16"
+
+// Rows of int8 values with a float scale each, x = scale * q. Symmetric, the
+// largest magnitude of a row maps to 127.
+struct Int8Matrix {
+    int32 rows = 0;
+    int32 cols = 0;
+    int32 stride = 0; // cols rounded up to kInt8Depth
+    std::vector<int8> data;
+    std::vector<float> scale;
+
+    void Quantize(const float *m, int32 num_rows, int32 num_cols, int32 m_stride);
+    void Quantize(const CuMatrixBase<BaseFloat> &m) { Quantize(m.Data(), m.NumRows(), m.NumCols(), m.Stride()); }
+    // |m - dequantized| / |m|, Frobenius norms
+    BaseFloat RelativeError(const float *m, int32 m_stride) const;
+    // out(i, o) += row (row_offset + i * row_step) of a times row o of this
+    void MultiplyAdd(const Int8Matrix &a, int32 row_offset, int32 row_step, CuMatrixBase<BaseFloat> *out) const;
+};
+
+// Rows of fp16 or bf16 values. Products widen a block of rows to float and
+// hand it to the float GEMM, so only one block per thread is ever in float.
+struct HalfMatrix {
+    int32 rows = 0;
+    int32 cols = 0;
+    bool bf16 = false;
+    std::vector<uint16> data;
+
+    void Convert(const float *m, int32 num_rows, int32 num_cols, int32 m_stride, bool use_bf16);
+    BaseFloat RelativeError(const float *m, int32 m_stride) const;
+    void Row(int32 r, float *out) const { HalfToFloat(&data[static_cast<size_t>(r) * cols], cols, bf16, out); }
+    // out(i, o) += row i of in times row o of this
+    void MultiplyAdd(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const;
+};
+
+// Input of a quantized component, prepared once for all weight matrices that
+// read it: quantized for int8, used as it is for 16 bit weights
+struct QuantizedInput {
+    const CuMatrixBase<BaseFloat> *in = nullptr;
+    Int8Matrix int8;
+
+    void Prepare(WeightStorage storage, const CuMatrixBase<BaseFloat> &input);
+};
+
+// One weight matrix of a quantized component
+class QuantizedMatrix {
+public:
+    void Init(WeightStorage storage, const float *m, int32 num_rows, int32 num_cols, int32 m_stride);
+    WeightStorage Storage() const { return storage_; }
+    int32 NumRows() const { return storage_ == kInt8Weights ? int8_.rows : half_.rows; }
+    int32 NumCols() const { return storage_ == kInt8Weights ? int8_.cols : half_.cols; }
+    BaseFloat RelativeError(const float *m, int32 m_stride) const;
+    // out(i, o) += row (row_offset + i * row_step) of the input times row o
+    void MultiplyAdd(const QuantizedInput &input, int32 row_offset, int32 row_step,
+                     CuMatrixBase<BaseFloat> *out) const;
+
+private:
+    WeightStorage storage_ = kInt8Weights;
+    Int8Matrix int8_;
+    HalfMatrix half_;
+};
+
+// AffineComponent, NaturalGradientAffineComponent or LinearComponent with
+// int8 or 16 bit weights, for inference only. For int8 the inputs are
+// quantized per row on the fly.
+class QuantizedAffineComponent : public nnet3::Component {
+public:
+    QuantizedAffineComponent(WeightStorage storage, const CuMatrixBase<BaseFloat> &linear_params,
+                             const CuVectorBase<BaseFloat> *bias_params);
+    QuantizedAffineComponent(const QuantizedAffineComponent &other)
+            : weights_(other.weights_), bias_params_(other.bias_params_), error_(other.error_) {}
+
+    std::string Type() const override { return "QuantizedAffineComponent"; }
+    std::string Info() const override;
+    void InitFromConfig(ConfigLine *cfl) override;
+    int32 InputDim() const override { return weights_.NumCols(); }
+    int32 OutputDim() const override { return weights_.NumRows(); }
+    int32 Properties() const override {
+        // same as the float components, without training
+        return nnet3::kSimpleComponent | nnet3::kBackpropNeedsInput | nnet3::kBackpropAdds |
+               (bias_params_.Dim() == 0 ? nnet3::kPropagateAdds : 0);
+    }
+    void *Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                    const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const override;
+    void Backprop(const std::string &debug_info, const nnet3::ComponentPrecomputedIndexes *indexes,
+                  const CuMatrixBase<BaseFloat> &in_value, const CuMatrixBase<BaseFloat> &out_value,
+                  const CuMatrixBase<BaseFloat> &out_deriv, void *memo, Component *to_update,
+                  CuMatrixBase<BaseFloat> *in_deriv) const override;
+    void Read(std::istream &is, bool binary) override;
+    void Write(std::ostream &os, bool binary) const override;
+    Component *Copy() const override { return new QuantizedAffineComponent(*this); }
+
+private:
+    QuantizedMatrix weights_;
+    CuVector<BaseFloat> bias_params_; // empty for LinearComponent
+    BaseFloat error_; // RelativeError() of the weights
+};
+
+// TdnnComponent with int8 or 16 bit weights, one matrix per time offset. The index
+// handling is the float component's, kept in a copy with a single output row.
+class QuantizedTdnnComponent : public nnet3::Component {
+public:
+    QuantizedTdnnComponent(WeightStorage storage, nnet3::TdnnComponent *tdnn);
+    QuantizedTdnnComponent(const QuantizedTdnnComponent &other);
+    ~QuantizedTdnnComponent() override;
+
+    std::string Type() const override { return "QuantizedTdnnComponent"; }
+    std::string Info() const override;
+    void InitFromConfig(ConfigLine *cfl) override;
+    int32 InputDim() const override { return shape_->InputDim(); }
+    int32 OutputDim() const override { return output_dim_; }
+    int32 Properties() const override {
+        return nnet3::kReordersIndexes | nnet3::kBackpropAdds | nnet3::kBackpropNeedsInput |
+               (bias_params_.Dim() == 0 ? nnet3::kPropagateAdds : 0);
+    }
+    void *Propagate(const nnet3::ComponentPrecomputedIndexes *indexes,
+                    const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const override;
+    void Backprop(const std::string &debug_info, const nnet3::ComponentPrecomputedIndexes *indexes,
+                  const CuMatrixBase<BaseFloat> &in_value, const CuMatrixBase<BaseFloat> &out_value,
+                  const CuMatrixBase<BaseFloat> &out_deriv, void *memo, Component *to_update,
+                  CuMatrixBase<BaseFloat> *in_deriv) const override;
+    void ReorderIndexes(std::vector<nnet3::Index> *input_indexes,
+                        std::vector<nnet3::Index> *output_indexes) const override {
+        shape_->ReorderIndexes(input_indexes, output_indexes);
+    }
+    void GetInputIndexes(const nnet3::MiscComputationInfo &misc_info, const nnet3::Index &output_index,
+                         std::vector<nnet3::Index> *desired_indexes) const override {
+        shape_->GetInputIndexes(misc_info, output_index, desired_indexes);
+    }
+    bool IsComputable(const nnet3::MiscComputationInfo &misc_info, const nnet3::Index &output_index,
+                      const nnet3::IndexSet &input_index_set, std::vector<nnet3::Index> *used_inputs) const override {
+        return shape_->IsComputable(misc_info, output_index, input_index_set, used_inputs);
+    }
+    nnet3::ComponentPrecomputedIndexes *PrecomputeIndexes(const nnet3::MiscComputationInfo &misc_info,
+                                                          const std::vector<nnet3::Index> &input_indexes,
+                                                          const std::vector<nnet3::Index> &output_indexes,
+                                                          bool need_backprop) const override {
+        return shape_->PrecomputeIndexes(misc_info, input_indexes, output_indexes, need_backprop);
+    }
+    void Read(std::istream &is, bool binary) override;
+    void Write(std::ostream &os, bool binary) const override;
+    Component *Copy() const override { return new QuantizedTdnnComponent(*this); }
+
+private:
+    nnet3::TdnnComponent *shape_; // time offsets and input dim, the weights are a stub
+    int32 output_dim_;
+    std::vector<QuantizedMatrix> weights_; // per time offset
+    CuVector<BaseFloat> bias_params_;
+    BaseFloat error_; // RelativeError() of the weights, averaged over the offsets
+};
+
+// The CPU can run a kernel for this storage: int8 needs one of the SIMD
+// kernels of int8_gemm.cpp (picked at run time, NEON is always there on
+// arm64). fp16 and bf16 run on every CPU, scalar where there is no F16C.
+bool WeightStorageSupported(WeightStorage storage);
+const char *WeightKernelName(WeightStorage storage);
+
+// Replaces the affine, linear and TDNN components of a collapsed nnet by
+// quantized ones in place. Component indexes stay the same and the properties
+// only lose kUpdatableComponent, which inference does not look at, so compiled
+// computations remain valid. Returns the number of components replaced.
+int32 QuantizeNnet(WeightStorage storage, nnet3::Nnet *nnet);
+
+#endif // KALDIANDROID_QUANTIZED_NNET_H
@@ -2,6 +2,12 @@
 #include "json.h"
 #include "language_model.h"
 
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 
 Recognizer::Recognizer(Model *model): model_(model) {
 
@@ -14,7 +20,9 @@ Recognizer::Recognizer(Model *model): model_(model) {
     silence_weighting_ = new kaldi::OnlineSilenceWeighting(*model_->trans_model_,
                                                            model_->feature_info_.silence_weighting_config,
                                                            3); // frame_subsampling_factor >= 1
-    if (!model_->HCLG_fst_) {
+    if (model_->HasGrammar()) {
+        UpdateGrammar();
+    } else if (!model_->HCLG_fst_) {
         if (model_->HCLr_fst_ && model_->Gr_fst_) {
             decode_fst_ = fst::LookaheadComposeFst(*model_->HCLr_fst_,
                                                    *model_->Gr_fst_,
@@ -28,21 +36,90 @@ Recognizer::Recognizer(Model *model): model_(model) {
             KALDI_ERR << "Can't create decoding graph";
         }
     }
-    decoder_ = new kaldi::SingleUtteranceNnet3IncrementalDecoder(
-            model_->nnet3_decoding_config_,
-            *model_->trans_model_,
-            *model_->decodable_info_,
-            model_->HCLG_fst_ ? *model_->HCLG_fst_ : *decode_fst_,
-            feature_pipeline_);
-    //    SingleUtteranceNnet3IncrementalDecoderTpl(
+    decoder_ = NewDecoder();
+
+    InitState();
+    if (model_->vad_opts_.enabled) {
+        vad_ = new VoiceActivityGate(model_->vad_opts_, sampling_frequency_,
+                                     new EnergyVoiceActivityDetector(model_->vad_opts_));
+    }
+    if (model_->governor_opts_.enabled) {
+        governor_ = new RtfGovernor(model_->governor_opts_, model_->nnet3_decoding_config_);
+    }
+}
+
+OnlineIncrementalDecoder *Recognizer::NewDecoder() {
+    //    OnlineIncrementalDecoder(
     //    const LatticeIncrementalDecoderConfig &decoder_opts,
     //    const TransitionModel &trans_model,
-    //    const nnet3::DecodableNnetSimpleLoopedInfo &info,
-    //    const FST &fst,
+    //    const nnet3::DecodableNnetSimpleLoopedInfo *info, // looped mode
+    //    BatchNnetComputer *batch_computer, // batched mode
+    //    const fst::Fst<fst::StdArc> &fst, // or const fst::ConstGrammarFst &grammar_fst
     //    OnlineNnet2FeaturePipeline *features);
+    if (grammar_fst_) {
+        return new OnlineIncrementalDecoder(model_->nnet3_decoding_config_, *model_->trans_model_,
+                                            model_->decodable_info_, model_->batch_computer_,
+                                            *grammar_fst_, feature_pipeline_);
+    }
+    return new OnlineIncrementalDecoder(model_->nnet3_decoding_config_, *model_->trans_model_,
+                                        model_->decodable_info_, model_->batch_computer_,
+                                        model_->HCLG_fst_ ? *model_->HCLG_fst_ : *decode_fst_,
+                                        feature_pipeline_);
+}
 
-    InitState();
-    InitRescoring();
+// The decoder starts from the model config, a new one takes the limits the
+// governor is at
+void Recognizer::ApplySearchLimits() {
+    const SearchOperatingPoint &point = governor_->Point();
+    decoder_->SetSearchLimits(point.beam, point.max_active, point.lattice_beam);
+}
+
+// GrammarFst is cheap to build, it only points at the graphs. It is rebuilt
+// rather than changed because it caches expanded states of its sub-graphs.
+void Recognizer::UpdateGrammar() {
+    if (grammar_fst_ && !grammar_changed_) {
+        return;
+    }
+    std::map<int32, SubGraphPtr> subgraphs(subgraphs_);
+    for (size_t i = 0; i < model_->default_subgraphs_.size(); i++) {
+        subgraphs.insert(model_->default_subgraphs_[i]); // ours take precedence
+    }
+    vector<pair<int32, SubGraphPtr> > ifsts(subgraphs.begin(), subgraphs.end());
+    fst::ConstGrammarFst *grammar_fst = new fst::ConstGrammarFst(model_->nonterm_phones_offset_,
+                                                                 model_->grammar_top_fst_, ifsts);
+    if (decoder_) {
+        decoder_->SetGrammar(*grammar_fst);
+    }
+    delete grammar_fst_;
+    grammar_fst_ = grammar_fst;
+    grammar_changed_ = false;
+}
+
+bool Recognizer::SetSubGrammar(const char *nonterminal, const char *phrases) {
+    if (!model_->HasGrammar()) {
+        KALDI_WARN << "The model has no grammar graph";
+        return false;
+    }
+    int32 id = model_->NonterminalId(nonterminal);
+    if (id < 0) {
+        KALDI_WARN << "No nonterminal " << nonterminal << " in the grammar";
+        return false;
+    }
+    json::JSON obj = json::JSON::Load(phrases);
+    if (obj.JSONType() != json::JSON::Class::Array) {
+        KALDI_WARN << "Expecting a JSON array of phrases for nonterminal " << nonterminal;
+        return false;
+    }
+    vector<string> list;
+    for (const auto &phrase : obj.ArrayRange()) {
+        list.push_back(phrase.ToString());
+    }
+    subgraphs_[id] = model_->CompileSubGraph(list);
+    grammar_changed_ = true;
+    if (state_ == RECOGNIZER_INITIALIZED) {
+        UpdateGrammar();
+    }
+    return true;
 }
 
 
@@ -51,53 +128,177 @@ void Recognizer::InitState() {
     frame_offset_ = 0;
     samples_processed_ = 0;
     samples_round_start_ = 0;
+    samples_skipped_ = 0;
+    if (vad_) {
+        vad_->Reset();
+    }
 
     state_ = RECOGNIZER_INITIALIZED;
 }
 
 void Recognizer::InitRescoring() { // ?????
-    if (model_->graph_lm_fst_) {
-        fst::CacheOptions cache_opts(true, -1);
-        fst::ArcMapFstOptions mapfst_opts(cache_opts);
-        fst::StdToLatticeMapper<BaseFloat> mapper; // maps a normal arc (StdArc) to a LatticeArc by putting the StdArc weight as the first element of the LatticeWeight. Useful when doing LM rescoring.
-        lm_to_subtract_ = new fst::ArcMapFst<fst::StdArc, LatticeArc, fst::StdToLatticeMapper<BaseFloat> >(
-                *model_->graph_lm_fst_, mapper, mapfst_opts);
+    rescoring_initialized_ = true;
+    if (model_->EnsureRescoring()) { // may block on loading rescore/ and rnnlm/
+        // Old LM is subtracted through its backoff structure instead of composing
+        // and determinizing, so the whole rescoring is one deterministic
+        // composition that can follow the lattice as it grows.
+        lm_to_subtract_det_backoff_ = new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(*model_->graph_lm_fst_);
+        lm_to_subtract_det_scale_ = new fst::ScaleDeterministicOnDemandFst(-1.0, lm_to_subtract_det_backoff_);
         carpa_to_add_ = new ConstArpaLmDeterministicFst(model_->const_arpa_);
+        ResetRescoring();
 
         if (model_->rnnlm_enabled_) {
             int lm_order = 4;
-            rnnlm_info_ = new kaldi::rnnlm::RnnlmComputeStateInfo(
-                    model_->rnnlm_compute_opts_, model_->rnnlm_, model_->word_embedding_mat_);
-            rnnlm_to_add_ = new kaldi::rnnlm::KaldiRnnlmDeterministicFst(lm_order, *rnnlm_info_);
-            rnnlm_to_add_scale_ = new fst::ScaleDeterministicOnDemandFst(0.5, rnnlm_to_add_);
+            if (model_->word_embedding_half_.rows > 0) {
+                half_rnnlm_to_add_ = new HalfRnnlmDeterministicFst(lm_order, model_->rnnlm_compute_opts_,
+                                                                   model_->rnnlm_, model_->word_embedding_half_);
+                rnnlm_to_add_scale_ = new fst::ScaleDeterministicOnDemandFst(0.5, half_rnnlm_to_add_);
+            } else {
+                rnnlm_info_ = new kaldi::rnnlm::RnnlmComputeStateInfo(
+                        model_->rnnlm_compute_opts_, model_->rnnlm_, model_->word_embedding_mat_);
+                rnnlm_to_add_ = new kaldi::rnnlm::KaldiRnnlmDeterministicFst(lm_order, *rnnlm_info_);
+                rnnlm_to_add_scale_ = new fst::ScaleDeterministicOnDemandFst(0.5, rnnlm_to_add_);
+            }
             carpa_to_add_scale_ = new fst::ScaleDeterministicOnDemandFst(-0.5, carpa_to_add_);
         }
     }
 }
-bool Recognizer::AcceptWaveform(const char *data, int len)
-{
-    Vector<BaseFloat> wave;
-    wave.Resize(len / 2, kUndefined);
-    for (int i = 0; i < len / 2; i++){
-        wave(i) = *(((short *)data) + i);
+
+// New utterance: drop the composition state of the previous one
+void Recognizer::ResetRescoring() {
+    if (!carpa_to_add_) {
+        return;
+    }
+    if (!rescorer_) {
+        lm_rescore_ = new ComposeLmDeterministicFst(lm_to_subtract_det_scale_, carpa_to_add_);
+        rescorer_ = new IncrementalLatticeRescorer(lm_rescore_);
+    } else {
+        // the rescorer holds lm_rescore_ state ids, both are cleared together
+        lm_rescore_->Clear();
+        rescorer_->Reset();
     }
-    return AcceptWaveform(wave);
+    rescored_frames_ = 0;
 }
-bool Recognizer::AcceptWaveform(const short *sdata, int len) {
-    Vector<BaseFloat> wave;
-    wave.Resize(len, kUndefined);
+
+// Rescore what the decoder has determinized so far, so little is left for the endpoint
+void Recognizer::UpdateRescoring() {
+    if (!rescoring_initialized_ && model_->RescoringReady()) {
+        InitRescoring(); // never waits here, partial results must not depend on the LMs
+    }
+    if (rescorer_ && decoder_->NumFramesInLattice() > rescored_frames_) {
+        rescored_frames_ = decoder_->NumFramesInLattice();
+        CompactLattice clat;
+        {
+            StageTimer timer(&stats_, STAGE_DETERMINIZE);
+            clat = decoder_->GetLattice(rescored_frames_, false);
+        }
+        StageTimer timer(&stats_, STAGE_RESCORE);
+        rescorer_->Update(clat);
+    }
+}
+
+// Convert 16-bit PCM samples to float without any per-sample bounds checks.
+// Input may come straight from a byte buffer, so loads are unaligned.
+void ConvertPcm16ToFloat(const short *in, int len, float *out) {
+    int i = 0;
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    for (; i + 8 <= len; i += 8) {
+        int16x8_t s = vld1q_s16(in + i);
+        vst1q_f32(out + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))));
+        vst1q_f32(out + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))));
+    }
+#elif defined(__AVX2__)
+    for (; i + 16 <= len; i += 16) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+        _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(lo));
+        _mm256_storeu_ps(out + i + 8, _mm256_cvtepi32_ps(hi));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= len; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // sign extend by placing the sample in the high half and shifting back
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(hi));
+    }
+#endif
+    for (; i < len; ++i) {
+        out[i] = in[i];
+    }
+}
+
+SubVector<BaseFloat> Recognizer::ConvertWaveform(const short *sdata, int len) {
+    // Grow only, so steady-state streaming with a fixed buffer size never allocates
+    if (wave_buffer_.Dim() < len) {
+        wave_buffer_.Resize(len, kUndefined);
+    }
     //    typedef enum {
     //        kSetZero,
     //        kUndefined,
     //        kCopyData
     //    } MatrixResizeType;
-    for (int i = 0; i < len; ++i) {
-        wave(i) = sdata[i];
+    ConvertPcm16ToFloat(sdata, len, wave_buffer_.Data());
+    return SubVector<BaseFloat>(wave_buffer_, 0, len);
+}
+
+bool Recognizer::AcceptWaveform(const char *data, int len)
+{
+    return AcceptWaveform(ConvertWaveform((const short *)data, len / 2));
+}
+
+bool Recognizer::AcceptWaveform(const short *sdata, int len) {
+    return AcceptWaveform(ConvertWaveform(sdata, len));
+}
+
+// Samples are expected in the int16 range, same as the other entry points
+bool Recognizer::AcceptWaveform(const float *fdata, int len) {
+    return AcceptWaveform(SubVector<BaseFloat>(fdata, len));
+}
+
+bool Recognizer::AcceptWaveform(const VectorBase<BaseFloat> &wave) {
+    stats_.samples += wave.Dim();
+    return vad_ ? AcceptGated(wave) : DecodeWaveform(wave);
+}
+
+// Audio is only held back between utterances, never inside one. Skipping it
+// restarts the feature pipeline in CleanUp(), and samples_round_start_ counts
+// the skipped samples, so word times stay stream times.
+bool Recognizer::AcceptGated(const VectorBase<BaseFloat> &wave) {
+    vad_->Accept(wave, &vad_runs_);
+    bool endpoint = false;
+    for (size_t i = 0; i < vad_runs_.size(); i++) {
+        const VoiceActivityRun &run = vad_runs_[i];
+        const SubVector<BaseFloat> audio = wave.Range(run.begin, run.end - run.begin);
+        if (run.speech) {
+            if (state_ != RECOGNIZER_RUNNING) { // onset, the audio before it goes first
+                if (state_ == RECOGNIZER_INITIALIZED) {
+                    samples_round_start_ += samples_skipped_; // nothing in the pipeline yet
+                    samples_skipped_ = 0;
+                }
+                vad_->Release(&vad_lookback_);
+                DecodeWaveform(vad_lookback_);
+            }
+            endpoint = DecodeWaveform(audio);
+        } else if (state_ == RECOGNIZER_RUNNING) {
+            // The hangover ran out, the utterance ends whatever the endpoint
+            // rules say. Until the result is taken the audio is still decoded.
+            DecodeWaveform(audio);
+            endpoint = true;
+        } else {
+            int32 dropped = vad_->Hold(audio);
+            samples_skipped_ += dropped;
+            stats_.skipped_samples += dropped;
+            endpoint = false;
+        }
     }
-    return AcceptWaveform(wave);
+    return endpoint;
 }
 
-bool Recognizer::AcceptWaveform(Vector<BaseFloat> &wave) {
+bool Recognizer::DecodeWaveform(const VectorBase<BaseFloat> &wave) {
+    Timer timer;
     // Cleanup if we finalized previous utterance or the whole feature pipeline
     if (!(state_ == RECOGNIZER_RUNNING || state_ == RECOGNIZER_INITIALIZED)) {
         CleanUp();
@@ -106,15 +307,24 @@ bool Recognizer::AcceptWaveform(Vector<BaseFloat> &wave) {
 
     int step = static_cast<int>(sampling_frequency_ * 0.2);
     for (int i = 0; i < wave.Dim(); i += step) {
-        SubVector <BaseFloat> r = wave.Range(i, std::min(step, wave.Dim() - i));
-        feature_pipeline_->AcceptWaveform(sampling_frequency_, r);
-        UpdateSilenceWeights();
-        decoder_->AdvanceDecoding();
+        const SubVector <BaseFloat> r = wave.Range(i, std::min(step, wave.Dim() - i));
+        {
+            StageTimer timer(&stats_, STAGE_FEATURES);
+            feature_pipeline_->AcceptWaveform(sampling_frequency_, r);
+            UpdateSilenceWeights();
+        }
+        decoder_->AdvanceDecoding(&stats_);
     }
     samples_processed_ += wave.Dim();
+    UpdateRescoring();
     if (spk_feature_) {
         spk_feature_->AcceptWaveform(sampling_frequency_, wave);
     }
+    // everything the audio cost the stream before the endpoint check, the
+    // results are taken by the caller whatever the load
+    if (governor_ && governor_->Update(timer.Elapsed(), wave.Dim() / sampling_frequency_)) {
+        ApplySearchLimits();
+    }
     if (decoder_->EndpointDetected(model_->endpoint_config_)) {
         return true;
     }
@@ -129,31 +339,52 @@ void Recognizer::CleanUp() {
     if (decoder_) {
         frame_offset_ += decoder_->NumFramesDecoded();
     }
-    if (decoder_ == nullptr || state_ == RECOGNIZER_FINALIZED || frame_offset_ > 20000) {
-        samples_round_start_ += samples_processed_;
+    if (decoder_ == nullptr || state_ == RECOGNIZER_FINALIZED || frame_offset_ > 20000 || samples_skipped_ > 0) {
+        bool gap = samples_skipped_ > 0 && state_ != RECOGNIZER_FINALIZED;
+        samples_round_start_ += samples_processed_ + samples_skipped_;
         samples_processed_ = 0;
+        samples_skipped_ = 0;
         frame_offset_ = 0;
 
-        delete decoder_;
-        delete feature_pipeline_;
-
+        OnlineNnet2FeaturePipeline *last_pipeline = feature_pipeline_;
         feature_pipeline_ = new kaldi::OnlineNnet2FeaturePipeline(model_->feature_info_);
-        decoder_ = new kaldi::SingleUtteranceNnet3IncrementalDecoder(
-                model_->nnet3_decoding_config_,
-                *model_->trans_model_,
-                *model_->decodable_info_,
-                model_->HCLG_fst_ ? *model_->HCLG_fst_ : *decode_fst_,
-                feature_pipeline_);
-        //    SingleUtteranceNnet3IncrementalDecoderTpl(
-        //    const LatticeIncrementalDecoderConfig &decoder_opts,
-        //    const TransitionModel &trans_model,
-        //    const nnet3::DecodableNnetSimpleLoopedInfo &info,
-        //    const FST &fst,
-        //    OnlineNnet2FeaturePipeline *features);
+        if (gap) {
+            // Still the same stream, only silence was skipped: keep what the
+            // last pipeline adapted to the speaker and channel
+            if (last_pipeline->IvectorFeature()) {
+                OnlineIvectorExtractorAdaptationState adaptation(model_->feature_info_.ivector_extractor_info);
+                last_pipeline->GetAdaptationState(&adaptation);
+                feature_pipeline_->SetAdaptationState(adaptation);
+            }
+            if (model_->feature_info_.use_cmvn && last_pipeline->NumFramesReady() > 0) {
+                OnlineCmvnState cmvn_state;
+                last_pipeline->GetCmvnState(&cmvn_state);
+                feature_pipeline_->SetCmvnState(cmvn_state);
+            }
+        }
+        delete last_pipeline;
+
+        if (grammar_fst_) {
+            UpdateGrammar(); // sub-graphs set during the last utterance
+        }
+        if (decoder_) {
+            decoder_->Reset(feature_pipeline_); // keeps the token and hash storage of the last utterance
+        } else {
+            decoder_ = NewDecoder();
+            if (governor_) {
+                ApplySearchLimits();
+            }
+        }
 
     } else {
+        if (grammar_fst_) {
+            UpdateGrammar();
+        }
         decoder_->InitDecoding(frame_offset_); // call InitDecoding and then (possibly multiple times) AdvanceDecoding().
     }
+    ResetRescoring();
+    partial_mbr_.Reset();
+    partial_frames_ = -1;
 
 
 }
@@ -164,7 +395,7 @@ void Recognizer::UpdateSilenceWeights() {
         feature_pipeline_->IvectorFeature() != nullptr ) {
 
         vector<pair<int32, BaseFloat> > delta_weights;
-        silence_weighting_->ComputeCurrentTraceback(decoder_->Decoder());
+        decoder_->ComputeCurrentTraceback(silence_weighting_);
         silence_weighting_->GetDeltaWeights(feature_pipeline_->NumFramesReady(),
                                             frame_offset_ * 3,
                                             &delta_weights);
@@ -188,27 +419,28 @@ const char* Recognizer::GetResult() { // ?????
     if (decoder_->NumFramesDecoded() == 0) {
         return StoreEmptyReturn();
     }
+    if (!rescoring_initialized_) {
+        InitRescoring();
+    }
     // Original from decoder, subtracted graph weight, rescored with carpa, rescored with rnnlm
-    CompactLattice clat, slat, tlat, rlat;
-    clat = decoder_->GetLattice(decoder_->NumFramesDecoded(), true); // num_frames_to_include, use_final_probs
-
-    if (lm_to_subtract_ && carpa_to_add_) { // from InitRescoring
-        Lattice lat, composed_lat;
-
-        // Delete old score
-        ConvertLattice(clat, &lat);
-        fst::ScaleLattice(fst::GraphLatticeScale(-1.0), &lat);
-        fst::Compose(lat, *lm_to_subtract_, &composed_lat);
-        fst::Invert(&composed_lat);
-        DeterminizeLattice(composed_lat, &slat);
-        fst::ScaleLattice(fst::GraphLatticeScale(-1.0), &slat);
+    CompactLattice clat, tlat, rlat;
+    {
+        StageTimer timer(&stats_, STAGE_DETERMINIZE);
+        clat = decoder_->GetLattice(decoder_->NumFramesDecoded(), true); // num_frames_to_include, use_final_probs
+        stats_.AddLattice(clat);
+    }
 
-        // Add CARPA score
-        TopSortCompactLatticeIfNeeded(&slat);
-        ComposeCompactLatticeDeterministic(slat, carpa_to_add_, &tlat);
+    if (rescorer_) { // from InitRescoring
+        // Subtract G.fst and add CARPA score, only the part determinized since the
+        // last UpdateRescoring() is composed here
+        {
+            StageTimer timer(&stats_, STAGE_RESCORE);
+            rescorer_->GetLattice(clat, &tlat);
+        }
 
         // Rescore with RNNLM score on top if needed
         if (rnnlm_to_add_scale_) {
+            StageTimer timer(&stats_, STAGE_RNNLM);
             ComposeLatticePrunedOptions compose_opts;
             compose_opts.lattice_compose_beam = 3.0;
             compose_opts.max_arcs = 3000;
@@ -217,7 +449,11 @@ const char* Recognizer::GetResult() { // ?????
             TopSortCompactLatticeIfNeeded(&tlat);
             ComposeCompactLatticePruned(compose_opts, tlat,
                                         &combined_rnnlm, &rlat);
-            rnnlm_to_add_->Clear();
+            if (rnnlm_to_add_) {
+                rnnlm_to_add_->Clear();
+            } else {
+                half_rnnlm_to_add_->Clear();
+            }
         } else {
             rlat = tlat;
         }
@@ -302,6 +538,7 @@ static bool CompactLatticeToWordAlignmentWeight(const CompactLattice &clat,
 }
 
 const char *Recognizer::NbestResult(CompactLattice &clat){
+    StageTimer timer(&stats_, STAGE_MBR);
     Lattice lat, nbest_lat;
     std::vector<Lattice> nbest_lats;
 
@@ -340,6 +577,21 @@ const char *Recognizer::NbestResult(CompactLattice &clat){
         CompactLatticeToWordAlignmentWeight(aligned_nclat, &words, &begin_times, &lengths, &weight);
         float likelihood = - (weight.Weight().Value1() + weight.Weight().Value2());
 
+        if (k == 0) {
+            result_words_.clear();
+            for (size_t i = 0; i < words.size(); ++i) {
+                if (words[i] == 0) {
+                    continue;
+                }
+                ResultWord word = {words[i], StreamFrame(begin_times[i]),
+                                   StreamFrame(begin_times[i] + lengths[i]), 1.0f};
+                result_words_.push_back(word);
+            }
+        }
+        if (!json_) {
+            break; // only the best one is kept in result_words_
+        }
+
         stringstream text;
         json::JSON entry;
 
@@ -365,11 +617,15 @@ const char *Recognizer::NbestResult(CompactLattice &clat){
         entry["confidence"] = likelihood;
         obj["alternatives"].append(entry);
     }
+    if (!json_) {
+        return StoreReturn("");
+    }
     //return StoreReturn(obj.dump());
     return StoreReturn(obj["text"].ToString());
 }
 
 const char *Recognizer::MbrResult(CompactLattice &rlat){
+    StageTimer timer(&stats_, STAGE_MBR);
     CompactLattice aligned_lat;
     if (model_->word_boundary_info_) {
         WordAlignLattice(rlat,
@@ -392,6 +648,17 @@ const char *Recognizer::MbrResult(CompactLattice &rlat){
 
     int size = words.size();
 
+    result_words_.resize(size);
+    for (int i = 0; i < size; ++i) {
+        result_words_[i].word = words[i];
+        result_words_[i].start = StreamFrame(times[i].first);
+        result_words_[i].end = StreamFrame(times[i].second);
+        result_words_[i].conf = conf[i];
+    }
+    if (!json_) {
+        return StoreReturn("");
+    }
+
     json::JSON obj;
     stringstream text;
 
@@ -437,7 +704,12 @@ const char *Recognizer::NlsmlResult(CompactLattice &clat){
 
 
 
+int32 Recognizer::StreamFrame(BaseFloat t) const {
+    return static_cast<int32>(std::lround(samples_round_start_ / sampling_frequency_ / 0.03 + frame_offset_ + t));
+}
+
 const char *Recognizer::StoreEmptyReturn() {
+    result_words_.clear();
     if (!max_alternatives_) {
 //        return StoreReturn("{\"text\": \"\"}");
         return StoreReturn("");
@@ -468,23 +740,18 @@ const char* Recognizer::FinalResult()
         return StoreEmptyReturn();
     }
 
-    feature_pipeline_->InputFinished();
-    UpdateSilenceWeights();
-    decoder_->AdvanceDecoding();
+    {
+        StageTimer timer(&stats_, STAGE_FEATURES);
+        feature_pipeline_->InputFinished();
+        UpdateSilenceWeights();
+    }
+    decoder_->AdvanceDecoding(&stats_);
     decoder_->FinalizeDecoding();
     state_ = RECOGNIZER_FINALIZED;
     GetResult();
 
-    // Free some memory while we are finalized, next
-    // iteration will reinitialize them anyway
-    delete decoder_;
-    delete feature_pipeline_;
-    delete silence_weighting_;
+    // The decoder is kept, the next utterance resets it in place in CleanUp()
     delete spk_feature_;
-
-    feature_pipeline_ = nullptr;
-    silence_weighting_ = nullptr;
-    decoder_ = nullptr;
     spk_feature_ = nullptr;
 
     return last_result_.c_str();
@@ -495,61 +762,98 @@ const char* Recognizer::PartialResult()
     if (state_ != RECOGNIZER_RUNNING) {
         return StoreEmptyReturn();
     }
+    // Nothing new was decoded since the last call
+    if (decoder_->NumFramesDecoded() == partial_frames_) {
+        return StoreReturn(partial_result_);
+    }
+    partial_frames_ = decoder_->NumFramesDecoded();
 
     json::JSON res;
 
     if (partial_words_) {
         if (decoder_->NumFramesInLattice() == 0 ) {
+            result_words_.clear();
             res["partial"] = "";
+            partial_result_ = res["partial"].ToString();
             //return StoreReturn(res.dump());
-            return StoreReturn(res["partial"].ToString());
+            return StoreReturn(partial_result_);
         }
         CompactLattice clat, aligned_lat;
 
-        clat = decoder_->GetLattice(decoder_->NumFramesInLattice(), false);
-        //WordAlignLatticePartial
-        WordAlignLattice(clat,
-                        *model_->trans_model_,
-                        *model_->word_boundary_info_,
-                        0,
-                        &aligned_lat);
-
-        MinimumBayesRisk mbr(aligned_lat);
-        const vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
-        const vector<int32> &words = mbr.GetOneBest();
-        const vector<pair<BaseFloat, BaseFloat> > &times = mbr.GetOneBestTimes();
+        {
+            StageTimer timer(&stats_, STAGE_DETERMINIZE);
+            clat = decoder_->GetLattice(decoder_->NumFramesInLattice(), false);
+        }
+        vector<PartialWord> words;
+        {
+            StageTimer timer(&stats_, STAGE_MBR);
+            //WordAlignLatticePartial
+            WordAlignLattice(clat,
+                            *model_->trans_model_,
+                            *model_->word_boundary_info_,
+                            0,
+                            &aligned_lat);
+
+            // words older than this are not expected to change anymore
+            int32 stable_frame = decoder_->NumFramesInLattice() - kPartialStableFrames;
+            partial_mbr_.Compute(aligned_lat, stable_frame, &words);
+        }
 
         int size = words.size();
 
+        result_words_.resize(size);
+        for (int i = 0; i < size; i++) {
+            result_words_[i].word = words[i].word;
+            result_words_[i].start = StreamFrame(words[i].start);
+            result_words_[i].end = StreamFrame(words[i].end);
+            result_words_[i].conf = words[i].conf;
+        }
+        if (!json_) {
+            partial_result_.clear();
+            return StoreReturn(partial_result_);
+        }
+
         stringstream text;
 
         // Create JSON object
         for (int i = 0; i < size; i++) {
             json::JSON word;
 
-            word["word"] = model_->word_syms_->Find(words[i]);
-            word["start"] = samples_round_start_ / sampling_frequency_ + (frame_offset_ + times[i].first) * 0.03;
-            word["end"] = samples_round_start_ / sampling_frequency_ + (frame_offset_ + times[i].second) * 0.03;
-            word["conf"] = conf[i];
+            word["word"] = model_->word_syms_->Find(words[i].word);
+            word["start"] = samples_round_start_ / sampling_frequency_ + (frame_offset_ + words[i].start) * 0.03;
+            word["end"] = samples_round_start_ / sampling_frequency_ + (frame_offset_ + words[i].end) * 0.03;
+            word["conf"] = words[i].conf;
             res["partial_result"].append(word);
 
             if (i) {
                 text << " ";
             }
-            text << model_->word_syms_->Find(words[i]);
+            text << model_->word_syms_->Find(words[i].word);
         }
         res["partial"] = text.str();
     } else {
         if (decoder_->NumFramesDecoded() == 0) {
+            result_words_.clear();
             res["partial"] = "";
+            partial_result_ = res["partial"].ToString();
             //return StoreReturn(res.dump());
-            return StoreReturn(res["partial"].ToString());
+            return StoreReturn(partial_result_);
         }
         Lattice lat;
         decoder_->GetBestPath(false, &lat);
         vector <kaldi::int32> alignment, words;
         LatticeWeight weight;
         fst::GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+        // no word times without alignment, see partial_words_
+        result_words_.resize(words.size());
+        for (size_t i = 0; i < words.size(); ++i) {
+            ResultWord word = {words[i], -1, -1, 1.0f};
+            result_words_[i] = word;
+        }
+        if (!json_) {
+            partial_result_.clear();
+            return StoreReturn(partial_result_);
+        }
         ostringstream text;
         for (size_t i = 0; i < words.size(); ++i) {
             if (i) {
@@ -559,8 +863,9 @@ const char* Recognizer::PartialResult()
         }
         res["partial"] = text.str();
     }
+    partial_result_ = res["partial"].ToString();
     //return StoreReturn(res.dump());
-    return StoreReturn(res["partial"].ToString());
+    return StoreReturn(partial_result_);
 
 }
 
@@ -573,21 +878,84 @@ void Recognizer::Reset()
     state_ = RECOGNIZER_ENDPOINT;
 }
 
+const char *Recognizer::Stats() {
+    stats_json_ = stats_.ToJson();
+    return stats_json_.c_str();
+}
+
+const char *Recognizer::SearchParams() {
+    json::JSON obj;
+    if (governor_) {
+        const SearchOperatingPoint &point = governor_->Point();
+        obj["beam"] = point.beam;
+        obj["max_active"] = point.max_active;
+        obj["lattice_beam"] = point.lattice_beam;
+        obj["level"] = point.level;
+        obj["rtf"] = point.rtf;
+    } else {
+        const LatticeIncrementalDecoderConfig &config = model_->nnet3_decoding_config_;
+        obj["beam"] = config.beam;
+        obj["max_active"] = config.max_active;
+        obj["lattice_beam"] = config.lattice_beam;
+    }
+    search_params_json_ = obj.dump();
+    return search_params_json_.c_str();
+}
+
+// Back to a new stream, for a recognizer returned to the model's pool
+void Recognizer::ResetStream() {
+    json_ = true;
+    stats_ = RecognizerStats(); // the counters belong to the previous client
+    if (!subgraphs_.empty()) { // the next stream starts from the model's sub-graphs
+        subgraphs_.clear();
+        grammar_changed_ = true;
+    }
+    if (state_ == RECOGNIZER_INITIALIZED) {
+        if (grammar_fst_) {
+            UpdateGrammar();
+        }
+        // Nothing decoded since the last reset, but the gate may still hold the
+        // previous client's lookback audio and the skipped samples shift times
+        if (vad_) {
+            vad_->Reset();
+        }
+        samples_round_start_ = 0;
+        samples_skipped_ = 0;
+        return;
+    }
+    if (state_ == RECOGNIZER_RUNNING) {
+        decoder_->FinalizeDecoding();
+    }
+    state_ = RECOGNIZER_FINALIZED;
+    CleanUp();
+    InitState();
+    StoreEmptyReturn();
+}
+
 Recognizer::~Recognizer() {
     delete decoder_;
+    delete grammar_fst_;
+    delete vad_;
+    delete governor_;
     delete feature_pipeline_;
     delete silence_weighting_;
     delete decode_fst_;
     delete spk_feature_;
 
-    delete lm_to_subtract_;
+    delete rescorer_;
+    delete lm_rescore_;
+    delete lm_to_subtract_det_scale_;
+    delete lm_to_subtract_det_backoff_;
     delete carpa_to_add_;
     delete carpa_to_add_scale_;
     delete rnnlm_info_;
     delete rnnlm_to_add_;
+    delete half_rnnlm_to_add_;
     delete rnnlm_to_add_scale_;
 
-    model_->Unref();
+    if (!pooled_) { // idle in the pool, see Model::ReleaseRecognizer
+        model_->Unref();
+    }
     //if (spk_model_) {
     //    spk_model_->Unref();
     //}
@@ -4,10 +4,29 @@
 
 #include "kaldi.h"
 
+#include "half_rnnlm.h"
+#include "lattice_rescorer.h"
 #include "model.h"
+#include "online_decoder.h"
+#include "partial_result.h"
+#include "recognizer_stats.h"
+#include "rtf_governor.h"
+#include "voice_activity.h"
 
 using namespace kaldi;
 
+// A word of the last result, start and end in output frames (0.03s) from the
+// start of the stream
+struct ResultWord {
+    int32 word;
+    int32 start;
+    int32 end;
+    BaseFloat conf;
+};
+
+// int16 samples to float, vectorized; also used by WakeWordRecognizer
+void ConvertPcm16ToFloat(const short *in, int len, float *out);
+
 enum RecognizerState {
     RECOGNIZER_INITIALIZED,
     RECOGNIZER_RUNNING,
@@ -20,15 +39,43 @@ public:
     Recognizer(Model *model);
     bool AcceptWaveform(const char* sdata, int len);
     bool AcceptWaveform(const short* sdata, int len);
+    bool AcceptWaveform(const float* fdata, int len);
     const char* Result();
     const char* FinalResult();
     const char* PartialResult();
+    // Words of the last result or partial result, filled whether or not
+    // the string results are formatted
+    const std::vector<ResultWord> &ResultWords() const { return result_words_; }
+    // With json off the result functions skip formatting and return ""
+    void SetJson(bool json) { json_ = json; }
+    Model *GetModel() const { return model_; }
+    // Replaces the phrases of a grammar nonterminal (#nonterm:name) for this
+    // recognizer, phrases is a JSON array of strings. Takes effect at the next
+    // utterance, or right away if nothing was decoded yet. False if the model
+    // has no grammar or no such nonterminal.
+    bool SetSubGrammar(const char *nonterminal, const char *phrases);
+    // Per-stage time and search counters since the recognizer was created, as
+    // JSON, valid until the next call
+    const char *Stats();
+    // Beam, max-active and lattice-beam the search runs with, with the level
+    // and last RTF of the governor if --rtf-governor is on, as JSON, valid
+    // until the next call
+    const char *SearchParams();
     void Reset();
     ~Recognizer();
 private:
     void InitState();
+    OnlineIncrementalDecoder *NewDecoder();
+    void ApplySearchLimits();
+    void UpdateGrammar();
+    void ResetStream();
     void InitRescoring();
-    bool AcceptWaveform(Vector<BaseFloat>& wave);
+    void ResetRescoring();
+    void UpdateRescoring();
+    bool AcceptWaveform(const VectorBase<BaseFloat>& wave);
+    bool AcceptGated(const VectorBase<BaseFloat>& wave);
+    bool DecodeWaveform(const VectorBase<BaseFloat>& wave);
+    SubVector<BaseFloat> ConvertWaveform(const short* sdata, int len);
     void CleanUp();
     void UpdateSilenceWeights();
     const char* GetResult();
@@ -37,6 +84,7 @@ private:
     const char *NlsmlResult(CompactLattice &clat);
     const char *StoreEmptyReturn();
     const char *StoreReturn(const string &res);
+    int32 StreamFrame(BaseFloat t) const;
 
 
     Model* model_ = nullptr;
@@ -44,31 +92,64 @@ private:
     kaldi::OnlineNnet2FeaturePipeline *feature_pipeline_ = nullptr; // main feature extraction pipeline
     kaldi::OnlineSilenceWeighting *silence_weighting_ = nullptr; // weighting silence in ivector adaptation
     fst::LookaheadFst<fst::StdArc, int32> *decode_fst_ = nullptr;
-    kaldi::SingleUtteranceNnet3IncrementalDecoder *decoder_ = nullptr;
+    // Grammar graphs, the model's top-level graph and sub-graphs with ours on top
+    fst::ConstGrammarFst *grammar_fst_ = nullptr;
+    std::map<int32, SubGraphPtr> subgraphs_;
+    bool grammar_changed_ = false;
+    OnlineIncrementalDecoder *decoder_ = nullptr; // looped or batched nnet3 scoring, see Model
     // Speaker identification
     //SpkModel *spk_model_ = nullptr;
     OnlineBaseFeature *spk_feature_ = nullptr;
     // Rescoring
-    fst::ArcMapFst<fst::StdArc, LatticeArc, fst::StdToLatticeMapper<BaseFloat> > *lm_to_subtract_ = nullptr;
+    fst::BackoffDeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_det_backoff_ = nullptr;
+    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale_ = nullptr;
     kaldi::ConstArpaLmDeterministicFst *carpa_to_add_ = nullptr;
+    ComposeLmDeterministicFst *lm_rescore_ = nullptr; // -G.fst + G.carpa, cleared per utterance
+    IncrementalLatticeRescorer *rescorer_ = nullptr; // follows the decoder lattice as it gets determinized
+    int32 rescored_frames_ = 0;
     fst::ScaleDeterministicOnDemandFst *carpa_to_add_scale_ = nullptr;
     // RNNLM rescoring
     kaldi::rnnlm::RnnlmComputeStateInfo *rnnlm_info_ = nullptr;
     kaldi::rnnlm::KaldiRnnlmDeterministicFst* rnnlm_to_add_ = nullptr;
+    HalfRnnlmDeterministicFst *half_rnnlm_to_add_ = nullptr; // instead of rnnlm_to_add_ with --rnnlm-weights=fp16/bf16
     fst::DeterministicOnDemandFst<fst::StdArc> *rnnlm_to_add_scale_ = nullptr;
+    bool rescoring_initialized_ = false; // deferred to the first full result
+    // Partial results
+    static const int32 kPartialStableFrames = 50; // ~1.5s, only MBR words older than this are kept
+    IncrementalPartialMbr partial_mbr_;
+    int32 partial_frames_ = -1; // NumFramesDecoded() when partial_result_ was computed
+    string partial_result_;
+    // Voice activity gating, see Model::vad_opts_
+    VoiceActivityGate *vad_ = nullptr;
+    std::vector<VoiceActivityRun> vad_runs_;
+    Vector<BaseFloat> vad_lookback_;
+    // Search limits under CPU pressure, see Model::governor_opts_
+    RtfGovernor *governor_ = nullptr;
+    string search_params_json_;
+    // Counters, kept across Reset(), started over when the pool hands the recognizer out
+    RecognizerStats stats_;
+    string stats_json_;
 
 
     float sampling_frequency_;
     int32 frame_offset_;
     int64 samples_processed_;
     int64 samples_round_start_;
+    int64 samples_skipped_; // dropped by the gate since the current feature pipeline started
     RecognizerState state_;
 
+    Vector<BaseFloat> wave_buffer_; // reused int16 -> float conversion buffer, only grows
+
     int max_alternatives_ = 0; // Disable alternatives by default
     bool words_ = false;
     bool partial_words_ = false;
     bool nlsml_ = false;
+    bool json_ = true;
+    bool pooled_ = false; // idle in the model's pool, holds no reference on the model
     string last_result_;
+    std::vector<ResultWord> result_words_;
+
+    friend class Model; // recognizer pool
 
 };
 
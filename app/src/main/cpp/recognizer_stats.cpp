@@ -0,0 +1,56 @@
+#include "recognizer_stats.h"
+#include "json.h"
+
+static const char *kStageNames[NUM_RECOGNIZER_STAGES] = {
+        "features", "nnet", "search", "determinize", "rescore", "rnnlm", "mbr"
+};
+
+RecognizerStats::RecognizerStats() {
+    for (int i = 0; i < NUM_RECOGNIZER_STAGES; i++) {
+        seconds[i] = 0;
+        calls[i] = 0;
+    }
+}
+
+void RecognizerStats::AddTokens(int32 num_tokens) {
+    token_samples++;
+    tokens += num_tokens;
+    max_tokens = std::max<int64>(max_tokens, num_tokens);
+}
+
+void RecognizerStats::AddLattice(const CompactLattice &clat) {
+    int64 num_states = clat.NumStates();
+    lattices++;
+    lattice_states += num_states;
+    for (int64 s = 0; s < num_states; s++) {
+        lattice_arcs += clat.NumArcs(s);
+    }
+    max_lattice_states = std::max(max_lattice_states, num_states);
+}
+
+string RecognizerStats::ToJson() const {
+    json::JSON obj;
+    obj["samples"] = samples;
+    obj["skipped_samples"] = skipped_samples;
+    obj["frames"] = frames;
+    obj["active_tokens_mean"] = token_samples > 0 ? static_cast<double>(tokens) / token_samples : 0.0;
+    obj["active_tokens_max"] = max_tokens;
+    obj["lattices"] = lattices;
+    obj["lattice_states"] = lattice_states;
+    obj["lattice_arcs"] = lattice_arcs;
+    obj["lattice_states_max"] = max_lattice_states;
+    obj["arena"]["tokens_allocated"] = token_arena.allocated;
+    obj["arena"]["tokens_freed"] = token_arena.freed;
+    obj["arena"]["tokens_live_max"] = token_arena.max_live;
+    obj["arena"]["links_allocated"] = link_arena.allocated;
+    obj["arena"]["links_freed"] = link_arena.freed;
+    obj["arena"]["links_live_max"] = link_arena.max_live;
+    obj["arena"]["bytes"] = token_arena.bytes + link_arena.bytes;
+    for (int i = 0; i < NUM_RECOGNIZER_STAGES; i++) {
+        json::JSON stage;
+        stage["seconds"] = seconds[i];
+        stage["calls"] = calls[i];
+        obj["stages"][kStageNames[i]] = stage;
+    }
+    return obj.dump();
+}
@@ -0,0 +1,59 @@
+#ifndef KALDIANDROID_RECOGNIZER_STATS_H
+#define KALDIANDROID_RECOGNIZER_STATS_H
+
+#include "kaldi.h"
+#include "token_arena.h"
+
+using namespace kaldi;
+
+enum RecognizerStage {
+    STAGE_FEATURES,    // feature extraction and silence weighting in AcceptWaveform
+    STAGE_NNET,        // nnet3 chunks, with the CMVN and iVector frames they pull in
+    STAGE_SEARCH,      // token passing, with the incremental determinization the decoder runs between chunks
+    STAGE_DETERMINIZE, // determinizing the rest of the lattice for a result or partial
+    STAGE_RESCORE,     // G.fst subtraction and CARPA
+    STAGE_RNNLM,
+    STAGE_MBR,         // word alignment, MBR or n-best
+    NUM_RECOGNIZER_STAGES
+};
+
+// Counters of one recognizer since it was created or taken from the model's
+// pool, cumulative so they can be shipped as monotonic metrics. Updating them
+// is a clock read per stage call.
+struct RecognizerStats {
+    double seconds[NUM_RECOGNIZER_STAGES];
+    int64 calls[NUM_RECOGNIZER_STAGES];
+    int64 samples = 0;
+    int64 skipped_samples = 0; // dropped by the voice activity gate, never decoded
+    int64 frames = 0;         // output frames decoded
+    int64 token_samples = 0;  // active tokens are sampled on the last frame of every decoder advance
+    int64 tokens = 0;
+    int64 max_tokens = 0;
+    int64 lattices = 0;       // lattices determinized for results; partials are not walked
+    int64 lattice_states = 0;
+    int64 lattice_arcs = 0;
+    int64 max_lattice_states = 0;
+    SlabPoolStats token_arena; // tokens and forward links of the search
+    SlabPoolStats link_arena;
+
+    RecognizerStats();
+    void AddTokens(int32 num_tokens);
+    void AddLattice(const CompactLattice &clat);
+    string ToJson() const;
+};
+
+// Adds the time of a scope to one stage
+class StageTimer {
+public:
+    StageTimer(RecognizerStats *stats, RecognizerStage stage) : stats_(stats), stage_(stage) {}
+    ~StageTimer() {
+        stats_->seconds[stage_] += timer_.Elapsed();
+        stats_->calls[stage_]++;
+    }
+private:
+    RecognizerStats *stats_;
+    RecognizerStage stage_;
+    Timer timer_;
+};
+
+#endif // KALDIANDROID_RECOGNIZER_STATS_H
@@ -0,0 +1,132 @@
+#include "kwang_client.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <string>
+
+#include "remote_io.h"
+#include "remote_protocol.h"
+
+struct RemoteRecognizer {
+    int fd = -1;
+    int16_t *buffer = nullptr; // shared with the server
+    uint32_t buffer_samples = 0;
+    std::string result;
+
+    ~RemoteRecognizer() {
+        if (buffer != nullptr) {
+            munmap(buffer, buffer_samples * sizeof(int16_t));
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Sends one request and reads its reply, result text goes to this->result
+    bool Call(uint32_t type, int32_t arg, int32_t *status) {
+        RemoteRequest request;
+        request.type = type;
+        request.arg = arg;
+        RemoteReply reply;
+        if (!RemoteWriteAll(fd, &request, sizeof(request)) ||
+            !RemoteReadAll(fd, &reply, sizeof(reply))) {
+            return false;
+        }
+        result.resize(reply.length);
+        if (reply.length > 0 && !RemoteReadAll(fd, &result[0], reply.length)) {
+            return false;
+        }
+        *status = reply.status;
+        return true;
+    }
+
+    const char *CallResult(uint32_t type) {
+        int32_t status;
+        if (!Call(type, 0, &status)) {
+            result.clear();
+        }
+        return result.c_str();
+    }
+};
+
+VRemoteRecognizer *kwang_remote_recognizer_new(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return nullptr;
+    }
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    RemoteRecognizer *recognizer = new RemoteRecognizer();
+    recognizer->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    RemoteHello hello;
+    int shm_fd = -1;
+    if (recognizer->fd < 0 ||
+        connect(recognizer->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        !RemoteRecvWithFd(recognizer->fd, &hello, sizeof(hello), &shm_fd) ||
+        hello.magic != KWANG_REMOTE_MAGIC || hello.version != KWANG_REMOTE_VERSION ||
+        hello.status != 0 || shm_fd < 0) {
+        if (shm_fd >= 0) close(shm_fd);
+        delete recognizer;
+        return nullptr;
+    }
+    void *buffer = mmap(nullptr, hello.buffer_samples * sizeof(int16_t),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (buffer == MAP_FAILED) {
+        delete recognizer;
+        return nullptr;
+    }
+    recognizer->buffer = static_cast<int16_t *>(buffer);
+    recognizer->buffer_samples = hello.buffer_samples;
+    return (VRemoteRecognizer *)recognizer;
+}
+
+void kwang_remote_recognizer_free(VRemoteRecognizer *recognizer)
+{
+    delete (RemoteRecognizer *)recognizer;
+}
+
+void kwang_remote_recognizer_reset(VRemoteRecognizer *recognizer)
+{
+    int32_t status;
+    ((RemoteRecognizer *)recognizer)->Call(REMOTE_RESET, 0, &status);
+}
+
+int kwang_remote_recognizer_accept_waveform_s(VRemoteRecognizer *recognizer, const short *data, int length)
+{
+    RemoteRecognizer *r = (RemoteRecognizer *)recognizer;
+    int ret = 0;
+    // the server reads the buffer before replying, so it can be refilled right after
+    for (int offset = 0; offset < length; ) {
+        int n = std::min<int>(length - offset, r->buffer_samples);
+        memcpy(r->buffer, data + offset, n * sizeof(int16_t));
+        int32_t status;
+        if (!r->Call(REMOTE_ACCEPT, n, &status) || status < 0) {
+            return -1;
+        }
+        ret = ret || status; // endpoint in any piece
+        offset += n;
+    }
+    return ret;
+}
+
+const char *kwang_remote_recognizer_result(VRemoteRecognizer *recognizer)
+{
+    return ((RemoteRecognizer *)recognizer)->CallResult(REMOTE_RESULT);
+}
+
+const char *kwang_remote_recognizer_partial_result(VRemoteRecognizer *recognizer)
+{
+    return ((RemoteRecognizer *)recognizer)->CallResult(REMOTE_PARTIAL);
+}
+
+const char *kwang_remote_recognizer_final_result(VRemoteRecognizer *recognizer)
+{
+    return ((RemoteRecognizer *)recognizer)->CallResult(REMOTE_FINAL);
+}
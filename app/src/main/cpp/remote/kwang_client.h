@@ -0,0 +1,31 @@
+#ifndef KALDIANDROID_KWANG_CLIENT_H
+#define KALDIANDROID_KWANG_CLIENT_H
+
+// Client side of kwang_model_server. Mirrors the recognizer part of
+// kwang_api.h, but the model lives in the server process, so this library has
+// no Kaldi dependency and adds no model memory to the client.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct VRemoteRecognizer VRemoteRecognizer;
+
+/* Connects to the server socket, nullptr if the server is not reachable */
+VRemoteRecognizer *kwang_remote_recognizer_new(const char *socket_path);
+void kwang_remote_recognizer_free(VRemoteRecognizer *recognizer);
+void kwang_remote_recognizer_reset(VRemoteRecognizer *recognizer);
+
+/* Same return values as kwang_recognizer_accept_waveform_s, -1 on connection errors */
+int kwang_remote_recognizer_accept_waveform_s(VRemoteRecognizer *recognizer, const short *data, int length);
+
+/* Valid until the next call on the same recognizer */
+const char *kwang_remote_recognizer_result(VRemoteRecognizer *recognizer);
+const char *kwang_remote_recognizer_partial_result(VRemoteRecognizer *recognizer);
+const char *kwang_remote_recognizer_final_result(VRemoteRecognizer *recognizer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KALDIANDROID_KWANG_CLIENT_H
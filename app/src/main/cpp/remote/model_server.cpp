@@ -0,0 +1,196 @@
+// Local model server. Loads one model and serves recognizers to other processes
+// over a Unix-domain socket, so N clients share one copy of the acoustic model,
+// graph and language models instead of each loading their own.
+//
+//   kwang_model_server <model-dir> <socket-path> [buffer-seconds]
+//
+// Clients use kwang_client.h. Each connection gets its own Recognizer and
+// decode thread on the server. The socket is created with mode 0660, so only
+// processes of the server's user or group can connect.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "../kwang_api.h"
+#include "remote_io.h"
+#include "remote_protocol.h"
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+// Anonymous shared memory that can be handed to another process. Its size is
+// sealed: a client that could shrink it would make the server read past the
+// end of its mapping and die of SIGBUS, with every other client's session.
+// There is no fallback to a file under /dev/shm, which cannot be sealed.
+static int CreateSharedBuffer(size_t size) {
+    int fd = -1;
+#ifdef SYS_memfd_create
+    fd = syscall(SYS_memfd_create, "kwang-audio", 1 | 2 /* MFD_CLOEXEC | MFD_ALLOW_SEALING */);
+#endif
+    if (fd >= 0 && (ftruncate(fd, size) != 0 ||
+                    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void ServeClient(VModel *model, int fd, uint32_t buffer_samples) {
+    size_t buffer_size = buffer_samples * sizeof(int16_t);
+    int shm_fd = CreateSharedBuffer(buffer_size);
+    void *shm = MAP_FAILED;
+    if (shm_fd >= 0) {
+        shm = mmap(nullptr, buffer_size, PROT_READ, MAP_SHARED, shm_fd, 0);
+    } else {
+        perror("kwang_model_server: sealed memfd");
+    }
+    VRecognizer *recognizer = shm != MAP_FAILED ? kwang_model_acquire_recognizer(model) : nullptr;
+
+    RemoteHello hello;
+    hello.magic = KWANG_REMOTE_MAGIC;
+    hello.version = KWANG_REMOTE_VERSION;
+    hello.buffer_samples = buffer_samples;
+    hello.status = recognizer ? 0 : -1;
+    bool ok = RemoteSendWithFd(fd, &hello, sizeof(hello), recognizer ? shm_fd : -1);
+    if (shm_fd >= 0) {
+        close(shm_fd); // the mapping and the client's copy keep it alive
+    }
+
+    RemoteRequest request;
+    while (ok && recognizer && RemoteReadAll(fd, &request, sizeof(request))) {
+        RemoteReply reply;
+        reply.status = 0;
+        reply.length = 0;
+        const char *text = nullptr;
+        switch (request.type) {
+            case REMOTE_ACCEPT:
+                if (request.arg < 0 || static_cast<uint32_t>(request.arg) > buffer_samples) {
+                    reply.status = -1;
+                } else {
+                    reply.status = kwang_recognizer_accept_waveform_s(
+                            recognizer, static_cast<const short *>(shm), request.arg);
+                }
+                break;
+            case REMOTE_RESULT:
+                text = kwang_recognizer_result(recognizer);
+                break;
+            case REMOTE_PARTIAL:
+                text = kwang_recognizer_partial_result(recognizer);
+                break;
+            case REMOTE_FINAL:
+                text = kwang_recognizer_final_result(recognizer);
+                break;
+            case REMOTE_RESET:
+                kwang_recognizer_reset(recognizer);
+                break;
+            default:
+                reply.status = -1;
+                break;
+        }
+        if (text != nullptr) {
+            reply.length = strlen(text);
+        }
+        ok = RemoteWriteAll(fd, &reply, sizeof(reply)) &&
+             (reply.length == 0 || RemoteWriteAll(fd, text, reply.length));
+    }
+
+    kwang_recognizer_release(recognizer); // the next connection reuses it
+    if (shm != MAP_FAILED) {
+        munmap(shm, buffer_size);
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <model-dir> <socket-path> [buffer-seconds]\n", argv[0]);
+        return 1;
+    }
+    float buffer_seconds = argc > 3 ? atof(argv[3]) : 1.0f;
+    uint32_t buffer_samples = static_cast<uint32_t>(16000 * (buffer_seconds > 0 ? buffer_seconds : 1.0f));
+    signal(SIGPIPE, SIG_IGN);
+
+    VModel *model = kwang_model_new(argv[1]);
+    if (model == nullptr) {
+        fprintf(stderr, "Failed to load model from %s\n", argv[1]);
+        return 1;
+    }
+    kwang_model_preload_rescoring(model); // a long running server should not make its first client wait
+    kwang_model_prewarm_recognizers(model, 4);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[2]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", argv[2]);
+        return 1;
+    }
+    strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+    // only remove a stale socket left by an earlier server, never some other
+    // file nor the socket of a server still listening on it
+    struct stat st;
+    if (lstat(argv[2], &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Not a socket, refusing to replace: %s\n", argv[2]);
+            return 1;
+        }
+        int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int connected = probe_fd < 0 ? -1 : connect(probe_fd, (struct sockaddr *)&addr, sizeof(addr));
+        int probe_errno = errno;
+        if (probe_fd >= 0) {
+            close(probe_fd);
+        }
+        if (connected == 0) {
+            fprintf(stderr, "Another server is already serving on %s\n", argv[2]);
+            return 1;
+        }
+        if (probe_errno != ECONNREFUSED) {
+            fprintf(stderr, "Cannot probe %s, refusing to replace it: %s\n", argv[2], strerror(probe_errno));
+            return 1;
+        }
+        unlink(argv[2]);
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // the socket is created with mode 0660: only the server's user and group may connect
+    mode_t old_mask = umask(0117);
+    int bound = listen_fd < 0 ? -1 : bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (listen_fd < 0 || bound != 0 || listen(listen_fd, 64) != 0) {
+        perror("kwang_model_server: socket");
+        return 1;
+    }
+    fprintf(stderr, "Serving %s on %s\n", argv[1], argv[2]);
+
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("kwang_model_server: accept");
+            break;
+        }
+        // recognizers hold a reference on the model, so sessions never outlive it
+        std::thread(ServeClient, model, fd, buffer_samples).detach();
+    }
+
+    close(listen_fd);
+    unlink(argv[2]);
+    kwang_model_free(model);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef KALDIANDROID_REMOTE_IO_H
+#define KALDIANDROID_REMOTE_IO_H
+
+// Socket helpers shared by the model server and the client library
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Returns false on error or when the peer closed the connection
+static inline bool RemoteWriteAll(int fd, const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static inline bool RemoteReadAll(int fd, void *data, size_t len) {
+    char *p = static_cast<char *>(data);
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Sends data with a file descriptor attached, or without one if pass_fd < 0
+static inline bool RemoteSendWithFd(int fd, const void *data, size_t len, int pass_fd) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    struct iovec iov;
+    iov.iov_base = const_cast<void *>(data);
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (pass_fd >= 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(len);
+}
+
+// Receives exactly len bytes (sent in one message) and the attached descriptor,
+// *recv_fd is -1 if none was attached
+static inline bool RemoteRecvWithFd(int fd, void *data, size_t len, int *recv_fd) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    *recv_fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n > 0 && cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(recv_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (n <= 0) return false;
+    // the rest of a short read carries no descriptor
+    return static_cast<size_t>(n) == len ||
+           RemoteReadAll(fd, static_cast<char *>(data) + n, len - n);
+}
+
+#endif // KALDIANDROID_REMOTE_IO_H
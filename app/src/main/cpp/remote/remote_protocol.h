@@ -0,0 +1,43 @@
+#ifndef KALDIANDROID_REMOTE_PROTOCOL_H
+#define KALDIANDROID_REMOTE_PROTOCOL_H
+
+// Wire protocol between kwang_model_server and kwang_client.
+//
+// One Unix-domain stream connection is one recognizer. Right after accept the
+// server sends a RemoteHello together with the file descriptor of a shared
+// memory buffer (SCM_RIGHTS). The client maps it, writes 16-bit samples to the
+// start of it and sends REMOTE_ACCEPT with the sample count; audio never goes
+// through the socket. Every request gets exactly one RemoteReply, followed by
+// `length` bytes of JSON for the result requests.
+
+#include <stdint.h>
+
+#define KWANG_REMOTE_MAGIC 0x6b77616eu // "kwan"
+#define KWANG_REMOTE_VERSION 1
+
+enum RemoteRequestType {
+    REMOTE_ACCEPT = 1,   // arg = number of samples in the shared buffer
+    REMOTE_RESULT = 2,
+    REMOTE_PARTIAL = 3,
+    REMOTE_FINAL = 4,
+    REMOTE_RESET = 5
+};
+
+struct RemoteHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t buffer_samples; // capacity of the shared buffer in int16 samples
+    int32_t status;          // 0 ok, < 0 the server could not create a recognizer
+};
+
+struct RemoteRequest {
+    uint32_t type;
+    int32_t arg;
+};
+
+struct RemoteReply {
+    int32_t status;  // AcceptWaveform return value for REMOTE_ACCEPT, -1 on error
+    uint32_t length; // bytes of result text that follow
+};
+
+#endif // KALDIANDROID_REMOTE_PROTOCOL_H
@@ -0,0 +1,50 @@
+#include "rtf_governor.h"
+
+RtfGovernor::RtfGovernor(const RtfGovernorOptions &opts, const LatticeIncrementalDecoderConfig &config)
+        : opts_(opts),
+          max_beam_(config.beam),
+          max_max_active_(config.max_active),
+          max_lattice_beam_(config.lattice_beam) {
+    point_.rtf = 0;
+    SetLevel(0);
+}
+
+bool RtfGovernor::Update(double decode_seconds, double audio_seconds) {
+    decode_seconds_ += decode_seconds;
+    audio_seconds_ += audio_seconds;
+    if (audio_seconds_ < opts_.update_seconds) {
+        return false;
+    }
+    BaseFloat rtf = decode_seconds_ / audio_seconds_;
+    decode_seconds_ = audio_seconds_ = 0;
+    point_.rtf = rtf;
+
+    BaseFloat level = point_.level;
+    if (rtf > opts_.rt_max) {
+        level += std::min(opts_.max_update, opts_.update * (rtf - opts_.rt_max) / opts_.rt_max);
+    } else if (rtf < opts_.rt_min) {
+        level -= std::min(opts_.max_update, opts_.update * (opts_.rt_min - rtf) / opts_.rt_min);
+    }
+    level = std::max<BaseFloat>(0, std::min<BaseFloat>(1, level));
+    if (level == point_.level) {
+        return false;
+    }
+    SetLevel(level);
+    KALDI_VLOG(1) << "RTF " << rtf << ", search level " << level << ": beam=" << point_.beam
+                  << " max-active=" << point_.max_active << " lattice-beam=" << point_.lattice_beam;
+    return true;
+}
+
+void RtfGovernor::SetLevel(BaseFloat level) {
+    // a bound looser than the model config leaves that parameter alone
+    BaseFloat min_beam = std::min(opts_.min_beam, max_beam_);
+    BaseFloat min_lattice_beam = std::min(opts_.min_lattice_beam, max_lattice_beam_);
+    int32 min_max_active = std::max(1, std::min(opts_.min_max_active, max_max_active_));
+
+    point_.level = level;
+    point_.beam = max_beam_ - level * (max_beam_ - min_beam);
+    point_.lattice_beam = max_lattice_beam_ - level * (max_lattice_beam_ - min_lattice_beam);
+    double max_active = max_max_active_ * std::pow(static_cast<double>(min_max_active) / max_max_active_, level);
+    point_.max_active = static_cast<int32>(std::max<double>(min_max_active,
+                                                            std::min<double>(max_max_active_, max_active + 0.5)));
+}
@@ -0,0 +1,72 @@
+#ifndef KALDIANDROID_RTF_GOVERNOR_H
+#define KALDIANDROID_RTF_GOVERNOR_H
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+struct RtfGovernorOptions {
+    bool enabled = false;
+    BaseFloat rt_min = 0.6;          // below, the search is relaxed back towards the model config
+    BaseFloat rt_max = 0.9;          // above, the stream is about to lag and the search is tightened
+    BaseFloat update_seconds = 1.0;  // audio decoded between two updates
+    BaseFloat update = 0.1;          // step of the level, scaled by how far the RTF is out of range
+    BaseFloat max_update = 0.25;     // largest step of the level in one update
+    BaseFloat min_beam = 8.0;        // the tightest point, the model config is the loosest
+    int32 min_max_active = 1000;
+    BaseFloat min_lattice_beam = 3.0;
+
+    void Register(OptionsItf *opts) {
+        opts->Register("rtf-governor", &enabled, "Tighten beam, max-active and lattice-beam of a recognizer "
+                                                 "when it decodes slower than real time, relax them again "
+                                                 "when it has headroom");
+        opts->Register("rtf-governor-rt-min", &rt_min, "Real-time factor below which the search is relaxed");
+        opts->Register("rtf-governor-rt-max", &rt_max, "Real-time factor above which the search is tightened");
+        opts->Register("rtf-governor-update-seconds", &update_seconds,
+                       "Audio over which the real-time factor is measured for one update");
+        opts->Register("rtf-governor-update", &update,
+                       "Rate of adjustment, relative to how far the real-time factor is out of range");
+        opts->Register("rtf-governor-max-update", &max_update, "Maximum adjustment in one update");
+        opts->Register("rtf-governor-min-beam", &min_beam, "Lowest beam the governor goes to");
+        opts->Register("rtf-governor-min-max-active", &min_max_active, "Lowest max-active the governor goes to");
+        opts->Register("rtf-governor-min-lattice-beam", &min_lattice_beam,
+                       "Lowest lattice-beam the governor goes to");
+    }
+};
+
+// Search parameters a recognizer decodes with
+struct SearchOperatingPoint {
+    BaseFloat beam;
+    int32 max_active;
+    BaseFloat lattice_beam;
+    BaseFloat level; // 0 at the model config, 1 at the --rtf-governor-min-* bounds
+    BaseFloat rtf;   // measured over the last update, 0 before the first
+};
+
+// Keeps one stream in real time under CPU pressure, after the beam update of
+// OnlineFasterDecoder (--rt-min, --rt-max in online/). Decode time is
+// measured against audio time; above rt_max the level goes up in proportion
+// to the excess, below rt_min it goes down. The level moves all three
+// parameters at once from the model config to the bounds, max_active
+// geometrically since tokens fall off roughly exponentially with cost.
+// The level is kept across utterances: the load of the host outlasts them.
+class RtfGovernor {
+public:
+    RtfGovernor(const RtfGovernorOptions &opts, const LatticeIncrementalDecoderConfig &config);
+    // decode_seconds spent on audio_seconds of audio, true when the operating
+    // point changed
+    bool Update(double decode_seconds, double audio_seconds);
+    const SearchOperatingPoint &Point() const { return point_; }
+private:
+    void SetLevel(BaseFloat level);
+
+    const RtfGovernorOptions &opts_;
+    BaseFloat max_beam_;
+    int32 max_max_active_;
+    BaseFloat max_lattice_beam_;
+    double decode_seconds_ = 0; // since the last update
+    double audio_seconds_ = 0;
+    SearchOperatingPoint point_;
+};
+
+#endif // KALDIANDROID_RTF_GOVERNOR_H
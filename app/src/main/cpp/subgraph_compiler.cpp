@@ -0,0 +1,119 @@
+#include "subgraph_compiler.h"
+
+#include <sstream>
+
+SubGraphCompiler::SubGraphCompiler(const TransitionModel &trans_model, ContextDependency *ctx_dep,
+                                   fst::VectorFst<fst::StdArc> *lexicon,
+                                   const std::vector<int32> &disambig_phones,
+                                   int32 nonterm_phones_offset, const fst::SymbolTable &word_syms)
+        : trans_model_(trans_model),
+          ctx_dep_(ctx_dep),
+          lexicon_(lexicon),
+          disambig_phones_(disambig_phones),
+          nonterm_phones_offset_(nonterm_phones_offset),
+          word_syms_(word_syms) {
+    if (ctx_dep_->ContextWidth() != 2 || ctx_dep_->CentralPosition() != 1) {
+        KALDI_ERR << "Sub-grammars need a left-biphone tree, this one has context width "
+                  << ctx_dep_->ContextWidth() << " and central position " << ctx_dep_->CentralPosition();
+    }
+    nonterm_begin_ = word_syms_.Find("#nonterm_begin");
+    nonterm_end_ = word_syms_.Find("#nonterm_end");
+    if (nonterm_begin_ == fst::kNoSymbol || nonterm_end_ == fst::kNoSymbol) {
+        KALDI_ERR << "No #nonterm_begin or #nonterm_end in the word symbols, "
+                     "the lang directory was not prepared with nonterminals";
+    }
+    // TableCompose matches the lexicon output against the grammar input
+    fst::ArcSort(lexicon_, fst::OLabelCompare<fst::StdArc>());
+}
+
+SubGraphCompiler::~SubGraphCompiler() {
+    delete ctx_dep_;
+    delete lexicon_;
+}
+
+void SubGraphCompiler::LookupPhrases(const std::vector<string> &phrases,
+                                     std::vector<std::vector<int32> > *ids) const {
+    ids->clear();
+    for (size_t i = 0; i < phrases.size(); i++) {
+        std::istringstream is(phrases[i]);
+        std::vector<int32> words;
+        string word;
+        bool known = true;
+        while (is >> word) {
+            int32 id = word_syms_.Find(word);
+            if (id == fst::kNoSymbol) {
+                KALDI_WARN << "Word '" << word << "' is not in the lexicon, skipping phrase '"
+                           << phrases[i] << "'";
+                known = false;
+                break;
+            }
+            words.push_back(id);
+        }
+        if (known && !words.empty()) {
+            ids->push_back(words);
+        }
+    }
+}
+
+// #nonterm_begin, one word path per phrase from a shared start, #nonterm_end.
+// The markers only go into the search, they have no output.
+void SubGraphCompiler::MakeGrammar(const std::vector<std::vector<int32> > &phrases,
+                                   fst::VectorFst<fst::StdArc> *G) const {
+    typedef fst::StdArc Arc;
+    G->DeleteStates();
+    int32 start = G->AddState(), body = G->AddState(), end = G->AddState(), final = G->AddState();
+    G->SetStart(start);
+    G->SetFinal(final, Arc::Weight::One());
+    G->AddArc(start, Arc(nonterm_begin_, 0, Arc::Weight::One(), body));
+    G->AddArc(end, Arc(nonterm_end_, 0, Arc::Weight::One(), final));
+    if (phrases.empty()) {
+        G->AddArc(body, Arc(0, 0, Arc::Weight::One(), end));
+    }
+    Arc::Weight phrase_cost(Log(static_cast<BaseFloat>(std::max<size_t>(phrases.size(), 1))));
+    for (size_t i = 0; i < phrases.size(); i++) {
+        int32 state = body;
+        for (size_t j = 0; j < phrases[i].size(); j++) {
+            int32 next = j + 1 == phrases[i].size() ? end : G->AddState();
+            int32 word = phrases[i][j];
+            G->AddArc(state, Arc(word, word, j == 0 ? phrase_cost : Arc::Weight::One(), next));
+            state = next;
+        }
+    }
+    fst::ArcSort(G, fst::ILabelCompare<Arc>());
+}
+
+SubGraphPtr SubGraphCompiler::Compile(const std::vector<std::vector<int32> > &phrases) const {
+    Timer timer;
+    fst::VectorFst<fst::StdArc> G;
+    MakeGrammar(phrases, &G);
+
+    fst::VectorFst<fst::StdArc> LG;
+    fst::TableCompose(*lexicon_, G, &LG);
+    fst::DeterminizeStarInLog(&LG, fst::kDelta);
+    fst::MinimizeEncoded(&LG, fst::kDelta);
+
+    fst::VectorFst<fst::StdArc> CLG;
+    std::vector<std::vector<int32> > ilabels;
+    fst::ComposeContextLeftBiphone(nonterm_phones_offset_, disambig_phones_, LG, &CLG, &ilabels);
+    fst::ArcSort(&CLG, fst::ILabelCompare<fst::StdArc>());
+
+    HTransducerConfig h_config;
+    h_config.nonterm_phones_offset = nonterm_phones_offset_;
+    std::vector<int32> disambig_tids;
+    fst::VectorFst<fst::StdArc> *H = GetHTransducer(ilabels, *ctx_dep_, trans_model_, h_config,
+                                                    &disambig_tids);
+    fst::VectorFst<fst::StdArc> HCLG;
+    fst::TableCompose(*H, CLG, &HCLG);
+    delete H;
+    fst::DeterminizeStarInLog(&HCLG, fst::kDelta);
+    fst::RemoveSomeInputSymbols(disambig_tids, &HCLG);
+    fst::RemoveEpsLocal(&HCLG);
+    fst::MinimizeEncoded(&HCLG, fst::kDelta);
+    AddSelfLoops(trans_model_, disambig_tids, 1.0, true, true, &HCLG); // chain models, self-loop-scale 1.0
+
+    fst::PrepareForGrammarFst(nonterm_phones_offset_, &HCLG);
+    SubGraphPtr graph(new fst::ConstFst<fst::StdArc>(HCLG));
+    KALDI_VLOG(1) << "Compiled sub-graph of " << phrases.size() << " phrases, "
+                  << graph->NumStates() << " states in " << timer.Elapsed() << "s";
+    return graph;
+}
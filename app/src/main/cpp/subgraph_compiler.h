@@ -0,0 +1,52 @@
+#ifndef KALDIANDROID_SUBGRAPH_COMPILER_H
+#define KALDIANDROID_SUBGRAPH_COMPILER_H
+
+#include <memory>
+#include <vector>
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+typedef std::shared_ptr<const fst::ConstFst<fst::StdArc> > SubGraphPtr;
+
+// Builds the HCLG of one GrammarFst nonterminal from a list of phrases at
+// runtime, the same steps as compile-graph with --nonterm-phones-offset. Only
+// the small sub-grammar is composed, the top-level graph is left as it is, so
+// for a few hundred phrases this is milliseconds.
+//
+// The lang directory must have been prepared with nonterminals
+// (prepare_lang.sh with nonterminals.txt), and the tree must be left-biphone,
+// which GrammarFst requires anyway.
+class SubGraphCompiler {
+public:
+    // Takes ownership of lexicon, L_disambig.fst of that lang directory
+    SubGraphCompiler(const TransitionModel &trans_model, ContextDependency *ctx_dep,
+                     fst::VectorFst<fst::StdArc> *lexicon, const std::vector<int32> &disambig_phones,
+                     int32 nonterm_phones_offset, const fst::SymbolTable &word_syms);
+    ~SubGraphCompiler();
+
+    // Phrases are word ids, all alternatives equally likely. An empty list
+    // gives a sub-graph that matches no words at all, so the nonterminal is
+    // skipped. Safe to call from several threads, it only reads the lexicon.
+    SubGraphPtr Compile(const std::vector<std::vector<int32> > &phrases) const;
+
+    // Splits phrases into words of the lexicon, dropping phrases with unknown words
+    void LookupPhrases(const std::vector<string> &phrases, std::vector<std::vector<int32> > *ids) const;
+
+private:
+    void MakeGrammar(const std::vector<std::vector<int32> > &phrases, fst::VectorFst<fst::StdArc> *G) const;
+
+    const TransitionModel &trans_model_;
+    ContextDependency *ctx_dep_;
+    fst::VectorFst<fst::StdArc> *lexicon_;
+    std::vector<int32> disambig_phones_;
+    int32 nonterm_phones_offset_;
+    const fst::SymbolTable &word_syms_;
+    int32 nonterm_begin_; // word ids of #nonterm_begin and #nonterm_end
+    int32 nonterm_end_;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(SubGraphCompiler);
+};
+
+#endif // KALDIANDROID_SUBGRAPH_COMPILER_H
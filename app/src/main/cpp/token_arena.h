@@ -0,0 +1,141 @@
+#ifndef KALDIANDROID_TOKEN_ARENA_H
+#define KALDIANDROID_TOKEN_ARENA_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+struct SlabPoolStats {
+    int64 allocated = 0;
+    int64 freed = 0;    // one by one on pruning, or all at once by Release()
+    int64 max_live = 0;
+    int64 bytes = 0;    // reserved by the slabs, never given back before the pool goes
+};
+
+// Adds what a pool did since last to total: allocated and freed are summed,
+// max_live and bytes are the largest seen. last becomes current.
+inline void AccumulateSlabPoolStats(const SlabPoolStats &current, SlabPoolStats *last, SlabPoolStats *total) {
+    total->allocated += current.allocated - last->allocated;
+    total->freed += current.freed - last->freed;
+    total->max_live = std::max(total->max_live, current.max_live);
+    total->bytes = std::max(total->bytes, current.bytes);
+    *last = current;
+}
+
+// Objects of one type carved out of slabs. Delete() puts an object on a free
+// list that the next New() takes from, Release() drops all objects at once
+// and starts carving the same slabs again. Nothing goes back to the heap
+// before the pool is destroyed and no destructor is run, so T must be
+// trivially destructible. Not thread-safe.
+template <typename T>
+class SlabPool {
+    static_assert(std::is_trivially_destructible<T>::value, "SlabPool does not run destructors");
+public:
+    explicit SlabPool(size_t objects_per_slab = 4096) : objects_per_slab_(objects_per_slab) {}
+    ~SlabPool() {
+        for (size_t i = 0; i < slabs_.size(); i++) {
+            delete[] slabs_[i];
+        }
+    }
+
+    template <typename... Args>
+    T *New(Args &&... args) {
+        stats_.allocated++;
+        live_++;
+        stats_.max_live = std::max(stats_.max_live, live_);
+        if (heap_) {
+            return new T(std::forward<Args>(args)...);
+        }
+        Slot *slot = free_;
+        if (slot != nullptr) {
+            free_ = slot->next;
+        } else {
+            slot = Carve();
+        }
+        return new (&slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void Delete(T *object) {
+        stats_.freed++;
+        live_--;
+        if (heap_) {
+            delete object;
+            return;
+        }
+        Slot *slot = reinterpret_cast<Slot *>(object);
+        slot->next = free_;
+        free_ = slot;
+    }
+
+    // Every object handed out so far is gone
+    void Release() {
+        KALDI_ASSERT(!heap_ || live_ == 0);
+        free_ = next_ = end_ = nullptr;
+        slab_ = 0;
+        stats_.freed += live_;
+        live_ = 0;
+    }
+
+    int64 NumLive() const { return live_; }
+
+    // Every New() from operator new and every Delete() back to it, as if
+    // there were no pool; decoder_search_bench times the pool against it.
+    // Release() cannot free heap objects, they must all be deleted first.
+    void SetHeap(bool heap) {
+        KALDI_ASSERT(live_ == 0);
+        heap_ = heap;
+    }
+    bool Heap() const { return heap_; }
+    const SlabPoolStats &Stats() const { return stats_; }
+
+private:
+    union Slot {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    Slot *Carve() {
+        if (next_ == end_) {
+            if (slab_ == slabs_.size()) {
+                slabs_.push_back(new Slot[objects_per_slab_]);
+                stats_.bytes += objects_per_slab_ * sizeof(Slot);
+            }
+            next_ = slabs_[slab_++];
+            end_ = next_ + objects_per_slab_;
+        }
+        return next_++;
+    }
+
+    size_t objects_per_slab_;
+    std::vector<Slot *> slabs_;
+    size_t slab_ = 0;         // next slab to carve from
+    Slot *next_ = nullptr;    // rest of the slab being carved
+    Slot *end_ = nullptr;
+    Slot *free_ = nullptr;
+    int64 live_ = 0;
+    bool heap_ = false;
+    SlabPoolStats stats_;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(SlabPool);
+};
+
+// Token and forward-link storage of one search. Kept outside the decoder so
+// that a decoder recreated for another graph starts on warm slabs; only one
+// live decoder may use it at a time.
+struct TokenArena {
+    SlabPool<decoder::BackpointerToken> tokens;
+    SlabPool<decoder::ForwardLink<decoder::BackpointerToken> > links;
+
+    void SetHeap(bool heap) {
+        tokens.SetHeap(heap);
+        links.SetHeap(heap);
+    }
+    bool Heap() const { return tokens.Heap(); }
+};
+
+#endif // KALDIANDROID_TOKEN_ARENA_H
@@ -0,0 +1,238 @@
+#ifndef KALDIANDROID_TOKEN_TABLE_H
+#define KALDIANDROID_TOKEN_TABLE_H
+
+#include <vector>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "kaldi.h"
+
+using namespace kaldi;
+
+// Slots probed at once, 32 bytes of int32 keys
+static const size_t kTokenTableGroup = 8;
+
+// Bit i set where keys[i] == key, over a group of kTokenTableGroup keys
+static inline uint32 MatchTokenGroup(const int32 *keys, int32 key) {
+#if defined(__aarch64__)
+    static const uint32 kBits[4] = {1, 2, 4, 8};
+    int32x4_t k = vdupq_n_s32(key);
+    uint32x4_t bits = vld1q_u32(kBits);
+    uint32 low = vaddvq_u32(vandq_u32(vceqq_s32(vld1q_s32(keys), k), bits));
+    uint32 high = vaddvq_u32(vandq_u32(vceqq_s32(vld1q_s32(keys + 4), k), bits));
+    return low | (high << 4);
+#elif defined(__SSE2__)
+    __m128i k = _mm_set1_epi32(key);
+    __m128i low = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys)), k);
+    __m128i high = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + 4)), k);
+    return _mm_movemask_ps(_mm_castsi128_ps(low)) | (_mm_movemask_ps(_mm_castsi128_ps(high)) << 4);
+#else
+    uint32 mask = 0;
+    for (size_t i = 0; i < kTokenTableGroup; i++) {
+        mask |= static_cast<uint32>(keys[i] == key) << i;
+    }
+    return mask;
+#endif
+}
+
+// The states of a GrammarFst are 64 bits
+static inline uint32 MatchTokenGroup(const int64 *keys, int64 key) {
+    uint32 mask = 0;
+    for (size_t i = 0; i < kTokenTableGroup; i++) {
+        mask |= static_cast<uint32>(keys[i] == key) << i;
+    }
+    return mask;
+}
+
+// Map from FST state to the token of the frame being decoded, in place of
+// the HashList of the Kaldi decoders. Open addressing over a flat array of
+// keys probed a group of kTokenTableGroup at a time, the matching slot
+// holds the index of the entry; entries are kept contiguous in insertion
+// order, which is also the order the next frame visits them in. There is
+// no removal, the table is only emptied as a whole for the next frame.
+template <typename StateId, typename Token>
+class TokenTable {
+public:
+    struct Entry {
+        StateId state;
+        Token *tok;
+    };
+
+    TokenTable() { Rehash(kMinCapacity); }
+
+    const std::vector<Entry> &Entries() const { return entries_; }
+    size_t Capacity() const { return keys_.size(); }
+
+    // nullptr if state has no token
+    Entry *Find(StateId state) {
+        for (size_t group = Group(state); ; group = (group + kTokenTableGroup) & mask_) {
+            uint32 match = MatchTokenGroup(&keys_[group], state);
+            if (match != 0) {
+                return &entries_[slots_[group + __builtin_ctz(match)]];
+            }
+            // groups fill from the front and nothing is removed: a free slot
+            // means state was never placed further on
+            if (MatchTokenGroup(&keys_[group], kEmpty) != 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    // The entry of state, added with a null token if there was none. Only
+    // valid until the next Insert().
+    Entry *Insert(StateId state) {
+        if ((entries_.size() + 1) * 2 > keys_.size()) {
+            Rehash(keys_.size() * 2);
+        }
+        for (size_t group = Group(state); ; group = (group + kTokenTableGroup) & mask_) {
+            uint32 match = MatchTokenGroup(&keys_[group], state);
+            if (match != 0) {
+                return &entries_[slots_[group + __builtin_ctz(match)]];
+            }
+            uint32 free = MatchTokenGroup(&keys_[group], kEmpty);
+            if (free != 0) {
+                size_t slot = group + __builtin_ctz(free);
+                keys_[slot] = state;
+                slots_[slot] = static_cast<int32>(entries_.size());
+                used_.push_back(slot);
+                Entry entry = {state, nullptr};
+                entries_.push_back(entry);
+                return &entries_.back();
+            }
+        }
+    }
+
+    // Room for num_entries without growing, never shrinks
+    void Reserve(size_t num_entries) {
+        size_t capacity = keys_.size();
+        while (capacity < num_entries * 2) {
+            capacity *= 2;
+        }
+        if (capacity > keys_.size()) {
+            Rehash(capacity);
+        }
+        entries_.reserve(num_entries);
+        used_.reserve(num_entries);
+    }
+
+    // Empties the table for the next frame, its entries are swapped into
+    // *entries. Only the slots in use are freed, the capacity stays.
+    void Clear(std::vector<Entry> *entries) {
+        entries->swap(entries_);
+        entries_.clear();
+        for (size_t i = 0; i < used_.size(); i++) {
+            keys_[used_[i]] = kEmpty;
+        }
+        used_.clear();
+    }
+
+private:
+    static const size_t kMinCapacity = 64;
+    static const StateId kEmpty = -1; // fst::kNoStateId
+
+    // first slot of the group of state, Fibonacci hashing of the dense state ids
+    size_t Group(StateId state) const {
+        uint64 hash = static_cast<uint64>(state) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash >> shift_) & mask_ & ~(kTokenTableGroup - 1);
+    }
+
+    void Rehash(size_t capacity) {
+        keys_.assign(capacity, kEmpty);
+        slots_.resize(capacity);
+        used_.clear();
+        mask_ = capacity - 1;
+        shift_ = 64;
+        for (size_t c = capacity; c > 1; c >>= 1) {
+            shift_--;
+        }
+        for (size_t i = 0; i < entries_.size(); i++) {
+            size_t group = Group(entries_[i].state);
+            uint32 free;
+            while ((free = MatchTokenGroup(&keys_[group], kEmpty)) == 0) {
+                group = (group + kTokenTableGroup) & mask_;
+            }
+            size_t slot = group + __builtin_ctz(free);
+            keys_[slot] = entries_[i].state;
+            slots_[slot] = static_cast<int32>(i);
+            used_.push_back(slot);
+        }
+    }
+
+    std::vector<StateId> keys_; // kEmpty where free
+    std::vector<int32> slots_;  // index into entries_ of the key in the same slot
+    std::vector<size_t> used_;  // slots holding a key, for Clear()
+    std::vector<Entry> entries_;
+    size_t mask_ = 0;
+    int shift_ = 64;
+};
+
+template <typename StateId, typename Token>
+const size_t TokenTable<StateId, Token>::kMinCapacity;
+template <typename StateId, typename Token>
+const StateId TokenTable<StateId, Token>::kEmpty;
+
+// The interface of TokenTable over the HashList of the Kaldi decoders, which
+// maps each state to its entry. Only for decoder_search_bench, to time the
+// decoder with the Kaldi map but the TokenArena.
+template <typename StateId, typename Token>
+class HashListTokenTable {
+public:
+    typedef typename TokenTable<StateId, Token>::Entry Entry;
+
+    HashListTokenTable() { hash_.SetSize(kMinBuckets); }
+    ~HashListTokenTable() { DeleteElems(hash_.Clear()); }
+
+    const std::vector<Entry> &Entries() const { return entries_; }
+
+    Entry *Find(StateId state) {
+        typename HashList<StateId, int32>::Elem *elem = hash_.Find(state);
+        return elem != nullptr ? &entries_[elem->val] : nullptr;
+    }
+
+    Entry *Insert(StateId state) {
+        // the existing element if state is there already
+        typename HashList<StateId, int32>::Elem *elem = hash_.Insert(state, static_cast<int32>(entries_.size()));
+        if (static_cast<size_t>(elem->val) == entries_.size()) {
+            Entry entry = {state, nullptr};
+            entries_.push_back(entry);
+        }
+        return &entries_[elem->val];
+    }
+
+    // Twice as many buckets as entries, the default --hash-ratio
+    void Reserve(size_t num_entries) {
+        if (num_entries * 2 > hash_.Size()) {
+            hash_.SetSize(num_entries * 2);
+        }
+        entries_.reserve(num_entries);
+    }
+
+    void Clear(std::vector<Entry> *entries) {
+        entries->swap(entries_);
+        entries_.clear();
+        DeleteElems(hash_.Clear());
+    }
+
+private:
+    static const size_t kMinBuckets = 1000;
+
+    void DeleteElems(typename HashList<StateId, int32>::Elem *elem) {
+        while (elem != nullptr) {
+            typename HashList<StateId, int32>::Elem *tail = elem->tail;
+            hash_.Delete(elem);
+            elem = tail;
+        }
+    }
+
+    HashList<StateId, int32> hash_;
+    std::vector<Entry> entries_;
+};
+
+template <typename StateId, typename Token>
+const size_t HashListTokenTable<StateId, Token>::kMinBuckets;
+
+#endif // KALDIANDROID_TOKEN_TABLE_H
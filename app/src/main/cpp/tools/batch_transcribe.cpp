@@ -0,0 +1,194 @@
+// Offline transcription of an audio archive with one model shared by a pool of
+// worker threads, see BatchTranscriber.
+//
+//   batch_transcribe [options] <model-dir> <wav.scp|wav-dir> [output]
+//
+// wav.scp lines are "<key> <wav-file>" (or just the file), a directory is
+// scanned for *.wav. Writes "<key> <text>" per file in input order to output or
+// stdout, and the aggregate real-time factor to stderr. With --compare-streaming
+// the same files are also run through Recognizer::AcceptWaveform on as many
+// threads, and the speedup and the number of differing transcripts are reported.
+// The run fails when the batch side is not at least --min-speedup times faster;
+// both use the same threads, so this is also the gain per core.
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "../batch_transcriber.h"
+#include "../recognizer.h"
+#include "wav_list.h"
+
+static const int32 kStreamChunkSamples = 3200; // 0.2 s at 16 kHz per AcceptWaveform
+
+static void AppendWords(Model *model, const std::vector<ResultWord> &words, string *text) {
+    for (size_t i = 0; i < words.size(); i++) {
+        string word;
+        if (!model->WordSymbol(words[i].word, &word)) {
+            continue;
+        }
+        if (!text->empty()) {
+            *text += " ";
+        }
+        *text += word;
+    }
+}
+
+// The streaming path for the same files: one Recognizer per thread, audio fed
+// in 0.2 s chunks, the utterances of a file joined. Returns the wall time.
+static double StreamingTranscribe(Model *model, int32 num_threads,
+                                  const std::vector<std::pair<string, string> > &inputs,
+                                  std::vector<string> *texts) {
+    texts->assign(inputs.size(), "");
+    std::atomic<size_t> next(0);
+    Timer timer;
+    std::vector<std::thread> workers;
+    for (int32 t = 0; t < num_threads; t++) {
+        workers.push_back(std::thread([&]() {
+            Recognizer recognizer(model);
+            recognizer.SetJson(false);
+            for (size_t i = next++; i < inputs.size(); i = next++) {
+                WaveData wave;
+                try {
+                    std::ifstream is(inputs[i].second.c_str(), std::ios::binary);
+                    wave.Read(is);
+                } catch (const std::exception &) {
+                    continue; // counted as failed by the batch run
+                }
+                if (wave.Data().NumRows() == 0) {
+                    continue;
+                }
+                SubVector<BaseFloat> samples(wave.Data(), 0);
+                string &text = (*texts)[i];
+                for (int32 offset = 0; offset < samples.Dim(); offset += kStreamChunkSamples) {
+                    int32 len = std::min(kStreamChunkSamples, samples.Dim() - offset);
+                    if (recognizer.AcceptWaveform(samples.Data() + offset, len)) {
+                        recognizer.Result();
+                        AppendWords(model, recognizer.ResultWords(), &text);
+                    }
+                }
+                recognizer.FinalResult();
+                AppendWords(model, recognizer.ResultWords(), &text);
+                recognizer.Reset();
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    return timer.Elapsed();
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Transcribe whole wav files with a worker pool sharing one model.\n"
+                "Acoustic scale and frame subsampling come from the model.\n"
+                "\n"
+                "Usage: batch_transcribe [options] <model-dir> <wav.scp|wav-dir> [output]\n";
+        ParseOptions po(usage);
+        BatchTranscriberOptions opts;
+        bool compare_streaming = false;
+        BaseFloat min_speedup = 1.0;
+        opts.Register(&po);
+        po.Register("compare-streaming", &compare_streaming,
+                    "Also transcribe with Recognizer::AcceptWaveform on --num-threads threads "
+                    "and report the speedup and differing transcripts");
+        po.Register("min-speedup", &min_speedup,
+                    "With --compare-streaming, fail unless batch is at least this many times faster "
+                    "than streaming");
+        po.Read(argc, argv);
+        if (po.NumArgs() < 2 || po.NumArgs() > 3) {
+            po.PrintUsage();
+            return 1;
+        }
+
+        std::vector<std::pair<string, string> > inputs;
+        if (!ReadWavList(po.GetArg(2), &inputs)) {
+            KALDI_ERR << "Cannot read input list " << po.GetArg(2);
+        }
+
+        Timer load_timer;
+        Model *model = new Model(po.GetArg(1).c_str());
+        BatchTranscriber transcriber(model, opts);
+        KALDI_LOG << "Model loaded in " << load_timer.Elapsed() << " s";
+
+        Timer timer;
+        std::vector<BatchTranscriberResult> results;
+        transcriber.Run(inputs, &results);
+        double wall_seconds = timer.Elapsed();
+
+        std::ofstream file;
+        if (po.NumArgs() == 3) {
+            file.open(po.GetArg(3).c_str());
+            if (!file) {
+                KALDI_ERR << "Cannot write " << po.GetArg(3);
+            }
+        }
+        std::ostream &os = file.is_open() ? file : std::cout;
+        double audio_seconds = 0, worker_seconds = 0;
+        int32 num_failed = 0;
+        for (size_t i = 0; i < results.size(); i++) {
+            const BatchTranscriberResult &result = results[i];
+            if (!result.ok) {
+                num_failed++;
+                continue;
+            }
+            os << result.key << " " << result.text << "\n";
+            audio_seconds += result.audio_seconds;
+            worker_seconds += result.seconds;
+        }
+        os.flush();
+
+        // wall RTF is what the archive takes, per-thread RTF what one core does
+        KALDI_LOG << "Transcribed " << (results.size() - num_failed) << " files, "
+                  << num_failed << " failed, " << audio_seconds << " s of audio in "
+                  << wall_seconds << " s";
+        if (audio_seconds > 0) {
+            KALDI_LOG << "RTF " << wall_seconds / audio_seconds
+                      << ", per thread " << wall_seconds * opts.num_threads / audio_seconds
+                      << ", summed over files " << worker_seconds / audio_seconds;
+        }
+
+        bool too_slow = false;
+        if (compare_streaming) {
+            std::vector<string> streaming_texts;
+            double streaming_seconds = StreamingTranscribe(model, opts.num_threads, inputs,
+                                                           &streaming_texts);
+            int32 num_different = 0;
+            for (size_t i = 0; i < results.size(); i++) {
+                if (results[i].ok && results[i].text != streaming_texts[i]) {
+                    num_different++;
+                    KALDI_VLOG(1) << results[i].key << " batch: " << results[i].text
+                                  << " streaming: " << streaming_texts[i];
+                }
+            }
+            KALDI_LOG << "AcceptWaveform on " << opts.num_threads << " threads took "
+                      << streaming_seconds << " s";
+            if (audio_seconds > 0) {
+                KALDI_LOG << "Streaming RTF " << streaming_seconds / audio_seconds
+                          << ", batch speedup " << streaming_seconds / wall_seconds;
+            }
+            KALDI_LOG << num_different << " of " << (results.size() - num_failed)
+                      << " transcripts differ from the streaming ones";
+            // one line with everything a benchmark report needs
+            double speedup = wall_seconds > 0 ? streaming_seconds / wall_seconds : 0;
+            KALDI_LOG << "Summary: " << (results.size() - num_failed) << " files, " << audio_seconds
+                      << " s of audio, " << opts.num_threads << " threads, batch RTF "
+                      << (audio_seconds > 0 ? wall_seconds / audio_seconds : 0) << ", streaming RTF "
+                      << (audio_seconds > 0 ? streaming_seconds / audio_seconds : 0)
+                      << " (" << kStreamChunkSamples << "-sample chunks), speedup " << speedup;
+            if (speedup < min_speedup) {
+                KALDI_WARN << "Batch is only " << speedup << " times as fast as streaming, --min-speedup="
+                           << min_speedup;
+                too_slow = true;
+            }
+        }
+        model->Unref(); // the transcriber holds its own reference
+        return num_failed == 0 && !too_slow ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,130 @@
+// Search speed of IncrementalDecoder against the Kaldi decoder it derives
+// from, on the same graph and the same acoustic scores. Log-likelihoods are
+// read from an archive (e.g. the output of nnet3-compute) so that only the
+// search is timed: InitDecoding(), AdvanceDecoding() and FinalizeDecoding()
+// of every utterance, --repeat times. Reports frames per second for both and
+// checks that they find the same best path.
+//
+// IncrementalDecoder is also run with its TokenArena taking every token and
+// link from the heap, and with Kaldi's HashList in place of its TokenTable,
+// so the gains of the arena and of the table show apart.
+//
+//   decoder_search_bench [options] <final.mdl> <HCLG.fst> <loglikes-rspecifier>
+//
+// Convert HCLG to a ConstFst (fstconvert --fst_type=const) to time the graph
+// the recognizer decodes with.
+
+#include "../incremental_decoder.h"
+#include "util/table-types.h"
+
+struct SearchTotals {
+    double seconds = 0;
+    int64 frames = 0;
+};
+
+template <typename DEC>
+static void Search(DEC *decoder, DecodableInterface *decodable, int32 repeat, SearchTotals *totals,
+                   std::vector<int32> *words) {
+    for (int32 i = 0; i < repeat; i++) {
+        Timer timer;
+        decoder->InitDecoding();
+        decoder->AdvanceDecoding(decodable);
+        decoder->FinalizeDecoding();
+        totals->seconds += timer.Elapsed();
+        totals->frames += decoder->NumFramesDecoded();
+    }
+    Lattice best_path;
+    std::vector<int32> alignment;
+    LatticeWeight weight;
+    words->clear();
+    if (decoder->GetBestPath(&best_path, true)) {
+        fst::GetLinearSymbolSequence(best_path, &alignment, words, &weight);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Time the token search of IncrementalDecoder and of Kaldi's\n"
+                "LatticeIncrementalOnlineDecoder on precomputed log-likelihoods.\n"
+                "\n"
+                "Usage: decoder_search_bench [options] <final.mdl> <HCLG.fst> <loglikes-rspecifier>\n";
+        ParseOptions po(usage);
+        LatticeIncrementalDecoderConfig config;
+        config.Register(&po);
+        BaseFloat acoustic_scale = 1.0;
+        int32 repeat = 3;
+        po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+        po.Register("repeat", &repeat, "Times every utterance is decoded by each decoder");
+        po.Read(argc, argv);
+        if (po.NumArgs() != 3) {
+            po.PrintUsage();
+            return 1;
+        }
+        if (repeat < 1) repeat = 1;
+
+        TransitionModel trans_model;
+        ReadKaldiObject(po.GetArg(1), &trans_model);
+        fst::Fst<fst::StdArc> *fst = fst::Fst<fst::StdArc>::Read(po.GetArg(2));
+        if (!fst) {
+            KALDI_ERR << "Could not read FST from " << po.GetArg(2);
+        }
+        KALDI_LOG << "Decoding graph is a " << fst->Type() << " FST";
+
+        // the token storage stays warm from utterance to utterance, as in a recognizer
+        TokenArena arena;
+        IncrementalDecoder decoder(*fst, trans_model, config, &arena);
+        TokenArena heap_arena;
+        heap_arena.SetHeap(true);
+        IncrementalDecoder heap_decoder(*fst, trans_model, config, &heap_arena);
+        TokenArena hash_arena;
+        IncrementalDecoderTpl<fst::Fst<fst::StdArc>, HashListTokenTable> hash_decoder(*fst, trans_model, config,
+                                                                                      &hash_arena);
+        LatticeIncrementalOnlineDecoder kaldi_decoder(*fst, trans_model, config);
+
+        SearchTotals totals, heap_totals, hash_totals, kaldi_totals;
+        int32 num_utts = 0, num_differ = 0;
+        SequentialBaseFloatMatrixReader loglikes_reader(po.GetArg(3));
+        for (; !loglikes_reader.Done(); loglikes_reader.Next()) {
+            const Matrix<BaseFloat> &loglikes = loglikes_reader.Value();
+            if (loglikes.NumRows() == 0) {
+                continue;
+            }
+            DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+            std::vector<int32> words, heap_words, hash_words, kaldi_words;
+            Search(&kaldi_decoder, &decodable, repeat, &kaldi_totals, &kaldi_words);
+            Search(&heap_decoder, &decodable, repeat, &heap_totals, &heap_words);
+            Search(&hash_decoder, &decodable, repeat, &hash_totals, &hash_words);
+            Search(&decoder, &decodable, repeat, &totals, &words);
+            if (words != kaldi_words || heap_words != kaldi_words || hash_words != kaldi_words) {
+                KALDI_WARN << "Best paths differ for " << loglikes_reader.Key();
+                num_differ++;
+            }
+            num_utts++;
+        }
+        if (num_utts == 0 || totals.seconds == 0 || heap_totals.seconds == 0 || hash_totals.seconds == 0 ||
+            kaldi_totals.seconds == 0) {
+            KALDI_ERR << "Nothing decoded";
+        }
+
+        double fps = totals.frames / totals.seconds, kaldi_fps = kaldi_totals.frames / kaldi_totals.seconds;
+        double heap_fps = heap_totals.frames / heap_totals.seconds;
+        double hash_fps = hash_totals.frames / hash_totals.seconds;
+        KALDI_LOG << "Decoded " << num_utts << " utterances, " << totals.frames / repeat << " frames";
+        KALDI_LOG << "LatticeIncrementalOnlineDecoder " << kaldi_fps << " frames/s";
+        KALDI_LOG << "IncrementalDecoder, tokens from the heap " << heap_fps << " frames/s, x" <<
+                     heap_fps / kaldi_fps;
+        KALDI_LOG << "IncrementalDecoder, HashList in place of the table " << hash_fps << " frames/s, x" <<
+                     hash_fps / kaldi_fps;
+        KALDI_LOG << "IncrementalDecoder " << fps << " frames/s, x" << fps / kaldi_fps << ", arena x" <<
+                     fps / heap_fps << ", table x" << fps / hash_fps;
+        if (num_differ > 0) {
+            KALDI_WARN << "Best paths differ for " << num_differ << " of " << num_utts << " utterances";
+        }
+        delete fst;
+        return num_differ == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,79 @@
+// Loads a model directory several times through the C API and reports the
+// load time and resident memory growth of every stage, averaged over runs.
+//
+//   model_load_bench <model-dir> [num-runs]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../json.h"
+#include "../kwang_api.h"
+
+struct StageTotals {
+    double seconds = 0;
+    double seconds_min = 1e30;
+    double seconds_max = 0;
+    long rss_delta_kb = 0;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <model-dir> [num-runs]\n", argv[0]);
+        return 1;
+    }
+    int num_runs = argc > 2 ? atoi(argv[2]) : 5;
+    if (num_runs < 1) num_runs = 1;
+
+    std::vector<std::string> order; // stage names in load order
+    std::map<std::string, StageTotals> stages;
+    StageTotals total;
+    long peak_rss_kb = 0;
+
+    for (int run = 0; run < num_runs; run++) {
+        VModel *model = kwang_model_new(argv[1]);
+        if (model == nullptr) {
+            fprintf(stderr, "Failed to load model from %s\n", argv[1]);
+            return 1;
+        }
+        json::JSON stats = json::JSON::Load(kwang_model_load_stats(model));
+        kwang_model_free(model);
+
+        double seconds = stats["seconds"].ToFloat();
+        total.seconds += seconds;
+        total.seconds_min = std::min(total.seconds_min, seconds);
+        total.seconds_max = std::max(total.seconds_max, seconds);
+        total.rss_delta_kb += stats["rss_delta_kb"].ToInt();
+        peak_rss_kb = std::max(peak_rss_kb, stats["peak_rss_kb"].ToInt());
+
+        for (auto &stage : stats["stages"].ArrayRange()) {
+            std::string name = stage["name"].ToString();
+            if (stages.find(name) == stages.end()) {
+                order.push_back(name);
+            }
+            StageTotals &t = stages[name];
+            double s = stage["seconds"].ToFloat();
+            t.seconds += s;
+            t.seconds_min = std::min(t.seconds_min, s);
+            t.seconds_max = std::max(t.seconds_max, s);
+            t.rss_delta_kb += stage["rss_delta_kb"].ToInt();
+        }
+        fprintf(stderr, "run %d: %.3f s\n", run + 1, seconds);
+    }
+
+    // The first run pays for cold page cache and first-touch allocations, the
+    // min/max spread shows how much of a stage is I/O rather than CPU.
+    printf("%-20s %10s %10s %10s %12s\n", "stage", "mean_s", "min_s", "max_s", "rss_delta_kb");
+    for (const std::string &name : order) {
+        const StageTotals &t = stages[name];
+        printf("%-20s %10.4f %10.4f %10.4f %12ld\n", name.c_str(), t.seconds / num_runs,
+               t.seconds_min, t.seconds_max, t.rss_delta_kb / num_runs);
+    }
+    printf("%-20s %10.4f %10.4f %10.4f %12ld\n", "total", total.seconds / num_runs,
+           total.seconds_min, total.seconds_max, total.rss_delta_kb / num_runs);
+    printf("peak_rss_kb %ld\n", peak_rss_kb);
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Accuracy drift of the quantized acoustic model. Loads the model twice,
+// converts the second copy with Model::ConvertNnetWeights() to --weights
+// (int8, fp16 or bf16), transcribes the same files with both and reports how
+// far the quantized transcripts are from the float ones, and from a reference
+// if one is given, together with the RTF of each.
+//
+//   nnet_quantize_drift [options] <model-dir> <wav.scp|wav-dir> [reference-text]
+//
+// The reference text has "<key> <words>" lines. --verbose=1 logs the relative
+// weight error of every quantized layer while the model is converted.
+//
+// --fuse-nnet-layers also fuses the layers of the quantized side, after
+// checking file by file that the fused acoustic model output is bit-identical
+// to the unfused one with the same weights; any difference fails the run.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "../batch_transcriber.h"
+#include "util/edit-distance.h"
+#include "wav_list.h"
+
+static std::vector<string> Words(const string &text) {
+    std::istringstream is(text);
+    std::vector<string> words;
+    string word;
+    while (is >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+static bool ReadReference(const string &filename, std::map<string, std::vector<string> > *reference) {
+    std::ifstream is(filename.c_str());
+    if (!is) {
+        return false;
+    }
+    string line;
+    while (std::getline(is, line)) {
+        std::vector<string> words = Words(line);
+        if (!words.empty()) {
+            (*reference)[words[0]] = std::vector<string>(words.begin() + 1, words.end());
+        }
+    }
+    return true;
+}
+
+struct Transcription {
+    std::vector<BatchTranscriberResult> results;
+    double wall_seconds = 0;
+    double audio_seconds = 0;
+};
+
+static void Transcribe(Model *model, const BatchTranscriberOptions &opts,
+                       const std::vector<std::pair<string, string> > &inputs, Transcription *out) {
+    BatchTranscriber transcriber(model, opts);
+    Timer timer;
+    transcriber.Run(inputs, &out->results);
+    out->wall_seconds = timer.Elapsed();
+    for (size_t i = 0; i < out->results.size(); i++) {
+        out->audio_seconds += out->results[i].audio_seconds;
+    }
+}
+
+// Files whose looped acoustic model output differs in any bit between the two
+// models, or whose frame count does
+static int32 CompareNnetOutput(const Model &unfused, const Model &fused,
+                               const std::vector<std::pair<string, string> > &inputs) {
+    int32 num_different = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        WaveData wave;
+        try {
+            std::ifstream is(inputs[i].second.c_str(), std::ios::binary);
+            wave.Read(is);
+        } catch (const std::exception &) {
+            continue; // counted as failed by the transcription
+        }
+        if (wave.Data().NumRows() == 0) {
+            continue;
+        }
+        Matrix<BaseFloat> expected, output;
+        unfused.ComputeNnetOutput(wave, &expected);
+        fused.ComputeNnetOutput(wave, &output);
+        if (expected.NumRows() != output.NumRows() || expected.NumCols() != output.NumCols()) {
+            num_different++;
+            KALDI_WARN << inputs[i].first << ": fused acoustic model output is " << output.NumRows() << "x" <<
+                          output.NumCols() << ", unfused " << expected.NumRows() << "x" << expected.NumCols();
+            continue;
+        }
+        bool same = true;
+        for (MatrixIndexT r = 0; same && r < expected.NumRows(); r++) {
+            same = memcmp(expected.RowData(r), output.RowData(r), expected.NumCols() * sizeof(BaseFloat)) == 0;
+        }
+        if (!same) {
+            num_different++;
+            output.AddMat(-1.0, expected);
+            KALDI_WARN << inputs[i].first << ": fused acoustic model output differs, max abs difference " <<
+                          output.LargestAbsElem();
+        }
+    }
+    return num_different;
+}
+
+// word errors and reference words, over the files both sides have
+struct ErrorCount {
+    int64 errors = 0;
+    int64 words = 0;
+
+    void Add(const std::vector<string> &ref, const std::vector<string> &hyp) {
+        errors += LevenshteinEditDistance(ref, hyp);
+        words += ref.size();
+    }
+    BaseFloat Wer() const { return words > 0 ? 100.0 * errors / words : 0; }
+};
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Compare transcripts and speed of the quantized acoustic model against the float one.\n"
+                "model.conf must leave --nnet-weights at float, the tool converts its own copy.\n"
+                "\n"
+                "Usage: nnet_quantize_drift [options] <model-dir> <wav.scp|wav-dir> [reference-text]\n";
+        ParseOptions po(usage);
+        BatchTranscriberOptions opts;
+        opts.Register(&po);
+        string weights = "int8";
+        po.Register("weights", &weights, "Weights of the quantized side: int8, fp16 or bf16");
+        bool fuse_nnet_layers = false;
+        po.Register("fuse-nnet-layers", &fuse_nnet_layers,
+                    "Also fuse the layers of the quantized side, after checking that the fused acoustic "
+                    "model output is bit-identical to the unfused one");
+        po.Read(argc, argv);
+        if (po.NumArgs() < 2 || po.NumArgs() > 3) {
+            po.PrintUsage();
+            return 1;
+        }
+
+        std::vector<std::pair<string, string> > inputs;
+        if (!ReadWavList(po.GetArg(2), &inputs) || inputs.empty()) {
+            KALDI_ERR << "Cannot read input list " << po.GetArg(2);
+        }
+        std::map<string, std::vector<string> > reference;
+        if (po.NumArgs() == 3 && !ReadReference(po.GetArg(3), &reference)) {
+            KALDI_ERR << "Cannot read reference text " << po.GetArg(3);
+        }
+
+        Model *float_model = new Model(po.GetArg(1).c_str());
+        if (float_model->NnetWeights() != "float") {
+            KALDI_ERR << "model.conf sets --nnet-weights=" << float_model->NnetWeights() <<
+                         ", the float side needs --nnet-weights=float";
+        }
+        if (float_model->NnetLayersFused()) {
+            KALDI_ERR << "model.conf sets --fuse-nnet-layers, the float side needs it off";
+        }
+        WeightStorage storage;
+        if (!ParseWeightStorage(weights, &storage)) {
+            KALDI_ERR << "Unknown --weights=" << weights;
+        }
+        Model *quantized_model = new Model(po.GetArg(1).c_str());
+        if (!quantized_model->ConvertNnetWeights(weights)) {
+            KALDI_ERR << "This CPU cannot run the " << weights << " kernel " << WeightKernelName(storage);
+        }
+        if (fuse_nnet_layers) {
+            // the same weights unfused, so only the fusion can make a difference
+            Model *unfused_model = new Model(po.GetArg(1).c_str());
+            unfused_model->ConvertNnetWeights(weights);
+            int32 num_fused = quantized_model->FuseNnetLayers();
+            int32 num_different = CompareNnetOutput(*unfused_model, *quantized_model, inputs);
+            unfused_model->Unref();
+            KALDI_LOG << "Fused " << num_fused << " layers, output differs on " << num_different << " of " <<
+                         inputs.size() << " files";
+            if (num_different > 0) {
+                KALDI_ERR << "Fused acoustic model output is not bit-identical to the unfused one";
+            }
+        }
+
+        // one after the other, so the two do not compete for cores
+        Transcription float_run, quantized_run;
+        Transcribe(float_model, opts, inputs, &float_run);
+        Transcribe(quantized_model, opts, inputs, &quantized_run);
+        float_model->Unref();
+        quantized_model->Unref();
+
+        ErrorCount drift, float_errors, quantized_errors;
+        int32 num_changed = 0, num_failed = 0;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            const BatchTranscriberResult &f = float_run.results[i], &q = quantized_run.results[i];
+            if (!f.ok || !q.ok) {
+                num_failed++;
+                continue;
+            }
+            std::vector<string> float_words = Words(f.text), quantized_words = Words(q.text);
+            drift.Add(float_words, quantized_words);
+            if (float_words != quantized_words) {
+                num_changed++;
+                KALDI_VLOG(1) << f.key << "\n  float: " << f.text << "\n  " << weights << ":  " << q.text;
+            }
+            std::map<string, std::vector<string> >::const_iterator ref = reference.find(f.key);
+            if (ref != reference.end()) {
+                float_errors.Add(ref->second, float_words);
+                quantized_errors.Add(ref->second, quantized_words);
+            }
+        }
+
+        KALDI_LOG << weights << " kernel " << WeightKernelName(storage) << ", " << inputs.size() << " files, " <<
+                     num_failed << " failed, " << num_changed << " transcripts changed";
+        KALDI_LOG << "WER of " << weights << " against float " << drift.Wer() << "% (" << drift.errors << " / " <<
+                     drift.words << ")";
+        if (float_errors.words > 0) {
+            KALDI_LOG << "WER against the reference: float " << float_errors.Wer() << "%, " << weights << " " <<
+                         quantized_errors.Wer() << "% over " << float_errors.words << " words";
+        }
+        if (float_run.audio_seconds > 0 && quantized_run.audio_seconds > 0) {
+            KALDI_LOG << "RTF float " << float_run.wall_seconds / float_run.audio_seconds << ", " << weights << " " <<
+                         quantized_run.wall_seconds / quantized_run.audio_seconds;
+        }
+        return num_failed == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,257 @@
+// Real-time streaming load test. Replays wav files at 1x speed into N
+// recognizers sharing one model and reports latency percentiles and RTF, or
+// searches for the largest N that stays within the latency SLO.
+//
+//   stream_load_test [options] <model-dir> <wav.scp|wav-dir>
+//
+// Latencies, all wall clock:
+//   chunk          AcceptWaveform() of one chunk
+//   first-partial  from the moment the audio of the chunk was available to
+//                  the first non-empty PartialResult() of the utterance
+//   final          Result() at an endpoint or FinalResult() at the end of a file
+//   lag            how far a stream is behind real time at the end of a file
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "../recognizer.h"
+#include "wav_list.h"
+
+struct LoadTestOptions {
+    int32 num_streams = 0;      // fixed N, 0 searches
+    int32 max_streams = 256;
+    BaseFloat trial_seconds = 60; // audio per stream and trial
+    BaseFloat chunk_ms = 100;
+    int32 partial_every = 1;    // chunks between PartialResult() calls, 0 never
+    BaseFloat slo_chunk_p99_ms = 100;
+    BaseFloat slo_final_p95_ms = 500;
+    BaseFloat slo_max_lag = 1.0;
+
+    void Register(OptionsItf *po) {
+        po->Register("num-streams", &num_streams, "Run one trial with this many streams, 0 searches for the maximum");
+        po->Register("max-streams", &max_streams, "Upper bound of the search");
+        po->Register("trial-seconds", &trial_seconds, "Seconds of audio every stream replays per trial");
+        po->Register("chunk-ms", &chunk_ms, "Audio per AcceptWaveform() call");
+        po->Register("partial-every", &partial_every, "Chunks between PartialResult() calls, 0 for none");
+        po->Register("slo-chunk-p99-ms", &slo_chunk_p99_ms, "SLO on the p99 AcceptWaveform() latency");
+        po->Register("slo-final-p95-ms", &slo_final_p95_ms, "SLO on the p95 endpoint-to-final latency");
+        po->Register("slo-max-lag", &slo_max_lag, "SLO on how far any stream may fall behind real time, in seconds");
+    }
+};
+
+struct Utterance {
+    string key;
+    std::vector<short> samples;
+    BaseFloat sampling_frequency;
+};
+
+// Per stream, merged after the trial
+struct StreamStats {
+    std::vector<double> chunk_ms;
+    std::vector<double> first_partial_ms;
+    std::vector<double> final_ms;
+    double max_lag = 0;
+    double audio_seconds = 0;
+    double busy_seconds = 0; // time spent inside the recognizer
+};
+
+struct TrialResult {
+    int32 num_streams;
+    StreamStats stats;
+    bool pass;
+};
+
+static double Percentile(std::vector<double> *values, double p) {
+    if (values->empty()) {
+        return 0;
+    }
+    std::sort(values->begin(), values->end());
+    size_t rank = static_cast<size_t>(p / 100 * (values->size() - 1) + 0.5);
+    return (*values)[rank];
+}
+
+static void RunStream(Model *model, const std::vector<Utterance> &utterances, int32 stream,
+                      const LoadTestOptions &opts, OnlineTimingStats *timing_stats,
+                      std::mutex *timing_mutex, StreamStats *stats) {
+    Recognizer recognizer(model);
+    recognizer.SetJson(false); // latency of the recognizer, not of formatting
+    // streams start at different files so they do not hit endpoints in lockstep
+    for (size_t u = stream; stats->audio_seconds < opts.trial_seconds; u++) {
+        const Utterance &utt = utterances[u % utterances.size()];
+        int32 chunk = std::max<int32>(1, utt.sampling_frequency * opts.chunk_ms / 1000);
+        int32 num_samples = utt.samples.size();
+        OnlineTimer timer(utt.key);
+        Timer wall;
+        bool have_partial = false;
+        for (int32 offset = 0, c = 0; offset < num_samples; offset += chunk, c++) {
+            int32 len = std::min(chunk, num_samples - offset);
+            double audio_time = (offset + len) / utt.sampling_frequency;
+            timer.SleepUntil(audio_time); // 1x speed, no sleep once we are behind
+
+            Timer t;
+            bool endpoint = recognizer.AcceptWaveform(utt.samples.data() + offset, len);
+            double elapsed = t.Elapsed();
+            stats->chunk_ms.push_back(elapsed * 1000);
+            stats->busy_seconds += elapsed;
+
+            if (endpoint) {
+                t.Reset();
+                recognizer.Result();
+                elapsed = t.Elapsed();
+                stats->final_ms.push_back(elapsed * 1000);
+                stats->busy_seconds += elapsed;
+                have_partial = false;
+            } else if (opts.partial_every > 0 && c % opts.partial_every == 0) {
+                t.Reset();
+                recognizer.PartialResult();
+                stats->busy_seconds += t.Elapsed();
+                if (!have_partial && !recognizer.ResultWords().empty()) {
+                    have_partial = true;
+                    stats->first_partial_ms.push_back((wall.Elapsed() - audio_time) * 1000);
+                }
+            }
+        }
+        Timer t;
+        recognizer.FinalResult();
+        double elapsed = t.Elapsed();
+        stats->final_ms.push_back(elapsed * 1000);
+        stats->busy_seconds += elapsed;
+
+        double duration = num_samples / utt.sampling_frequency;
+        stats->max_lag = std::max(stats->max_lag, wall.Elapsed() - duration);
+        stats->audio_seconds += duration;
+        std::lock_guard<std::mutex> lock(*timing_mutex);
+        timer.OutputStats(timing_stats);
+    }
+}
+
+static TrialResult RunTrial(Model *model, const std::vector<Utterance> &utterances,
+                            int32 num_streams, const LoadTestOptions &opts) {
+    std::vector<StreamStats> stream_stats(num_streams);
+    OnlineTimingStats timing_stats;
+    std::mutex timing_mutex;
+    std::vector<std::thread> threads;
+    for (int32 i = 0; i < num_streams; i++) {
+        threads.push_back(std::thread(RunStream, model, std::cref(utterances), i, std::cref(opts),
+                                      &timing_stats, &timing_mutex, &stream_stats[i]));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    TrialResult result;
+    result.num_streams = num_streams;
+    StreamStats &total = result.stats;
+    for (size_t i = 0; i < stream_stats.size(); i++) {
+        const StreamStats &s = stream_stats[i];
+        total.chunk_ms.insert(total.chunk_ms.end(), s.chunk_ms.begin(), s.chunk_ms.end());
+        total.first_partial_ms.insert(total.first_partial_ms.end(), s.first_partial_ms.begin(),
+                                      s.first_partial_ms.end());
+        total.final_ms.insert(total.final_ms.end(), s.final_ms.begin(), s.final_ms.end());
+        total.max_lag = std::max(total.max_lag, s.max_lag);
+        total.audio_seconds += s.audio_seconds;
+        total.busy_seconds += s.busy_seconds;
+    }
+    timing_stats.Print(true); // average RTF and delay as online2 binaries report them
+
+    double chunk_p50 = Percentile(&total.chunk_ms, 50), chunk_p95 = Percentile(&total.chunk_ms, 95),
+           chunk_p99 = Percentile(&total.chunk_ms, 99);
+    double partial_p50 = Percentile(&total.first_partial_ms, 50),
+           partial_p95 = Percentile(&total.first_partial_ms, 95),
+           partial_p99 = Percentile(&total.first_partial_ms, 99);
+    double final_p50 = Percentile(&total.final_ms, 50), final_p95 = Percentile(&total.final_ms, 95),
+           final_p99 = Percentile(&total.final_ms, 99);
+    result.pass = chunk_p99 <= opts.slo_chunk_p99_ms && final_p95 <= opts.slo_final_p95_ms &&
+                  total.max_lag <= opts.slo_max_lag;
+
+    printf("%4d streams  chunk ms %6.1f %6.1f %6.1f  first-partial ms %6.1f %6.1f %6.1f  "
+           "final ms %6.1f %6.1f %6.1f  rtf %.3f  lag %.2f s  %s\n",
+           num_streams, chunk_p50, chunk_p95, chunk_p99, partial_p50, partial_p95, partial_p99,
+           final_p50, final_p95, final_p99,
+           total.audio_seconds > 0 ? total.busy_seconds / total.audio_seconds : 0.0,
+           total.max_lag, result.pass ? "PASS" : "FAIL");
+    fflush(stdout);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Replay wav files at 1x speed into N recognizers sharing one model and report\n"
+                "p50/p95/p99 latencies, or find the largest N within the SLO.\n"
+                "\n"
+                "Usage: stream_load_test [options] <model-dir> <wav.scp|wav-dir>\n";
+        ParseOptions po(usage);
+        LoadTestOptions opts;
+        opts.Register(&po);
+        po.Read(argc, argv);
+        if (po.NumArgs() != 2) {
+            po.PrintUsage();
+            return 1;
+        }
+
+        std::vector<std::pair<string, string> > inputs;
+        if (!ReadWavList(po.GetArg(2), &inputs) || inputs.empty()) {
+            KALDI_ERR << "No wav files in " << po.GetArg(2);
+        }
+        // in memory up front, disk reads must not show up as decoder latency
+        std::vector<Utterance> utterances;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            WaveData wave;
+            std::ifstream is(inputs[i].second.c_str(), std::ios::binary);
+            wave.Read(is);
+            Utterance utt;
+            utt.key = inputs[i].first;
+            utt.sampling_frequency = wave.SampFreq();
+            const Matrix<BaseFloat> &data = wave.Data();
+            utt.samples.resize(data.NumCols());
+            for (int32 j = 0; j < data.NumCols(); j++) {
+                utt.samples[j] = static_cast<short>(data(0, j));
+            }
+            if (!utt.samples.empty()) {
+                utterances.push_back(utt);
+            }
+        }
+        if (utterances.empty()) {
+            KALDI_ERR << "No audio in " << po.GetArg(2);
+        }
+
+        Model *model = new Model(po.GetArg(1).c_str());
+        model->PreloadRescoring(); // the first endpoint should not pay for loading the LMs
+
+        printf("latencies are p50 p95 p99, rtf is time inside the recognizer per second of audio\n");
+        if (opts.num_streams > 0) {
+            TrialResult result = RunTrial(model, utterances, opts.num_streams, opts);
+            model->Unref();
+            return result.pass ? 0 : 2;
+        }
+
+        // Double until the SLO breaks, then bisect between the last pass and the first failure
+        int32 good = 0, bad = opts.max_streams + 1;
+        for (int32 n = 1; n <= opts.max_streams; n *= 2) {
+            if (RunTrial(model, utterances, n, opts).pass) {
+                good = n;
+            } else {
+                bad = n;
+                break;
+            }
+        }
+        while (bad - good > 1) {
+            int32 n = good + (bad - good) / 2;
+            if (RunTrial(model, utterances, n, opts).pass) {
+                good = n;
+            } else {
+                bad = n;
+            }
+        }
+        printf("max streams within SLO (chunk p99 <= %.0f ms, final p95 <= %.0f ms, lag <= %.1f s): %d\n",
+               opts.slo_chunk_p99_ms, opts.slo_final_p95_ms, opts.slo_max_lag, good);
+        model->Unref();
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef KALDIANDROID_TOOLS_WAV_LIST_H
+#define KALDIANDROID_TOOLS_WAV_LIST_H
+
+// Input lists of the host tools: a wav.scp with "<key> <wav-file>" lines (or
+// just the file, keyed by its name) or a directory scanned for *.wav
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#include "../kaldi.h"
+
+using namespace kaldi;
+
+static inline string WavKey(const string &path) {
+    size_t slash = path.find_last_of('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == string::npos ? name : name.substr(0, dot);
+}
+
+static inline bool ReadWavList(const string &source, std::vector<std::pair<string, string> > *inputs) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) {
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source.c_str());
+        if (dir == nullptr) {
+            return false;
+        }
+        std::vector<string> files;
+        for (struct dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+                files.push_back(source + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size(); i++) {
+            inputs->push_back(std::make_pair(WavKey(files[i]), files[i]));
+        }
+        return true;
+    }
+    std::ifstream is(source.c_str());
+    string line;
+    while (std::getline(is, line)) {
+        std::vector<string> fields;
+        SplitStringToVector(line, " \t", true, &fields);
+        if (fields.size() == 1) {
+            inputs->push_back(std::make_pair(WavKey(fields[0]), fields[0]));
+        } else if (fields.size() == 2) {
+            inputs->push_back(std::make_pair(fields[0], fields[1]));
+        } else if (!fields.empty()) {
+            KALDI_WARN << "Skipping line, expected '<key> <wav-file>' (pipes are not supported): " << line;
+        }
+    }
+    return true;
+}
+
+#endif // KALDIANDROID_TOOLS_WAV_LIST_H
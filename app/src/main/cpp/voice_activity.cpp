@@ -0,0 +1,87 @@
+#include "voice_activity.h"
+
+bool EnergyVoiceActivityDetector::IsSpeech(const VectorBase<BaseFloat> &frame) {
+    BaseFloat energy = Log(std::max<BaseFloat>(VecVec(frame, frame) / frame.Dim(), 1.0));
+    if (floor_ < 0 || energy < floor_) {
+        floor_ = energy; // falls at once, rises slowly
+    } else {
+        floor_ += opts_.floor_rise;
+    }
+    return energy > opts_.energy_threshold && energy > floor_ + opts_.energy_margin;
+}
+
+VoiceActivityGate::VoiceActivityGate(const VoiceActivityOptions &opts, BaseFloat samp_freq,
+                                     VoiceActivityDetector *detector)
+        : detector_(detector),
+          frame_samples_(static_cast<int32>(samp_freq * 0.01)),
+          onset_frames_(std::max(opts.onset_frames, 1)),
+          hangover_frames_(static_cast<int32>(opts.hangover_seconds * 100)),
+          lookback_samples_(static_cast<size_t>(opts.lookback_seconds * samp_freq)),
+          frame_(frame_samples_),
+          held_(lookback_samples_ + 1) {
+}
+
+VoiceActivityGate::~VoiceActivityGate() {
+    delete detector_;
+}
+
+void VoiceActivityGate::Accept(const VectorBase<BaseFloat> &wave, std::vector<VoiceActivityRun> *runs) {
+    runs->clear();
+    int32 i = 0;
+    while (i < wave.Dim()) {
+        int32 n = std::min(frame_samples_ - frame_fill_, wave.Dim() - i);
+        SubVector<BaseFloat>(frame_, frame_fill_, n).CopyFromVec(wave.Range(i, n));
+        frame_fill_ += n;
+        if (frame_fill_ == frame_samples_) {
+            frame_fill_ = 0;
+            bool speech = detector_->IsSpeech(frame_);
+            if (open_) {
+                silent_frames_ = speech ? 0 : silent_frames_ + 1;
+                open_ = silent_frames_ <= hangover_frames_;
+            } else {
+                speech_frames_ = speech ? speech_frames_ + 1 : 0;
+                open_ = speech_frames_ >= onset_frames_;
+            }
+            if (open_) {
+                speech_frames_ = 0;
+            } else {
+                silent_frames_ = 0;
+            }
+        }
+        if (!runs->empty() && runs->back().speech == open_) {
+            runs->back().end = i + n;
+        } else {
+            VoiceActivityRun run = {i, i + n, open_};
+            runs->push_back(run);
+        }
+        i += n;
+    }
+}
+
+int32 VoiceActivityGate::Hold(const VectorBase<BaseFloat> &wave) {
+    size_t len = wave.Dim();
+    size_t keep = std::min(len, lookback_samples_);
+    size_t dropped = len - keep;
+    if (held_.Size() + keep > lookback_samples_) {
+        drop_.resize(held_.Size() + keep - lookback_samples_);
+        held_.Pop(drop_.data(), drop_.size());
+        dropped += drop_.size();
+    }
+    held_.Push(wave.Data() + len - keep, keep);
+    return static_cast<int32>(dropped);
+}
+
+void VoiceActivityGate::Release(Vector<BaseFloat> *audio) {
+    audio->Resize(held_.Size(), kUndefined);
+    held_.Pop(audio->Data(), audio->Dim());
+}
+
+void VoiceActivityGate::Reset() {
+    detector_->Reset();
+    frame_fill_ = 0;
+    open_ = false;
+    speech_frames_ = 0;
+    silent_frames_ = 0;
+    drop_.resize(held_.Size());
+    held_.Pop(drop_.data(), drop_.size());
+}
@@ -0,0 +1,103 @@
+#ifndef KALDIANDROID_VOICE_ACTIVITY_H
+#define KALDIANDROID_VOICE_ACTIVITY_H
+
+#include <vector>
+
+#include "kaldi.h"
+#include "audio_ring_buffer.h"
+
+using namespace kaldi;
+
+struct VoiceActivityOptions {
+    bool enabled = false;
+    BaseFloat energy_threshold = 8.0;    // log mean square of a 10ms frame, int16 samples, below is never speech
+    BaseFloat energy_margin = 2.5;       // above the noise floor for speech, ~11dB
+    BaseFloat floor_rise = 0.002;        // per frame, how fast the noise floor follows louder background
+    int32 onset_frames = 3;              // speech frames in a row to open the gate
+    BaseFloat hangover_seconds = 0.5;    // non-speech kept open after speech, endpointing needs trailing silence
+    BaseFloat lookback_seconds = 0.3;    // held back audio decoded ahead of an onset, so it is not clipped
+
+    void Register(OptionsItf *opts) {
+        opts->Register("vad", &enabled, "Skip features, nnet and search on audio the voice activity gate "
+                                        "classifies as non-speech between utterances");
+        opts->Register("vad-energy-threshold", &energy_threshold,
+                       "Log mean square energy of a 10ms frame below which it is never speech");
+        opts->Register("vad-energy-margin", &energy_margin,
+                       "Log energy above the tracked noise floor for a frame to be speech");
+        opts->Register("vad-floor-rise", &floor_rise, "Rise of the noise floor per frame");
+        opts->Register("vad-onset-frames", &onset_frames, "Speech frames in a row that open the gate");
+        opts->Register("vad-hangover-seconds", &hangover_seconds,
+                       "Non-speech after speech that still goes to the decoder");
+        opts->Register("vad-lookback-seconds", &lookback_seconds,
+                       "Audio before an onset that is decoded with it");
+    }
+};
+
+// Speech or not for each 10ms frame, in order. A small-model VAD plugs in
+// here; it may keep its own context, the gate only needs one decision per
+// frame as the frames come.
+class VoiceActivityDetector {
+public:
+    virtual bool IsSpeech(const VectorBase<BaseFloat> &frame) = 0;
+    virtual void Reset() = 0;
+    virtual ~VoiceActivityDetector() {}
+};
+
+// Frame energy against a tracked noise floor. ComputeVadEnergy() in
+// ivector/voice-activity-detection.h thresholds on the mean energy of the
+// whole utterance and looks at future frames, neither of which a stream has.
+class EnergyVoiceActivityDetector : public VoiceActivityDetector {
+public:
+    explicit EnergyVoiceActivityDetector(const VoiceActivityOptions &opts) : opts_(opts) {}
+    bool IsSpeech(const VectorBase<BaseFloat> &frame) override;
+    void Reset() override { floor_ = -1; }
+private:
+    const VoiceActivityOptions &opts_;
+    BaseFloat floor_ = -1; // log energy, < 0 until the first frame
+};
+
+struct VoiceActivityRun {
+    int32 begin;
+    int32 end;
+    bool speech; // the gate was open
+};
+
+// Opens after onset_frames of speech and closes after hangover_seconds
+// without. What to do with the samples of a closed run is up to the caller;
+// those it drops go through Hold(), so the last lookback_seconds of them can be
+// decoded ahead of the next onset.
+class VoiceActivityGate {
+public:
+    // Takes ownership of detector
+    VoiceActivityGate(const VoiceActivityOptions &opts, BaseFloat samp_freq, VoiceActivityDetector *detector);
+    ~VoiceActivityGate();
+
+    // Splits wave into runs the gate was open or closed for. The decision of a
+    // frame applies from the sample that completes it.
+    void Accept(const VectorBase<BaseFloat> &wave, std::vector<VoiceActivityRun> *runs);
+    // Keeps the samples for lookback, returns how many older ones were dropped
+    int32 Hold(const VectorBase<BaseFloat> &wave);
+    // Moves the held samples, oldest first, to audio
+    void Release(Vector<BaseFloat> *audio);
+    bool Open() const { return open_; }
+    void Reset();
+
+private:
+    VoiceActivityDetector *detector_;
+    int32 frame_samples_;
+    int32 onset_frames_;
+    int32 hangover_frames_;
+    size_t lookback_samples_;
+
+    Vector<BaseFloat> frame_;  // the incomplete frame
+    int32 frame_fill_ = 0;
+    bool open_ = false;
+    int32 speech_frames_ = 0;  // in a row, while closed
+    int32 silent_frames_ = 0;  // in a row, while open
+    AudioRingBuffer<BaseFloat> held_;
+    std::vector<BaseFloat> drop_;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(VoiceActivityGate);
+};
+
+#endif // KALDIANDROID_VOICE_ACTIVITY_H
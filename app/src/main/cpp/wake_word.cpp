@@ -0,0 +1,216 @@
+#include "wake_word.h"
+
+#include <sys/stat.h>
+#include <fstream>
+
+WakeWordModel::WakeWordModel(const string &dir) {
+    struct stat buffer;
+    // small enough for a keyword graph, a full vocabulary would need far more
+    decoder_opts_.beam = 8.0;
+    decoder_opts_.max_active = 200;
+    decoder_opts_.min_active = 20;
+    decodable_opts_.frame_subsampling_factor = 3;
+    decodable_opts_.acoustic_scale = 1.0;
+
+    string conf = dir + "/kws.conf";
+    if (stat(conf.c_str(), &buffer) == 0) {
+        kaldi::ParseOptions po("");
+        decoder_opts_.Register(&po, true);
+        decodable_opts_.Register(&po);
+        po.Register("lookback-seconds", &lookback_seconds_,
+                    "Audio before the keyword detection passed to the full recognizer");
+        po.Register("restart-seconds", &restart_seconds_,
+                    "Restart listening after this long without a keyword, bounds its memory");
+        po.ReadConfigFile(conf);
+    }
+
+    feature_info_.feature_type = "mfcc";
+    ReadConfigFromFile(dir + "/mfcc.conf", &feature_info_.mfcc_opts);
+    feature_info_.mfcc_opts.frame_opts.allow_downsample = true;
+    feature_info_.use_ivectors = false;
+    string cmvn = dir + "/global_cmvn.stats";
+    if (stat(cmvn.c_str(), &buffer) == 0) {
+        feature_info_.use_cmvn = true;
+        ReadKaldiObject(cmvn, &feature_info_.global_cmvn_stats);
+    }
+
+    KALDI_LOG << "Loading wake word model from " << dir;
+    {
+        bool binary;
+        kaldi::Input ki(dir + "/final.mdl", &binary);
+        trans_model_.Read(ki.Stream(), binary);
+        nnet_.Read(ki.Stream(), binary);
+    }
+    nnet3::SetBatchnormTestMode(true, &nnet_.GetNnet());
+    nnet3::SetDropoutTestMode(true, &nnet_.GetNnet());
+    nnet3::CollapseModel(nnet3::CollapseModelConfig(), &nnet_.GetNnet());
+    decodable_info_ = new nnet3::DecodableNnetSimpleLoopedInfo(decodable_opts_, &nnet_);
+
+    graph_ = fst::ReadFstKaldiGeneric(dir + "/HCLG.fst");
+    word_syms_ = fst::SymbolTable::ReadText(dir + "/words.txt");
+    if (!word_syms_) {
+        KALDI_ERR << "Could not read symbol table from file " << dir << "/words.txt";
+    }
+
+    std::ifstream is((dir + "/keywords.txt").c_str());
+    if (is) {
+        string word;
+        while (is >> word) {
+            int32 id = word_syms_->Find(word);
+            if (id == fst::kNoSymbol) {
+                KALDI_WARN << "Keyword " << word << " is not in " << dir << "/words.txt";
+            } else {
+                keywords_.insert(id);
+            }
+        }
+    } else {
+        const char *fillers[] = {"<eps>", "<sil>", "<unk>", "SIL", "FREETEXT"};
+        for (fst::SymbolTableIterator it(*word_syms_); !it.Done(); it.Next()) {
+            if (std::find(fillers, fillers + 5, it.Symbol()) == fillers + 5) {
+                keywords_.insert(it.Value());
+            }
+        }
+    }
+    if (keywords_.empty()) {
+        KALDI_ERR << "No keywords in " << dir;
+    }
+}
+
+WakeWordModel::~WakeWordModel() {
+    delete decodable_info_;
+    delete graph_;
+    delete word_syms_;
+}
+
+const WakeWordModel &WakeWordRecognizer::GetWakeWordModel(Model *model) {
+    if (!model->wake_word_model_) {
+        KALDI_ERR << "The model has no kws directory for wake word detection";
+    }
+    return *model->wake_word_model_;
+}
+
+WakeWordRecognizer::WakeWordRecognizer(Model *model)
+        : model_(model),
+          kws_(GetWakeWordModel(model)),
+          decoder_(*kws_.graph_, kws_.decoder_opts_),
+          lookback_(static_cast<size_t>(kws_.lookback_seconds_ * sampling_frequency_)),
+          lookback_samples_(static_cast<size_t>(kws_.lookback_seconds_ * sampling_frequency_)) {
+    model_->Ref();
+    StartListening(false);
+}
+
+WakeWordRecognizer::~WakeWordRecognizer() {
+    if (recognizer_) {
+        model_->ReleaseRecognizer(recognizer_);
+    }
+    delete decodable_;
+    delete feature_pipeline_;
+    model_->Unref();
+}
+
+// Fresh features and search. With replay the lookback audio is decoded again,
+// so a keyword that straddles a periodic restart is still found.
+void WakeWordRecognizer::StartListening(bool replay) {
+    delete decodable_;
+    delete feature_pipeline_;
+    feature_pipeline_ = new OnlineNnet2FeaturePipeline(kws_.feature_info_);
+    decodable_ = new nnet3::DecodableAmNnetLoopedOnline(kws_.trans_model_, *kws_.decodable_info_,
+                                                        feature_pipeline_->InputFeature(),
+                                                        feature_pipeline_->IvectorFeature());
+    decoder_.InitDecoding();
+    listened_samples_ = 0;
+
+    if (replay && lookback_.Size() > 0) {
+        std::vector<short> audio(lookback_.Size());
+        lookback_.Pop(audio.data(), audio.size());
+        Listen(audio.data(), audio.size());
+    }
+}
+
+void WakeWordRecognizer::Listen(const short *sdata, int len) {
+    // keep only the last lookback_samples_ samples
+    size_t keep = std::min(static_cast<size_t>(len), lookback_samples_);
+    if (lookback_.Size() + keep > lookback_samples_) {
+        lookback_.Discard(lookback_.Size() + keep - lookback_samples_);
+    }
+    lookback_.Push(sdata + len - keep, keep);
+
+    // the always-on path, as in Recognizer::ConvertWaveform() nothing is
+    // allocated once the buffer fits the chunk size
+    if (wave_buffer_.Dim() < len) {
+        wave_buffer_.Resize(len, kUndefined);
+    }
+    ConvertPcm16ToFloat(sdata, len, wave_buffer_.Data());
+    feature_pipeline_->AcceptWaveform(sampling_frequency_, SubVector<BaseFloat>(wave_buffer_, 0, len));
+    decoder_.AdvanceDecoding(decodable_);
+    listened_samples_ += len;
+}
+
+// Only the part of the best path all active hypotheses agree on is checked,
+// so a keyword is reported once and only when the search is sure of it
+bool WakeWordRecognizer::DetectKeyword() {
+    Lattice lat;
+    if (!decoder_.PartialTraceback(&lat)) {
+        return false;
+    }
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    fst::GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+    for (size_t i = 0; i < words.size(); i++) {
+        if (kws_.IsKeyword(words[i])) {
+            keyword_ = kws_.word_syms_->Find(words[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WakeWordRecognizer::Wake() {
+    if (recognizer_) {
+        model_->ReleaseRecognizer(recognizer_); // results of the last command are no longer needed
+    }
+    recognizer_ = model_->AcquireRecognizer();
+    active_ = true;
+    std::vector<short> audio(lookback_.Size());
+    lookback_.Pop(audio.data(), audio.size());
+    // an endpoint here is detected again on the next chunk
+    recognizer_->AcceptWaveform(audio.data(), audio.size());
+}
+
+int WakeWordRecognizer::AcceptWaveform(const short *sdata, int len) {
+    if (active_) {
+        if (recognizer_->AcceptWaveform(sdata, len)) {
+            active_ = false;
+            StartListening(false);
+            return WAKE_EVENT_RESULT;
+        }
+        return WAKE_EVENT_NONE;
+    }
+
+    Listen(sdata, len);
+    if (DetectKeyword()) {
+        Wake();
+        return WAKE_EVENT_KEYWORD;
+    }
+    if (listened_samples_ > kws_.restart_seconds_ * sampling_frequency_) {
+        StartListening(true);
+    }
+    return WAKE_EVENT_NONE;
+}
+
+const char *WakeWordRecognizer::Result() {
+    return recognizer_ ? recognizer_->Result() : "";
+}
+
+const char *WakeWordRecognizer::PartialResult() {
+    return active_ ? recognizer_->PartialResult() : "";
+}
+
+const char *WakeWordRecognizer::FinalResult() {
+    if (!active_) {
+        return "";
+    }
+    active_ = false;
+    StartListening(false);
+    return recognizer_->FinalResult();
+}
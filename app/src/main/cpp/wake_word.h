@@ -0,0 +1,91 @@
+#ifndef KALDIANDROID_WAKE_WORD_H
+#define KALDIANDROID_WAKE_WORD_H
+
+#include <unordered_set>
+
+#include "kaldi.h"
+
+#include "audio_ring_buffer.h"
+#include "recognizer.h"
+
+using namespace kaldi;
+
+// Keyword spotting model from the kws/ directory of a model: a small acoustic
+// model with a keyword graph of its own (final.mdl, HCLG.fst, words.txt,
+// mfcc.conf), optional kws.conf with the options below and keywords.txt with
+// the words that wake the recognizer. Without keywords.txt every word of the
+// graph but the fillers (<eps>, <sil>, <unk>, SIL, FREETEXT) is a keyword.
+class WakeWordModel {
+public:
+    explicit WakeWordModel(const string &dir);
+    ~WakeWordModel();
+    bool IsKeyword(int32 word) const { return keywords_.count(word) != 0; }
+private:
+    friend class WakeWordRecognizer;
+
+    OnlineWakeWordFasterDecoderOpts decoder_opts_;
+    nnet3::NnetSimpleLoopedComputationOptions decodable_opts_;
+    OnlineNnet2FeaturePipelineInfo feature_info_;
+    BaseFloat lookback_seconds_ = 2.0; // audio before the detection handed to the full recognizer
+    BaseFloat restart_seconds_ = 30.0; // listening restarts this often to bound its memory
+
+    TransitionModel trans_model_;
+    nnet3::AmNnetSimple nnet_;
+    nnet3::DecodableNnetSimpleLoopedInfo *decodable_info_ = nullptr;
+    fst::Fst<fst::StdArc> *graph_ = nullptr;
+    fst::SymbolTable *word_syms_ = nullptr;
+    std::unordered_set<int32> keywords_;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(WakeWordModel);
+};
+
+enum WakeWordEvent {
+    WAKE_EVENT_NONE,    // listening, or the utterance after the keyword goes on
+    WAKE_EVENT_RESULT,  // endpoint of the utterance after the keyword, see Result()
+    WAKE_EVENT_KEYWORD  // keyword detected, the full recognizer takes over
+};
+
+// Always-on listening at a fraction of the cost of a Recognizer: the keyword
+// model of the Model runs with a FasterDecoder, small beams and no lattices.
+// On a keyword the last lookback seconds of audio, which include it, and
+// everything after go to a full Recognizer from the model's pool until its
+// endpoint, then listening resumes. Times in the results count from the start
+// of the handed-over audio. Input is 16 kHz, as for Recognizer.
+class WakeWordRecognizer {
+public:
+    explicit WakeWordRecognizer(Model *model);
+    int AcceptWaveform(const short *sdata, int len); // a WakeWordEvent
+    const char *Keyword() const { return keyword_.c_str(); } // the last one detected
+    // Results of the full recognizer, "" while it has not been woken
+    const char *Result();
+    const char *PartialResult();
+    const char *FinalResult();
+    bool Listening() const { return !active_; }
+    ~WakeWordRecognizer();
+private:
+    static const WakeWordModel &GetWakeWordModel(Model *model);
+    void StartListening(bool replay);
+    void Listen(const short *sdata, int len);
+    bool DetectKeyword();
+    void Wake();
+
+    Model *model_;
+    const WakeWordModel &kws_;
+    BaseFloat sampling_frequency_ = 16000;
+
+    OnlineNnet2FeaturePipeline *feature_pipeline_ = nullptr;
+    nnet3::DecodableAmNnetLoopedOnline *decodable_ = nullptr;
+    OnlineWakeWordFasterDecoder decoder_;
+    AudioRingBuffer<short> lookback_; // only used from the calling thread
+    Vector<BaseFloat> wave_buffer_; // reused int16 -> float conversion buffer, only grows
+    size_t lookback_samples_;
+    int64 listened_samples_ = 0; // since the last restart
+
+    Recognizer *recognizer_ = nullptr; // from the pool, kept for Result() until the next keyword
+    bool active_ = false;
+    string keyword_;
+
+    KALDI_DISALLOW_COPY_AND_ASSIGN(WakeWordRecognizer);
+};
+
+#endif // KALDIANDROID_WAKE_WORD_H
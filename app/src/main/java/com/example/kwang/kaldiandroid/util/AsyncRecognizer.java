@@ -0,0 +1,28 @@
+package com.example.kwang.kaldiandroid.util;
+
+import com.sun.jna.PointerType;
+
+public class AsyncRecognizer extends PointerType implements AutoCloseable {
+
+    // keep a strong reference, JNA callbacks are unregistered once garbage collected
+    private final KaldiUtil.ResultCallback callback;
+
+    public AsyncRecognizer(Model model, float bufferSeconds, KaldiUtil.ResultCallback callback) {
+        super(KaldiUtil.kwang_async_recognizer_new(model, bufferSeconds, callback, null));
+        this.callback = callback;
+    }
+
+    // returns the number of samples queued, the rest was dropped because decoding fell behind
+    public int acceptWaveForm(short[] data, int len) {
+        return KaldiUtil.kwang_async_recognizer_accept_waveform_s(this.getPointer(), data, len);
+    }
+
+    public void inputFinished() {
+        KaldiUtil.kwang_async_recognizer_input_finished(this.getPointer());
+    }
+
+    @Override
+    public void close() throws Exception {
+        KaldiUtil.kwang_async_recognizer_free(this.getPointer());
+    }
+}
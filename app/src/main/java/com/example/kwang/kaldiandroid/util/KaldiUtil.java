@@ -1,6 +1,7 @@
 package com.example.kwang.kaldiandroid.util;
 
 
+import com.sun.jna.Callback;
 import com.sun.jna.Native;
 import com.sun.jna.Pointer;
 
@@ -18,12 +19,52 @@ public class KaldiUtil {
 //    public static native String getResultString();
     public static native Pointer kwang_model_new(String path);
     public static native void kwang_model_free(Pointer model);
+    public static native String kwang_model_load_stats(Pointer model);
+    public static native void kwang_model_preload_rescoring(Pointer model);
+    public static native int kwang_model_word_symbol(Pointer model, int wordId, byte[] buffer, int size);
     public static native Pointer kwang_recognizer_new(Model model);
     public static native void kwang_recognizer_free(Pointer recognizer);
     public static native void kwang_recognizer_reset(Pointer recognizer);
+    public static native int kwang_recognizer_set_sub_grammar(Pointer recognizer, String nonterminal, String phrases);
+    public static native Pointer kwang_model_acquire_recognizer(Pointer model);
+    public static native void kwang_recognizer_release(Pointer recognizer);
+    public static native void kwang_model_prewarm_recognizers(Pointer model, int count);
     public static native boolean kwang_recognizer_accept_waveform(Pointer recognizer, byte[] data, int len);
     public static native boolean kwang_recognizer_accept_waveform_s(Pointer recognizer, short[] data, int len);
+    public static native boolean kwang_recognizer_accept_waveform_f(Pointer recognizer, float[] data, int len);
     public static native String kwang_recognizer_result(Pointer recognizer);
     public static native String kwang_recognizer_final_result(Pointer recognizer);
     public static native String kwang_recognizer_partial_result(Pointer recognizer);
+    public static native void kwang_recognizer_set_json(Pointer recognizer, int json);
+    public static native int kwang_recognizer_result_words(Pointer recognizer, int[] words, int[] startFrames,
+                                                           int[] endFrames, float[] confs, int maxWords);
+    public static native int kwang_recognizer_result_binary(Pointer recognizer, byte[] buffer, int size);
+    public static native String kwang_recognizer_stats(Pointer recognizer);
+    public static native String kwang_recognizer_search_params(Pointer recognizer);
+
+    // events passed to ResultCallback, see kwang_api.h
+    public static final int KWANG_EVENT_PARTIAL = 0;
+    public static final int KWANG_EVENT_RESULT = 1;
+    public static final int KWANG_EVENT_FINAL = 2;
+
+    public interface ResultCallback extends Callback {
+        void invoke(Pointer userData, int event, String result);
+    }
+    public static native Pointer kwang_async_recognizer_new(Model model, float bufferSeconds, ResultCallback callback, Pointer userData);
+    public static native void kwang_async_recognizer_free(Pointer recognizer);
+    public static native int kwang_async_recognizer_accept_waveform_s(Pointer recognizer, short[] data, int len);
+    public static native void kwang_async_recognizer_input_finished(Pointer recognizer);
+
+    // returned by kwang_wake_word_recognizer_accept_waveform_s, see kwang_api.h
+    public static final int KWANG_WAKE_NONE = 0;
+    public static final int KWANG_WAKE_RESULT = 1;
+    public static final int KWANG_WAKE_KEYWORD = 2;
+
+    public static native Pointer kwang_wake_word_recognizer_new(Model model);
+    public static native void kwang_wake_word_recognizer_free(Pointer recognizer);
+    public static native int kwang_wake_word_recognizer_accept_waveform_s(Pointer recognizer, short[] data, int len);
+    public static native String kwang_wake_word_recognizer_keyword(Pointer recognizer);
+    public static native String kwang_wake_word_recognizer_result(Pointer recognizer);
+    public static native String kwang_wake_word_recognizer_partial_result(Pointer recognizer);
+    public static native String kwang_wake_word_recognizer_final_result(Pointer recognizer);
 }
\ No newline at end of file
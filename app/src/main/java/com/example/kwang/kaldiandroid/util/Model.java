@@ -3,6 +3,8 @@ package com.example.kwang.kaldiandroid.util;
 
 import com.sun.jna.PointerType;
 
+import java.nio.charset.StandardCharsets;
+
 public class Model extends PointerType implements AutoCloseable {
 
     public Model() {
@@ -12,6 +14,30 @@ public class Model extends PointerType implements AutoCloseable {
         super(KaldiUtil.kwang_model_new(path));
     }
 
+    public String getLoadStats() {
+        return KaldiUtil.kwang_model_load_stats(this.getPointer());
+    }
+
+    // Word for an id from Recognizer.getResultWords(), null if unknown
+    public String getWordSymbol(int wordId) {
+        byte[] buffer = new byte[64];
+        int length = KaldiUtil.kwang_model_word_symbol(this.getPointer(), wordId, buffer, buffer.length);
+        if (length >= buffer.length) {
+            buffer = new byte[length + 1];
+            length = KaldiUtil.kwang_model_word_symbol(this.getPointer(), wordId, buffer, buffer.length);
+        }
+        return length < 0 ? null : new String(buffer, 0, length, StandardCharsets.UTF_8);
+    }
+
+    // Create idle recognizers for Recognizer.acquire() ahead of the first streams
+    public void prewarmRecognizers(int count) {
+        KaldiUtil.kwang_model_prewarm_recognizers(this.getPointer(), count);
+    }
+
+    public void preloadRescoring() {
+        KaldiUtil.kwang_model_preload_rescoring(this.getPointer());
+    }
+
     @Override
     public void close() {
         KaldiUtil.kwang_model_free(this.getPointer());
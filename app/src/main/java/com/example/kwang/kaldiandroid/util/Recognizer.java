@@ -1,13 +1,26 @@
 package com.example.kwang.kaldiandroid.util;
 
+import com.sun.jna.Pointer;
 import com.sun.jna.PointerType;
 
 public class Recognizer extends PointerType implements AutoCloseable {
 
+    private boolean pooled;
+
     public Recognizer(Model model) {
         super(KaldiUtil.kwang_recognizer_new(model));
     }
 
+    private Recognizer(Pointer pointer) {
+        super(pointer);
+        pooled = true;
+    }
+
+    // Recognizer from the model's pool, close() gives it back instead of freeing it
+    public static Recognizer acquire(Model model) {
+        return new Recognizer(KaldiUtil.kwang_model_acquire_recognizer(model.getPointer()));
+    }
+
     public boolean acceptWaveForm(byte[] data, int len) {
         return KaldiUtil.kwang_recognizer_accept_waveform(this.getPointer(), data, len);
     }
@@ -16,6 +29,10 @@ public class Recognizer extends PointerType implements AutoCloseable {
         return KaldiUtil.kwang_recognizer_accept_waveform_s(this.getPointer(), data, len);
     }
 
+    public boolean acceptWaveForm(float[] data, int len) {
+        return KaldiUtil.kwang_recognizer_accept_waveform_f(this.getPointer(), data, len);
+    }
+
     public String getResult() {
         return KaldiUtil.kwang_recognizer_result(this.getPointer());
     }
@@ -28,12 +45,45 @@ public class Recognizer extends PointerType implements AutoCloseable {
         return KaldiUtil.kwang_recognizer_final_result(this.getPointer());
     }
 
+    // With json off the string results are empty, use getResultWords()
+    public void setJson(boolean json) {
+        KaldiUtil.kwang_recognizer_set_json(this.getPointer(), json ? 1 : 0);
+    }
+
+    // Words of the last result or partial result into the given arrays, returns
+    // the number of words, which may be larger than the arrays
+    public int getResultWords(int[] words, int[] startFrames, int[] endFrames, float[] confs) {
+        return KaldiUtil.kwang_recognizer_result_words(this.getPointer(), words, startFrames, endFrames,
+                confs, words.length);
+    }
+
+    // Per-stage timings and search counters as JSON, see kwang_recognizer_stats
+    public String getStats() {
+        return KaldiUtil.kwang_recognizer_stats(this.getPointer());
+    }
+
+    // Beam, max-active and lattice-beam the search currently runs with as JSON,
+    // see kwang_recognizer_search_params
+    public String getSearchParams() {
+        return KaldiUtil.kwang_recognizer_search_params(this.getPointer());
+    }
+
+    // Phrases of a grammar nonterminal for this recognizer, as a JSON array of
+    // strings, used from the next utterance on
+    public boolean setSubGrammar(String nonterminal, String phrases) {
+        return KaldiUtil.kwang_recognizer_set_sub_grammar(this.getPointer(), nonterminal, phrases) == 1;
+    }
+
     public void reset() {
         KaldiUtil.kwang_recognizer_reset(this.getPointer());
     }
 
     @Override
     public void close() throws Exception {
+        if (pooled) {
+            KaldiUtil.kwang_recognizer_release(this.getPointer());
+            return;
+        }
         KaldiUtil.kwang_recognizer_free(this.getPointer());
     }
 }
@@ -0,0 +1,38 @@
+package com.example.kwang.kaldiandroid.util;
+
+import com.sun.jna.PointerType;
+
+// Listens for a keyword with the small model in kws/ and only then runs the
+// full recognizer on the buffered audio and what follows
+public class WakeWordRecognizer extends PointerType implements AutoCloseable {
+
+    public WakeWordRecognizer(Model model) {
+        super(KaldiUtil.kwang_wake_word_recognizer_new(model));
+    }
+
+    // one of KaldiUtil.KWANG_WAKE_NONE, KWANG_WAKE_RESULT, KWANG_WAKE_KEYWORD, or -1 on failure
+    public int acceptWaveForm(short[] data, int len) {
+        return KaldiUtil.kwang_wake_word_recognizer_accept_waveform_s(this.getPointer(), data, len);
+    }
+
+    public String getKeyword() {
+        return KaldiUtil.kwang_wake_word_recognizer_keyword(this.getPointer());
+    }
+
+    public String getResult() {
+        return KaldiUtil.kwang_wake_word_recognizer_result(this.getPointer());
+    }
+
+    public String getPartialResult() {
+        return KaldiUtil.kwang_wake_word_recognizer_partial_result(this.getPointer());
+    }
+
+    public String getFinalResult() {
+        return KaldiUtil.kwang_wake_word_recognizer_final_result(this.getPointer());
+    }
+
+    @Override
+    public void close() throws Exception {
+        KaldiUtil.kwang_wake_word_recognizer_free(this.getPointer());
+    }
+}